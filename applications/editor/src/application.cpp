@@ -5,6 +5,7 @@
 #include "backends/imgui_impl_glfw.h"
 #include "engine/components/CameraComponent.h"
 #include <cstring>
+#include <fstream>
 
 #include "ImGuiFileDialog.h"
 
@@ -16,7 +17,10 @@
 #include "engine/stb_image_write.h"
 
 #include "application.h"
+#include "imgui/raytracerPanel/engine_scene_bridge.h"
 
+// declared first so it outlives the ray tracer rendering with its materials
+engine_scene_bridge rayTracerSceneBridge;
 RayTracer rayTracerz;
 
 
@@ -69,10 +73,12 @@ RayTracer rayTracerz;
     initImGui();
     vectorDrawer = picasso();
     RTimageData.comp = STBI_rgb;
-    RTimageData.w = rayTracerz.rgb_image.get_width();
-    RTimageData.h = rayTracerz.rgb_image.get_height();
+    RTimageData.w = rayTracerz.image.get_width();
+    RTimageData.h = rayTracerz.image.get_height();
     auto texDesc = TextureDesc::new2D(TextureFormat::RGBX_UNorm8, RTimageData.w, RTimageData.h, TextureDesc::TextureUsageBits::Attachment | TextureDesc::TextureUsageBits::Sampled);
     RTtexture = gameEngine.getRenderer().getDevice().createTexture(texDesc);
+    RTcameraPosition = rayTracerz.settings.look_from;
+    RTcameraTarget = rayTracerz.settings.look_at;
 }
 
 std::unique_ptr<unsigned char[]> originalImageData;
@@ -242,17 +248,216 @@ void application::run()
         {
             ImGui::SetNextWindowSizeConstraints(ImVec2(1250, 650), ImVec2(FLT_MAX, FLT_MAX));
             ImGui::Begin("Ray Tracer", &showRayTracer, ImGuiWindowFlags_AlwaysAutoResize);
-            if (!renderedImage)
+            if (ImGui::Checkbox("Progressive", &progressiveRayTracing))
+            {
+                rayTracerz.set_progressive(progressiveRayTracing);
+                renderedImage = false;
+            }
+            ImGui::SameLine();
+            if (ImGui::Checkbox("Sobol samples", &sobolRayTracing))
+            {
+                rayTracerz.set_sampler_type(sobolRayTracing ? sampler_type::sobol : sampler_type::random);
+                renderedImage = false;
+            }
+            ImGui::SameLine();
+            if (ImGui::Checkbox("Denoise", &denoiseRayTracing))
+            {
+                renderedImage = false;
+            }
+            ImGui::SameLine();
+            // restarts show the image at a coarse resolution first, refined over the next frames
+            if (ImGui::Checkbox("Preview", &previewRayTracing))
+            {
+                rayTracerz.set_preview(previewRayTracing);
+            }
+            ImGui::SameLine();
+            if (ImGui::Button("Full image"))
+            {
+                rayTracerz.clear_region();
+                renderedImage = false;
+            }
+            if (progressiveRayTracing)
+            {
+                // progressive passes stop refining tiles below the target error, and stop altogether once the budget is spent
+                ImGui::SetNextItemWidth(150.0f);
+                if (ImGui::DragFloat("Target error", &RTtargetError, 0.001f, 0.0f, 1.0f, RTtargetError > 0.0f ? "%.3f" : "off"))
+                {
+                    rayTracerz.set_target_error(RTtargetError);
+                }
+                ImGui::SameLine();
+                ImGui::SetNextItemWidth(150.0f);
+                if (ImGui::DragFloat("Time budget", &RTtimeBudgetSeconds, 0.1f, 0.0f, 600.0f, RTtimeBudgetSeconds > 0.0f ? "%.1f s" : "off"))
+                {
+                    rayTracerz.set_time_budget(RTtimeBudgetSeconds * 1000.0);
+                }
+            }
+            if (ImGui::Checkbox("Follow engine scene", &followEngineScene) && followEngineScene)
+            {
+                // converts the meshes again in case they were edited while the ray tracer was not following them
+                rayTracerSceneBridge.invalidate();
+            }
+            if (followEngineScene)
+            {
+                // the meshes, lights and viewer camera of the engine scene replace the ones of the ray tracer, moving
+                // them only places the converted meshes again
+                if (auto scene = gameEngine.getStage().getScene())
+                {
+                    bool sceneChanged = rayTracerSceneBridge.sync_scene(*scene, rayTracerz);
+                    if (auto viewer = scene->getEntityByName("viewer"))
+                    {
+                        auto& viewerNode = viewer->getSceneNode();
+                        sceneChanged |= rayTracerSceneBridge.sync_camera(viewerNode.getWorldTransform(), *viewer->getComponent<CameraComponent>().getCamera(), rayTracerz);
+                    }
+                    if (sceneChanged)
+                    {
+                        renderedImage = false;
+                    }
+                }
+            }
+            else
+            {
+                bool cameraChanged = ImGui::DragFloat3("Camera position", &RTcameraPosition.x, 0.05f);
+                cameraChanged |= ImGui::DragFloat3("Camera target", &RTcameraTarget.x, 0.05f);
+                if (cameraChanged)
+                {
+                    rayTracerz.set_camera(RTcameraPosition, RTcameraTarget);
+                    renderedImage = false;
+                }
+            }
+            // depth of field, a focus distance of 0 keeps the camera target in focus
+            ImGui::SetNextItemWidth(150.0f);
+            bool lensChanged = ImGui::DragFloat("Aperture", &RTaperture, 0.005f, 0.0f, 2.0f, RTaperture > 0.0f ? "%.3f" : "pinhole");
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(150.0f);
+            lensChanged |= ImGui::DragFloat("Focus distance", &RTfocusDistance, 0.05f, 0.0f, 100.0f, RTfocusDistance > 0.0f ? "%.2f" : "target");
+            if (lensChanged)
+            {
+                rayTracerz.set_lens(RTaperture, RTfocusDistance);
+                renderedImage = false;
+            }
+            // the samples are kept, only the display is tonemapped again and uploaded whole
+            bool toneMappingChanged = ImGui::Checkbox("Reinhard", &RTreinhard);
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(150.0f);
+            toneMappingChanged |= ImGui::DragFloat("Exposure", &RTexposure, 0.01f, 0.01f, 16.0f, "%.2f");
+            if (toneMappingChanged)
+            {
+                rayTracerz.set_tone_mapping(RTreinhard ? tone_mapping::reinhard : tone_mapping::clamp, RTexposure);
+                if (RTtexture)
+                {
+                    RTtexture->upload(rayTracerz.image.get_pixel_data(),
+                                      TextureRangeDesc::new2D(0, 0, rayTracerz.image.get_width(), rayTracerz.image.get_height()));
+                }
+                RTframeDenoised = false;
+            }
+
+            // checked before draining so every tile of a finished frame is uploaded before the next one overwrites it
+            const bool frameFinished = rayTracerz.frame_done();
+            // the workers write their counters while a frame runs, they are only read or reset in between
+            if (frameFinished && !RTstatsUpToDate)
+            {
+                if (RTresetStats)
+                {
+                    rayTracerz.renderer.reset_worker_stats();
+                    RTresetStats = false;
+                }
+                RTstats = rayTracerz.renderer.get_stats();
+                RTstatsUpToDate = true;
+            }
+            if (RTtexture)
+            {
+                // only the regions finished since the last ui frame are copied to the texture, a denoised image is
+                // shown whole once its frame is done instead
+                rayTracerz.take_completed_tiles(RTcompletedTiles);
+                for (const tile& region: RTcompletedTiles)
+                {
+                    if (denoiseRayTracing)
+                        break;
+                    const uint32_t regionWidth = region.x_end - region.x_begin;
+                    const uint32_t regionHeight = region.y_end - region.y_begin;
+                    RTtileStaging.resize(static_cast<size_t>(regionWidth) * regionHeight * RTimageData.comp);
+                    rayTracerz.image.copy_region(region.x_begin, region.y_begin, regionWidth, regionHeight, RTtileStaging.data());
+                    RTtexture->upload(RTtileStaging.data(), TextureRangeDesc::new2D(region.x_begin, region.y_begin, regionWidth, regionHeight));
+                }
+                if (denoiseRayTracing && frameFinished && !RTframeDenoised)
+                {
+                    rayTracerz.denoise();
+                    RTtexture->upload(rayTracerz.image.get_pixel_data(),
+                                      TextureRangeDesc::new2D(0, 0, rayTracerz.image.get_width(), rayTracerz.image.get_height()));
+                    RTframeDenoised = true;
+                }
+            }
+            if (!renderedImage || (frameFinished && rayTracerz.preview_pending()) || (progressiveRayTracing && frameFinished && !rayTracerz.converged()))
             {
                 renderedImage = rayTracerz.run();
-                RTimageData.pixels = rayTracerz.rgb_image.get_pixel_data();
+                RTframeDenoised = false;
+                RTstatsUpToDate = false;
+            }
+            ImGui::Text("Samples per pixel: %u%s", rayTracerz.samples_per_pixel(),
+                        progressiveRayTracing && frameFinished && rayTracerz.converged() ? " (done)" : "");
+
+            if (ImGui::CollapsingHeader("Statistics"))
+            {
+                // totals since the last reset, the tile times are the ones of the last finished frame
+                const ray_counters totals = RTstats.totals();
+                const double rays = static_cast<double>(std::max<uint64_t>(1, totals.rays()));
+                const double busy = std::max(RTstats.busy_milliseconds(), 1.0e-3);
+                ImGui::Text("Rays: %llu primary, %llu shadow, %llu secondary", static_cast<unsigned long long>(totals.primary_rays),
+                            static_cast<unsigned long long>(totals.shadow_rays), static_cast<unsigned long long>(totals.secondary_rays));
+                ImGui::Text("Per ray: %.1f node tests, %.1f triangle tests, %.2f bounces per path", totals.node_tests / rays,
+                            totals.triangle_tests / rays, totals.average_bounces());
+                ImGui::Text("Time: traversal %.1f%%, shading %.1f%%, image write %.1f%% of %.0f ms", RTstats.traversal_milliseconds() / busy * 100.0,
+                            RTstats.shading_milliseconds() / busy * 100.0, RTstats.image_write_milliseconds() / busy * 100.0, busy);
+                float tileMin, tileMean, tileMax;
+                RTstats.tile_milliseconds(tileMin, tileMean, tileMax);
+                ImGui::Text("Tiles: %.3f / %.3f / %.3f ms (min / mean / max)", tileMin, tileMean, tileMax);
+                for (size_t i = 0; i < RTstats.workers.size(); ++i)
+                {
+                    const worker_stats& worker = RTstats.workers[i];
+                    ImGui::Text("Thread %zu: %.0f ms busy, %u tiles (%u stolen), %llu rays", i, worker.busy_milliseconds, worker.tiles,
+                                worker.stolen_tiles, static_cast<unsigned long long>(worker.counters.rays()));
+                }
+                if (ImGui::Button("Reset statistics"))
+                {
+                    RTresetStats = true;
+                    RTstatsUpToDate = false;
+                }
+                ImGui::SameLine();
+                if (ImGui::Button("Save statistics"))
+                {
+                    std::ofstream json("raytracer_stats.json");
+                    RTstats.write_json(json);
+                    std::cout << "Ray tracer statistics written to raytracer_stats.json" << std::endl;
+                }
             }
 
             if (RTtexture)
             {
-                RTtexture->upload(RTimageData.pixels, TextureRangeDesc::new2D(0, 0, RTimageData.w, RTimageData.h));
                 ImGui::Text("RTImage:");
                 ImGui::Image(RTtexture.get(), ImVec2(RTtexture->getWidth(), RTtexture->getHeight()));
+                // dragging with the right button over the image renders only the selected rectangle
+                const ImVec2 imageOrigin = ImGui::GetItemRectMin();
+                const glm::vec2 cursor{ImGui::GetMousePos().x - imageOrigin.x, ImGui::GetMousePos().y - imageOrigin.y};
+                if (ImGui::IsItemHovered() && ImGui::IsMouseClicked(ImGuiMouseButton_Right))
+                {
+                    RTselectingRegion = true;
+                    RTregionStart = cursor;
+                }
+                if (RTselectingRegion)
+                {
+                    const glm::vec2 imageSize{RTtexture->getWidth(), RTtexture->getHeight()};
+                    const glm::vec2 corner0 = glm::clamp(glm::min(RTregionStart, cursor), glm::vec2{0.0f}, imageSize);
+                    const glm::vec2 corner1 = glm::clamp(glm::max(RTregionStart, cursor), glm::vec2{0.0f}, imageSize);
+                    ImGui::GetWindowDrawList()->AddRect(ImVec2(imageOrigin.x + corner0.x, imageOrigin.y + corner0.y),
+                                                        ImVec2(imageOrigin.x + corner1.x, imageOrigin.y + corner1.y), IM_COL32(255, 200, 0, 255));
+                    if (ImGui::IsMouseReleased(ImGuiMouseButton_Right))
+                    {
+                        RTselectingRegion = false;
+                        rayTracerz.set_region({static_cast<uint32_t>(corner0.x), static_cast<uint32_t>(corner0.y),
+                                               static_cast<uint32_t>(std::ceil(corner1.x)), static_cast<uint32_t>(std::ceil(corner1.y))});
+                        renderedImage = false;
+                    }
+                }
             }
             ImGui::End();
         }
@@ -98,10 +98,31 @@ private:
     bool showRayTracer = false;
     bool showCurvesUwu = false;
     bool renderedImage = false;
+    bool progressiveRayTracing = false;
+    bool sobolRayTracing = false;
+    bool denoiseRayTracing = false;
+    bool followEngineScene = false;
+    bool previewRayTracing = false;
+    bool RTselectingRegion = false;
+    glm::vec2 RTregionStart{};
+    bool RTframeDenoised = false;
+    float RTtargetError = 0.0f;
+    float RTtimeBudgetSeconds = 0.0f;
     picasso vectorDrawer;
     CurvesDrawer curvesDrawer;
     std::shared_ptr<ITexture> RTtexture;
     ImageData RTimageData;
+    std::vector<tile> RTcompletedTiles;
+    std::vector<uint8_t> RTtileStaging;
+    render_stats RTstats;
+    bool RTstatsUpToDate = false;
+    bool RTresetStats = false;
+    glm::vec3 RTcameraPosition{};
+    glm::vec3 RTcameraTarget{};
+    float RTaperture = 0.0f;
+    float RTfocusDistance = 0.0f;
+    bool RTreinhard = false;
+    float RTexposure = 1.0f;
 
     std::vector<vec3> corners{
             {0.15f, 0.15f, 0.0f},
@@ -0,0 +1,368 @@
+#pragma once
+
+#include <memory>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "engine/Camera.h"
+#include "engine/Light.h"
+#include "engine/Scene.h"
+#include "engine/SceneRenderData.h"
+#include "engine/Transform.h"
+#include "engine/graphics/MaterialResource.h"
+#include "engine/graphics/MeshResource.h"
+#include "rt.h"
+#include "renderer/scene/objects/lights/directional_light.h"
+#include "renderer/scene/objects/lights/spot_light.h"
+#include "renderer/scene/objects/materials/emissive.h"
+
+//Builds the world of the ray tracer from an engine Scene instead of its own. Every mesh resource is converted once
+//from its loaded vertices into a shared triangle_mesh, placed by a mesh_instance with the world transform of its node.
+//When only transforms changed, a sync places the same meshes again and only the top level BVH is built again.
+//The materials are read from the uniforms of the engine pbr shader the first time they are met, the texture maps are
+//left out. To be destroyed after the ray tracer it feeds, which keeps pointers to its materials.
+class engine_scene_bridge
+{
+public:
+    engine_scene_bridge() = default;
+    engine_scene_bridge(const engine_scene_bridge&) = delete;
+    engine_scene_bridge& operator=(const engine_scene_bridge&) = delete;
+
+    ~engine_scene_bridge()
+    {
+        for (const auto& [resource, converted]: materials)
+        {
+            delete_material(converted);
+        }
+        delete_material(default_material);
+    }
+
+    //brings the objects and lights of the ray tracer up to date with the visible nodes of the scene, true when they
+    //changed and the accumulation restarted
+    bool sync_scene(const Scene& p_scene, RayTracer& p_ray_tracer)
+    {
+        p_scene.getSceneRenderData(render_data);
+
+        std::vector<placement> new_placements;
+        new_placements.reserve(render_data.meshRenderData.size());
+        for (const MeshRenderData& item: render_data.meshRenderData)
+        {
+            if (item.mesh != nullptr)
+            {
+                new_placements.push_back({item.mesh.get(), item.material.get(), item.modelMatrix});
+            }
+        }
+        std::vector<placed_light> new_lights;
+        new_lights.reserve(render_data.lights.size());
+        for (const LightData& item: render_data.lights)
+        {
+            const Light& light = *item.light;
+            new_lights.push_back({light.getType(), item.position, item.direction, light.getColor(), light.getIntensity(),
+                                  light.getCutOff(), light.getOuterCutOff()});
+        }
+
+        if (synced && new_placements == placements && new_lights == lights)
+        {
+            return false;
+        }
+        placements = std::move(new_placements);
+        lights = std::move(new_lights);
+        synced = true;
+
+        p_ray_tracer.edit_scene([&](object_manager& objects) {
+            objects.clear_objects();
+            if (reload_resources)
+            {
+                release_resources(objects);
+                reload_resources = false;
+            }
+
+            std::unordered_set<const MeshResource*> placed_meshes;
+            for (const MeshRenderData& item: render_data.meshRenderData)
+            {
+                if (item.mesh == nullptr)
+                    continue;
+                const triangle_mesh* mesh = find_or_convert_mesh(item.mesh, objects);
+                if (mesh != nullptr)
+                {
+                    objects.add_object(new mesh_instance{mesh, item.modelMatrix, find_or_convert_material(item.material)});
+                }
+                placed_meshes.insert(item.mesh.get());
+            }
+            //meshes of the nodes removed since the last sync
+            for (auto it = meshes.begin(); it != meshes.end();)
+            {
+                if (placed_meshes.contains(it->first))
+                {
+                    ++it;
+                    continue;
+                }
+                objects.remove_shared_mesh(it->second.mesh);
+                it = meshes.erase(it);
+            }
+
+            for (const placed_light& light: lights)
+            {
+                objects.add_light(convert_light(light));
+            }
+        });
+        return true;
+    }
+
+    //moves the ray tracer camera to the node of an engine camera with the same vertical field of view, true when it
+    //moved and the accumulation restarted
+    bool sync_camera(const Transform& p_world_transform, const Camera& p_camera, RayTracer& p_ray_tracer)
+    {
+        const point3 position = p_world_transform.getPosition();
+        const vec3 forward = p_world_transform.getForward();
+        const vec3 up = p_world_transform.getUp();
+        //the projection scales y by the cotangent of half the field of view
+        const float vfov = glm::degrees(2.0f * std::atan(1.0f / p_camera.getProjection()[1][1]));
+        if (camera_synced && position == camera_position && forward == camera_forward && up == camera_up && vfov == camera_vfov)
+        {
+            return false;
+        }
+        if (!camera_synced || vfov != camera_vfov)
+        {
+            p_ray_tracer.set_field_of_view(vfov);
+        }
+        p_ray_tracer.set_camera(position, position + forward, up);
+        camera_position = position;
+        camera_forward = forward;
+        camera_up = up;
+        camera_vfov = vfov;
+        camera_synced = true;
+        return true;
+    }
+
+    //the next sync converts every mesh and material again, for a scene edited in ways the transforms do not show
+    void invalidate()
+    {
+        synced = false;
+        camera_synced = false;
+        reload_resources = true;
+    }
+
+private:
+    //layout of the "Settings" uniform buffer of the engine pbr shader
+    struct alignas(16) pbr_settings
+    {
+        int use_albedo_map{true};
+        int use_normal_map{true};
+        int use_metallic_map{true};
+        int use_roughness_map{true};
+        int use_ao_map{true};
+        int use_emissive_map{true};
+
+        alignas(16) glm::vec3 base_color{1.0f};
+        float metallic{0.0f};
+        float roughness{0.5f};
+        float ao{1.0f};
+        alignas(16) glm::vec3 emission_color{1.0f};
+        float emission_intensity{0.0f};
+        int light_model{0};
+    };
+
+    //what a sync compares to find out whether the world changed
+    struct placement
+    {
+        const MeshResource* mesh;
+        const MaterialResource* material;
+        glm::mat4 transform;
+
+        bool operator==(const placement&) const = default;
+    };
+
+    struct placed_light
+    {
+        LightType type;
+        point3 position;
+        vec3 direction;
+        color3 color;
+        float intensity;
+        float cut_off;
+        float outer_cut_off;
+
+        bool operator==(const placed_light&) const = default;
+    };
+
+    //the resources are kept alive so their addresses are not reused by new ones while they are cached
+    struct converted_mesh
+    {
+        std::shared_ptr<MeshResource> resource;
+        const triangle_mesh* mesh;
+    };
+
+    struct converted_material
+    {
+        std::shared_ptr<MaterialResource> resource;
+        const color3* color{nullptr};
+        const i_texture* texture{nullptr};
+        const i_material* material{nullptr};
+    };
+
+    const triangle_mesh* find_or_convert_mesh(const std::shared_ptr<MeshResource>& p_resource, object_manager& objects)
+    {
+        if (const auto found = meshes.find(p_resource.get()); found != meshes.end())
+        {
+            return found->second.mesh;
+        }
+
+        const indexed_mesh data = to_indexed_mesh(p_resource->getMesh());
+        const triangle_mesh* mesh = data.indices.empty() ? nullptr : objects.add_shared_mesh(new triangle_mesh{default_material.material, data});
+        meshes.emplace(p_resource.get(), converted_mesh{p_resource, mesh});
+        return mesh;
+    }
+
+    //the vertex buffer is used as the vertex pool as it is, only the normals it lacks are computed
+    static indexed_mesh to_indexed_mesh(const Mesh& p_mesh)
+    {
+        indexed_mesh data;
+        data.positions.reserve(p_mesh.vertices.size());
+        data.normals.reserve(p_mesh.vertices.size());
+        bool missing_normals{false};
+        for (const Mesh::Vertex& vertex: p_mesh.vertices)
+        {
+            data.positions.push_back(vertex.position);
+            data.normals.push_back(vertex.normal);
+            missing_normals |= glm::dot(vertex.normal, vertex.normal) == 0.0f;
+        }
+
+        if (p_mesh.indices.empty())
+        {
+            data.indices.resize(p_mesh.vertices.size() - p_mesh.vertices.size() % 3);
+            std::iota(data.indices.begin(), data.indices.end(), 0u);
+        }
+        else
+        {
+            data.indices.assign(p_mesh.indices.begin(), p_mesh.indices.end() - static_cast<std::ptrdiff_t>(p_mesh.indices.size() % 3));
+        }
+
+        if (missing_normals)
+        {
+            std::vector<bool> has_normal(data.normals.size());
+            for (size_t i = 0; i < data.normals.size(); ++i)
+            {
+                has_normal[i] = glm::dot(data.normals[i], data.normals[i]) > 0.0f;
+            }
+            for (size_t i = 0; i < data.indices.size(); i += 3)
+            {
+                const uint32_t* triangle = &data.indices[i];
+                const vec3 face_normal = glm::cross(data.positions[triangle[1]] - data.positions[triangle[0]],
+                                                    data.positions[triangle[2]] - data.positions[triangle[0]]);
+                for (uint32_t corner = 0; corner < 3; ++corner)
+                {
+                    if (!has_normal[triangle[corner]])
+                    {
+                        data.normals[triangle[corner]] += face_normal;
+                    }
+                }
+            }
+            for (size_t i = 0; i < data.normals.size(); ++i)
+            {
+                if (!has_normal[i] && glm::dot(data.normals[i], data.normals[i]) > 0.0f)
+                {
+                    data.normals[i] = glm::normalize(data.normals[i]);
+                }
+            }
+        }
+        return data;
+    }
+
+    const i_material* find_or_convert_material(const std::shared_ptr<MaterialResource>& p_resource)
+    {
+        if (p_resource == nullptr)
+        {
+            return default_material.material;
+        }
+        if (const auto found = materials.find(p_resource.get()); found != materials.end())
+        {
+            return found->second.material;
+        }
+
+        pbr_settings settings;
+        p_resource->getCachedUniformData("Settings", settings);
+
+        converted_material converted{p_resource};
+        if (!settings.use_emissive_map && settings.emission_intensity > 0.0f)
+        {
+            converted.material = new emissive{glm::clamp(settings.emission_color, 0.0f, 1.0f) * settings.emission_intensity};
+        }
+        else
+        {
+            //rough surfaces scatter their reflection more, metals reflect more of the light specularly
+            converted.color = new color3{settings.base_color};
+            converted.texture = new base_color{converted.color};
+            converted.material = new metal{converted.texture, settings.roughness * max_diffusion,
+                                           settings.metallic * (1.0f - settings.roughness) * max_shininess};
+        }
+        return materials.emplace(p_resource.get(), converted).first->second.material;
+    }
+
+    //to call while no frame is in flight, once the objects placing them are deleted
+    void release_resources(object_manager& objects)
+    {
+        for (const auto& [resource, converted]: meshes)
+        {
+            objects.remove_shared_mesh(converted.mesh);
+        }
+        meshes.clear();
+        for (const auto& [resource, converted]: materials)
+        {
+            delete_material(converted);
+        }
+        materials.clear();
+    }
+
+    static converted_material make_default_material()
+    {
+        converted_material converted;
+        converted.color = new color3{0.5f, 0.5f, 0.5f};
+        converted.texture = new base_color{converted.color};
+        converted.material = new metal{converted.texture, 0.5f * max_diffusion, 0.0f};
+        return converted;
+    }
+
+    static void delete_material(const converted_material& converted)
+    {
+        delete converted.material;
+        delete converted.texture;
+        delete converted.color;
+    }
+
+    //the attenuation terms of the engine lights are left out, the lights of the ray tracer fade with a fixed one
+    static const i_light* convert_light(const placed_light& light)
+    {
+        switch (light.type)
+        {
+            case LightType::Directional:
+                return new directional_light{light.direction, light.color, light.intensity};
+            case LightType::Spot:
+                return new spot_light{light.position, light.direction, light.color, light.intensity, light.cut_off, light.outer_cut_off};
+            case LightType::Point:
+            default:
+                return new point_light{light.position, light.color, light.intensity};
+        }
+    }
+
+    static constexpr float max_diffusion{20.0f};
+    static constexpr float max_shininess{100.0f};
+
+    SceneRenderData render_data;
+    std::vector<placement> placements;
+    std::vector<placed_light> lights;
+    bool synced{false};
+    bool reload_resources{false};
+
+    std::unordered_map<const MeshResource*, converted_mesh> meshes;
+    std::unordered_map<const MaterialResource*, converted_material> materials;
+    const converted_material default_material{make_default_material()};
+
+    point3 camera_position{};
+    vec3 camera_forward{};
+    vec3 camera_up{};
+    float camera_vfov{0.0f};
+    bool camera_synced{false};
+};
@@ -0,0 +1,575 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "tiny_obj_loader.h"
+#include "../renderer/mapped_file.h"
+#include "../renderer/utils.h"
+#include "glm/geometric.hpp"
+
+//Reads the triangles of an obj file straight into an indexed mesh, without holding the text or a per face copy of it.
+//The mapped file is cut into chunks at line ends that are read in parallel twice: a first pass counts the vertices,
+//normals, texture coordinates and triangles of every chunk, which gives each chunk the place of its elements in the
+//final arrays and resolves the relative indices of its faces, and a second pass parses them into those places. Faces
+//of more than 3 corners are split in fans, quads along their shorter diagonal like tiny_obj_loader does. Every
+//distinct combination of position, normal and texture coordinate becomes a vertex of the pool; a position used with a
+//single combination, as in most files, keeps its index so the pool needs no lookup table. Groups, smoothing groups and
+//per face materials are ignored, the mesh is one object with the materials of its first material library.
+class obj_stream_reader
+{
+public:
+    //a thread count of 0 uses every hardware thread
+    explicit obj_stream_reader(const size_t p_thread_count = 0)
+        : thread_count(p_thread_count > 0 ? p_thread_count : std::max(1u, std::thread::hardware_concurrency()))
+    {
+    }
+
+    //false when the file cannot be read, error() tells why. Faces with an index out of range are dropped with a warning
+    bool load(const std::string& p_path, indexed_mesh& mesh)
+    {
+        error_message.clear();
+        warning_message.clear();
+        materials.clear();
+        const mapped_file file(p_path, true);
+        if (!file.is_open())
+        {
+            error_message = "cannot open " + p_path;
+            return false;
+        }
+        file_bytes = file.get_size();
+        split(file.data(), file.get_size());
+
+        for_each_chunk([&](chunk& part) { count(part); });
+        uint64_t position_count{0}, normal_count{0}, texcoord_count{0}, triangle_count{0};
+        for (chunk& part: chunks)
+        {
+            part.first_position = position_count;
+            part.first_normal = normal_count;
+            part.first_texcoord = texcoord_count;
+            part.first_triangle = triangle_count;
+            position_count += part.positions;
+            normal_count += part.normals;
+            texcoord_count += part.texcoords;
+            triangle_count += part.triangles;
+        }
+        if (position_count >= invalid_index || 3 * triangle_count >= invalid_index)
+        {
+            error_message = p_path + " has more than 2^32 vertices or corners";
+            return false;
+        }
+
+        //without normals or texture coordinates the positions are the pool and the faces index them directly
+        const bool has_attributes = normal_count > 0 || texcoord_count > 0;
+        mesh = {};
+        mesh.positions.resize(position_count);
+        file_normals.resize(normal_count);
+        file_texcoords.resize(texcoord_count);
+        corners.resize(has_attributes ? 3 * triangle_count : 0);
+        mesh.indices.resize(has_attributes ? 0 : 3 * triangle_count);
+        totals = {position_count, normal_count, texcoord_count};
+
+        for_each_chunk([&](chunk& part) { parse(part, mesh, has_attributes); });
+        for_each_chunk([&](chunk& part) {
+            if (has_attributes)
+                split_quads(part, corners.data(), mesh.positions);
+            else
+                split_quads(part, mesh.indices.data(), mesh.positions);
+        });
+
+        std::vector<bool> has_normal;
+        if (has_attributes)
+        {
+            build_pool(mesh, has_normal, texcoord_count > 0);
+        }
+        else
+        {
+            mesh.normals.assign(mesh.positions.size(), vec3{0.0f, 0.0f, 0.0f});
+            has_normal.assign(mesh.positions.size(), false);
+        }
+        drop_invalid_triangles(mesh);
+        compute_missing_normals(mesh, has_normal);
+
+        load_materials(std::filesystem::path(p_path).parent_path());
+        chunks.clear();
+        chunks.shrink_to_fit();
+        return true;
+    }
+
+    [[nodiscard]] const std::vector<tinyobj::material_t>& get_materials() const { return materials; }
+    [[nodiscard]] const std::string& error() const { return error_message; }
+    [[nodiscard]] const std::string& warning() const { return warning_message; }
+    [[nodiscard]] size_t get_file_bytes() const { return file_bytes; }
+    [[nodiscard]] size_t get_chunk_count() const { return chunk_count; }
+    [[nodiscard]] size_t get_thread_count() const { return thread_count; }
+
+private:
+    static constexpr uint32_t invalid_index{0xffffffffu};
+    //chunks smaller than this cost more to schedule than to parse
+    static constexpr size_t min_chunk_bytes{1u << 20};
+    //more chunks than threads so a chunk full of faces does not hold the others up
+    static constexpr size_t chunks_per_thread{8};
+
+    //corner of a face as written in the file, 0 based, -1 for an attribute it does not have
+    struct obj_corner
+    {
+        int64_t position;
+        int64_t normal;
+        int64_t texcoord;
+    };
+
+    //corner of a triangle with its attributes resolved, the position is invalid_index when the face is dropped
+    struct pool_corner
+    {
+        uint32_t position;
+        uint32_t normal;
+        uint32_t texcoord;
+
+        bool operator==(const pool_corner&) const = default;
+    };
+
+    struct pool_corner_hash
+    {
+        size_t operator()(const pool_corner& corner) const
+        {
+            const uint64_t low = static_cast<uint64_t>(corner.position) << 32 | corner.normal;
+            return std::hash<uint64_t>{}(low ^ static_cast<uint64_t>(corner.texcoord) * 0x9e3779b97f4a7c15ull);
+        }
+    };
+
+    struct chunk
+    {
+        const char* begin{nullptr};
+        const char* end{nullptr};
+        uint64_t positions{0}, normals{0}, texcoords{0}, triangles{0};
+        uint64_t first_position{0}, first_normal{0}, first_texcoord{0}, first_triangle{0};
+        std::vector<uint64_t> quads{}; //first of the two triangles of every quad
+        std::vector<std::string> material_libraries{};
+        uint64_t invalid_faces{0};
+    };
+
+    struct attribute_totals
+    {
+        uint64_t positions, normals, texcoords;
+    };
+
+    //chunk boundaries are moved to the next line start, so no line is cut
+    void split(const char* data, const size_t size)
+    {
+        chunks.clear();
+        const size_t wanted = std::clamp<size_t>(size / min_chunk_bytes, 1, thread_count * chunks_per_thread);
+        const char* end = data + size;
+        const char* begin = data;
+        for (size_t i = 1; i <= wanted && begin < end; ++i)
+        {
+            const char* cut = i == wanted ? end : data + size / wanted * i;
+            if (cut < begin)
+                cut = begin;
+            const char* line_end = cut < end ? static_cast<const char*>(std::memchr(cut, '\n', end - cut)) : nullptr;
+            cut = line_end == nullptr || i == wanted ? end : line_end + 1;
+            chunks.push_back({begin, cut});
+            begin = cut;
+        }
+        chunk_count = chunks.size();
+    }
+
+    void for_each_chunk(const std::function<void(chunk&)>& job)
+    {
+        std::atomic<size_t> next{0};
+        const size_t workers = std::min(thread_count, chunks.size());
+        auto run = [&] {
+            for (size_t i = next.fetch_add(1); i < chunks.size(); i = next.fetch_add(1))
+                job(chunks[i]);
+        };
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < workers; ++i)
+            threads.emplace_back(run);
+        run();
+        for (std::thread& thread: threads)
+            thread.join();
+    }
+
+    static bool is_space(const char c)
+    {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+
+    static const char* skip_spaces(const char* p, const char* end)
+    {
+        while (p < end && is_space(*p))
+            ++p;
+        return p;
+    }
+
+    //the keyword of a line, the pointer is left after it
+    static std::string_view keyword(const char*& p, const char* end)
+    {
+        p = skip_spaces(p, end);
+        const char* start = p;
+        while (p < end && !is_space(*p))
+            ++p;
+        return {start, static_cast<size_t>(p - start)};
+    }
+
+    template<typename line_function>
+    static void for_each_line(const chunk& part, const line_function& function)
+    {
+        for (const char* line = part.begin; line < part.end;)
+        {
+            const char* newline = static_cast<const char*>(std::memchr(line, '\n', part.end - line));
+            if (newline == nullptr)
+            {
+                function(line, part.end);
+                break;
+            }
+            function(line, newline);
+            line = newline + 1;
+        }
+    }
+
+    static uint64_t count_face_corners(const char* p, const char* end)
+    {
+        uint64_t corner_count{0};
+        for (p = skip_spaces(p, end); p < end; p = skip_spaces(p, end))
+        {
+            ++corner_count;
+            while (p < end && !is_space(*p))
+                ++p;
+        }
+        return corner_count;
+    }
+
+    static void count(chunk& part)
+    {
+        for_each_line(part, [&](const char* p, const char* end) {
+            const std::string_view word = keyword(p, end);
+            if (word == "v")
+                ++part.positions;
+            else if (word == "vn")
+                ++part.normals;
+            else if (word == "vt")
+                ++part.texcoords;
+            else if (word == "f")
+            {
+                const uint64_t corner_count = count_face_corners(p, end);
+                part.triangles += corner_count >= 3 ? corner_count - 2 : 0;
+            }
+            else if (word == "mtllib")
+            {
+                p = skip_spaces(p, end);
+                const char* name_end = end;
+                while (name_end > p && is_space(name_end[-1]))
+                    --name_end;
+                part.material_libraries.emplace_back(p, name_end);
+            }
+        });
+    }
+
+    static float parse_float(const char*& p, const char* end)
+    {
+        p = skip_spaces(p, end);
+        if (p < end && *p == '+')
+            ++p;
+        float value{0.0f};
+        const auto [next, status] = std::from_chars(p, end, value);
+        if (status != std::errc{})
+        {
+            while (p < end && !is_space(*p))
+                ++p;
+            return 0.0f;
+        }
+        p = next;
+        return value;
+    }
+
+    //obj indices start at 1, negative ones count back from the last element read before the face
+    static int64_t resolve_index(const char*& p, const char* end, const uint64_t read_before)
+    {
+        int64_t index{0};
+        const auto [next, status] = std::from_chars(p, end, index);
+        if (status != std::errc{})
+            return -1;
+        p = next;
+        if (index > 0)
+            return index - 1;
+        if (index < 0)
+            return static_cast<int64_t>(read_before) + index;
+        return std::numeric_limits<int64_t>::min();
+    }
+
+    //one v, v/vt, v//vn or v/vt/vn corner
+    static obj_corner parse_corner(const char*& p, const char* end, const chunk& part, const uint64_t positions, const uint64_t normals,
+                                   const uint64_t texcoords)
+    {
+        obj_corner corner{resolve_index(p, end, part.first_position + positions), -1, -1};
+        if (p < end && *p == '/')
+        {
+            ++p;
+            if (p < end && *p != '/')
+                corner.texcoord = resolve_index(p, end, part.first_texcoord + texcoords);
+            if (p < end && *p == '/')
+            {
+                ++p;
+                corner.normal = resolve_index(p, end, part.first_normal + normals);
+            }
+        }
+        while (p < end && !is_space(*p))
+            ++p;
+        return corner;
+    }
+
+    void parse(chunk& part, indexed_mesh& mesh, const bool has_attributes)
+    {
+        uint64_t positions{0}, normals{0}, texcoords{0};
+        uint64_t triangle = part.first_triangle;
+        std::vector<pool_corner> face;
+        for_each_line(part, [&](const char* p, const char* end) {
+            const std::string_view word = keyword(p, end);
+            if (word == "v")
+            {
+                point3& position = mesh.positions[part.first_position + positions++];
+                position.x = parse_float(p, end);
+                position.y = parse_float(p, end);
+                position.z = parse_float(p, end);
+            }
+            else if (word == "vn")
+            {
+                vec3& normal = file_normals[part.first_normal + normals++];
+                normal.x = parse_float(p, end);
+                normal.y = parse_float(p, end);
+                normal.z = parse_float(p, end);
+            }
+            else if (word == "vt")
+            {
+                glm::vec2& texcoord = file_texcoords[part.first_texcoord + texcoords++];
+                texcoord.x = parse_float(p, end);
+                texcoord.y = parse_float(p, end);
+            }
+            else if (word == "f")
+            {
+                face.clear();
+                bool valid{true};
+                for (p = skip_spaces(p, end); p < end; p = skip_spaces(p, end))
+                {
+                    const obj_corner corner = parse_corner(p, end, part, positions, normals, texcoords);
+                    valid &= corner.position >= 0 && static_cast<uint64_t>(corner.position) < totals.positions;
+                    //an attribute out of range is treated as missing, the position alone still places the corner
+                    const bool has_normal = corner.normal >= 0 && static_cast<uint64_t>(corner.normal) < totals.normals;
+                    const bool has_texcoord = corner.texcoord >= 0 && static_cast<uint64_t>(corner.texcoord) < totals.texcoords;
+                    face.push_back({static_cast<uint32_t>(corner.position), has_normal ? static_cast<uint32_t>(corner.normal) : invalid_index,
+                                    has_texcoord ? static_cast<uint32_t>(corner.texcoord) : invalid_index});
+                }
+                if (face.size() < 3)
+                    return;
+                if (!valid)
+                {
+                    ++part.invalid_faces;
+                    face[0].position = invalid_index;
+                }
+                if (face.size() == 4)
+                    part.quads.push_back(triangle);
+                for (size_t corner = 2; corner < face.size(); ++corner, ++triangle)
+                {
+                    if (has_attributes)
+                    {
+                        corners[3 * triangle + 0] = face[0];
+                        corners[3 * triangle + 1] = face[corner - 1];
+                        corners[3 * triangle + 2] = face[corner];
+                    }
+                    else
+                    {
+                        mesh.indices[3 * triangle + 0] = face[0].position;
+                        mesh.indices[3 * triangle + 1] = face[corner - 1].position;
+                        mesh.indices[3 * triangle + 2] = face[corner].position;
+                    }
+                }
+            }
+        });
+    }
+
+    static uint32_t position_of(const pool_corner& corner) { return corner.position; }
+    static uint32_t position_of(const uint32_t index) { return index; }
+
+    //quads are read as (0, 1, 2) (0, 2, 3) and split along (1, 3) instead when it is the shorter diagonal
+    template<typename corner_type>
+    static void split_quads(const chunk& part, corner_type* triangle_corners, const std::vector<point3>& positions)
+    {
+        for (const uint64_t triangle: part.quads)
+        {
+            corner_type* quad = triangle_corners + 3 * triangle;
+            if (position_of(quad[0]) == invalid_index)
+                continue;
+            const corner_type c0 = quad[0], c1 = quad[1], c2 = quad[2], c3 = quad[5];
+            const vec3 e02 = positions[position_of(c2)] - positions[position_of(c0)];
+            const vec3 e13 = positions[position_of(c3)] - positions[position_of(c1)];
+            if (glm::dot(e02, e02) < glm::dot(e13, e13))
+                continue;
+            quad[0] = c0, quad[1] = c1, quad[2] = c3;
+            quad[3] = c1, quad[4] = c2, quad[5] = c3;
+        }
+    }
+
+    //a position keeps its index for the first normal and texture coordinate it is used with, further combinations are
+    //appended after the positions of the file
+    void build_pool(indexed_mesh& mesh, std::vector<bool>& has_normal, const bool has_texcoords)
+    {
+        const size_t file_positions = mesh.positions.size();
+        std::vector<std::pair<uint32_t, uint32_t>> first_use(file_positions, {invalid_index, invalid_index});
+        std::vector<bool> used(file_positions, false);
+        std::unordered_map<pool_corner, uint32_t, pool_corner_hash> extra_vertices;
+        std::vector<std::pair<uint32_t, uint32_t>> extra_attributes;
+
+        mesh.indices.resize(corners.size());
+        for (size_t i = 0; i < corners.size(); ++i)
+        {
+            const pool_corner& corner = corners[3 * (i / 3)];
+            const pool_corner& current = corners[i];
+            if (corner.position == invalid_index)
+            {
+                mesh.indices[i] = invalid_index;
+                continue;
+            }
+            const std::pair<uint32_t, uint32_t> attributes{current.normal, current.texcoord};
+            if (!used[current.position])
+            {
+                used[current.position] = true;
+                first_use[current.position] = attributes;
+                mesh.indices[i] = current.position;
+            }
+            else if (first_use[current.position] == attributes)
+            {
+                mesh.indices[i] = current.position;
+            }
+            else
+            {
+                const auto [it, inserted] = extra_vertices.try_emplace(current, static_cast<uint32_t>(file_positions + extra_attributes.size()));
+                if (inserted)
+                {
+                    extra_attributes.push_back(attributes);
+                    mesh.positions.push_back(mesh.positions[current.position]);
+                }
+                mesh.indices[i] = it->second;
+            }
+        }
+        corners.clear();
+        corners.shrink_to_fit();
+        extra_vertices = {};
+
+        //unused positions keep a zero normal, no triangle reads it
+        const size_t pool_size = mesh.positions.size();
+        mesh.normals.assign(pool_size, vec3{0.0f, 0.0f, 0.0f});
+        has_normal.assign(pool_size, false);
+        if (has_texcoords)
+            mesh.texcoords.assign(pool_size, glm::vec2{0.0f, 0.0f});
+        for (size_t vertex = 0; vertex < pool_size; ++vertex)
+        {
+            const std::pair<uint32_t, uint32_t>& attributes = vertex < file_positions ? first_use[vertex] : extra_attributes[vertex - file_positions];
+            if (vertex < file_positions && !used[vertex])
+            {
+                has_normal[vertex] = true;
+                continue;
+            }
+            if (attributes.first != invalid_index)
+            {
+                mesh.normals[vertex] = file_normals[attributes.first];
+                has_normal[vertex] = true;
+            }
+            if (has_texcoords && attributes.second != invalid_index)
+                mesh.texcoords[vertex] = file_texcoords[attributes.second];
+        }
+        file_normals = {};
+        file_texcoords = {};
+    }
+
+    void drop_invalid_triangles(indexed_mesh& mesh)
+    {
+        uint64_t invalid_faces{0};
+        for (const chunk& part: chunks)
+            invalid_faces += part.invalid_faces;
+        if (invalid_faces == 0)
+            return;
+        warning_message += std::to_string(invalid_faces) + " faces with a vertex index out of range dropped\n";
+        size_t kept{0};
+        for (size_t i = 0; i < mesh.indices.size(); i += 3)
+        {
+            if (mesh.indices[i] == invalid_index)
+                continue;
+            std::copy_n(&mesh.indices[i], 3, &mesh.indices[kept]);
+            kept += 3;
+        }
+        mesh.indices.resize(kept);
+    }
+
+    //vertices without a normal in the file get the area weighted normal of the faces around them
+    static void compute_missing_normals(indexed_mesh& mesh, const std::vector<bool>& has_normal)
+    {
+        for (size_t i = 0; i < mesh.indices.size(); i += 3)
+        {
+            const uint32_t* triangle = &mesh.indices[i];
+            const vec3 face_normal = glm::cross(mesh.positions[triangle[1]] - mesh.positions[triangle[0]],
+                                                mesh.positions[triangle[2]] - mesh.positions[triangle[0]]);
+            for (uint32_t corner = 0; corner < 3; ++corner)
+            {
+                if (!has_normal[triangle[corner]])
+                {
+                    mesh.normals[triangle[corner]] += face_normal;
+                }
+            }
+        }
+        for (size_t i = 0; i < mesh.normals.size(); ++i)
+        {
+            if (!has_normal[i])
+            {
+                mesh.normals[i] = glm::normalize(mesh.normals[i]);
+            }
+        }
+    }
+
+    //the materials of the first material library found next to the obj file
+    void load_materials(const std::filesystem::path& directory)
+    {
+        for (const chunk& part: chunks)
+        {
+            for (const std::string& library: part.material_libraries)
+            {
+                std::ifstream stream(directory / library);
+                if (!stream)
+                {
+                    warning_message += "material library " + library + " not found\n";
+                    continue;
+                }
+                std::map<std::string, int> material_map;
+                std::string error;
+                tinyobj::LoadMtl(&material_map, &materials, &stream, &warning_message, &error);
+                warning_message += error;
+                return;
+            }
+        }
+    }
+
+    const size_t thread_count;
+    std::vector<chunk> chunks;
+    size_t chunk_count{0};
+    size_t file_bytes{0};
+    attribute_totals totals{0, 0, 0};
+    //attributes as read from the file, until the pool copies them to its vertices
+    std::vector<vec3> file_normals;
+    std::vector<glm::vec2> file_texcoords;
+    std::vector<pool_corner> corners;
+    std::vector<tinyobj::material_t> materials;
+    std::string error_message;
+    std::string warning_message;
+};
@@ -0,0 +1,67 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct tile
+{
+    uint32_t x_begin;
+    uint32_t y_begin;
+    uint32_t x_end;
+    uint32_t y_end;
+};
+
+//Tiles whose pixels are final, pushed by the workers and drained by the thread displaying the image.
+//The mutex orders the pixel writes of a tile before its read by the consumer.
+class completed_tile_queue
+{
+public:
+    void push(const tile& p_tile)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tiles.push_back(p_tile);
+    }
+
+    //moves the completed tiles into regions, runs of touching tiles of the same tile row are merged into one span so
+    //a consumer uploading each region issues fewer copies. Tiles apart stay apart, the tiles between them may still
+    //be traced.
+    void drain(std::vector<tile>& regions)
+    {
+        regions.clear();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::swap(regions, tiles);
+        }
+        if (regions.empty())
+            return;
+
+        std::sort(regions.begin(), regions.end(), [](const tile& a, const tile& b) {
+            return a.y_begin != b.y_begin ? a.y_begin < b.y_begin : a.x_begin < b.x_begin;
+        });
+        size_t merged = 0;
+        for (size_t i = 1; i < regions.size(); ++i)
+        {
+            tile& last = regions[merged];
+            if (regions[i].y_begin == last.y_begin && regions[i].y_end == last.y_end && regions[i].x_begin == last.x_end)
+            {
+                last.x_end = regions[i].x_end;
+            }
+            else
+            {
+                regions[++merged] = regions[i];
+            }
+        }
+        regions.resize(merged + 1);
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tiles.clear();
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<tile> tiles;
+};
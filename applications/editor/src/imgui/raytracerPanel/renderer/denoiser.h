@@ -0,0 +1,306 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "completed_tile_queue.h"
+#include "scene/image/rgb_image.h"
+#include "simd.h"
+#include "threaded_cpu_renderer.h"
+#include "utils.h"
+
+//how much the features of two pixels may differ before they stop being averaged, smaller keeps more edges and noise
+struct denoiser_settings
+{
+    uint32_t iterations{4};
+    float color_sigma{8.0f}; //relative to the mean luminance of the image, halved after every iteration
+    float normal_sigma{0.2f};
+    float depth_sigma{0.05f}; //relative to the depth of the filtered pixel
+};
+
+namespace denoiser_detail
+{
+constexpr float kernel[5] = {1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+constexpr float exp_lower_bound{-80.0f};
+constexpr float log2e{1.44269504f};
+//Taylor series of 2^f on [0, 1), shared by the scalar and SIMD paths so both produce the same weights
+constexpr float exp2_coefficients[6] = {1.0f, 0.69314718f, 0.24022651f, 0.05550411f, 0.00961813f, 0.00133336f};
+constexpr float min_albedo{0.01f};
+constexpr float min_depth{1.0e-4f};
+
+//e^x for x <= 0, exact enough for filter weights and a lot cheaper than std::exp
+inline float fast_exp(float x)
+{
+    x = std::max(x, exp_lower_bound);
+    const float t = x * log2e;
+    const float whole = std::floor(t);
+    const float f = t - whole;
+    float p = exp2_coefficients[5];
+    for (int i = 4; i >= 0; --i)
+        p = p * f + exp2_coefficients[i];
+    return p * std::bit_cast<float>(static_cast<uint32_t>(static_cast<int32_t>(whole) + 127) << 23);
+}
+
+#ifdef RT_SIMD_X86
+RT_TARGET_AVX2 inline __m256 fast_exp_avx2(__m256 x)
+{
+    x = _mm256_max_ps(x, _mm256_set1_ps(exp_lower_bound));
+    const __m256 t = _mm256_mul_ps(x, _mm256_set1_ps(log2e));
+    const __m256 whole = _mm256_floor_ps(t);
+    const __m256 f = _mm256_sub_ps(t, whole);
+    __m256 p = _mm256_set1_ps(exp2_coefficients[5]);
+    for (int i = 4; i >= 0; --i)
+        p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(exp2_coefficients[i]));
+    const __m256i exponent = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(whole), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(exponent));
+}
+#endif
+}// namespace denoiser_detail
+
+//Edge-avoiding à-trous wavelet filter (Dammertz et al. 2010) for previews of a few samples per pixel. The accumulated
+//colors are divided by the albedo of the first hit so textures are not blurred, then filtered by a 5x5 B3-spline kernel
+//whose taps spread twice as far every iteration and are weighted by how close their color, normal and depth are to
+//the filtered pixel. The feature buffers are planar so eight neighbouring pixels load as one AVX2 register, every pass
+//runs on the tiles of the renderer and its worker threads.
+class atrous_denoiser
+{
+public:
+    //writes the filtered image to the display buffer, the accumulated samples are left untouched
+    void apply(const rgb_image& image, threaded_cpu_renderer& renderer)
+    {
+        if (image.get_sample_count() == 0)
+            return;
+
+        resize(image.get_width(), image.get_height());
+        std::atomic<float> luminance_sum{0.0f};
+        renderer.run_tiles([&](const tile& p_tile) { load_tile(image, p_tile, luminance_sum); });
+
+        const float mean_luminance = luminance_sum.load() / static_cast<float>(width * height);
+        const float color_scale = settings.color_sigma * std::max(mean_luminance, 1.0e-6f);
+        float inv_color_variance = 1.0f / (color_scale * color_scale);
+        const float inv_normal_variance = 1.0f / (settings.normal_sigma * settings.normal_sigma);
+        uint32_t source = 0;
+        for (uint32_t iteration = 0; iteration < settings.iterations; ++iteration)
+        {
+            const filter_pass pass{source, 1u << iteration, inv_color_variance, inv_normal_variance};
+            renderer.run_tiles([&](const tile& p_tile) { filter_tile(p_tile, pass); });
+            source ^= 1u;
+            inv_color_variance *= 4.0f;
+        }
+        renderer.run_tiles([&](const tile& p_tile) { store_tile(image, p_tile, source); });
+    }
+
+    void set_settings(const denoiser_settings& p_settings) { settings = p_settings; }
+    [[nodiscard]] const denoiser_settings& get_settings() const { return settings; }
+
+private:
+    struct filter_pass
+    {
+        uint32_t source;
+        uint32_t step;
+        float inv_color_variance;
+        float inv_normal_variance;
+    };
+
+    void resize(const uint32_t p_width, const uint32_t p_height)
+    {
+        width = p_width;
+        height = p_height;
+        const size_t size = static_cast<size_t>(width) * height;
+        for (uint32_t channel = 0; channel < 3; ++channel)
+        {
+            color[0][channel].resize(size);
+            color[1][channel].resize(size);
+            albedo[channel].resize(size);
+            normal[channel].resize(size);
+        }
+        depth.resize(size);
+    }
+
+    //averages the samples and features of the tile and removes the albedo from the colors
+    void load_tile(const rgb_image& image, const tile& p_tile, std::atomic<float>& luminance_sum)
+    {
+        const color3* accumulation = image.get_accumulation_data();
+        const pixel_features* features = image.get_feature_data();
+        float tile_luminance{0.0f};
+        for (uint32_t y = p_tile.y_begin; y < p_tile.y_end; ++y)
+        {
+            for (uint32_t x = p_tile.x_begin; x < p_tile.x_end; ++x)
+            {
+                const uint32_t p = y * width + x;
+                const float inv_sample_count = 1.0f / static_cast<float>(std::max(1u, image.get_sample_count_at(p)));
+                const color3 average = accumulation[p] * inv_sample_count;
+                const pixel_features& pixel = features[p];
+                color3 irradiance;
+                for (uint32_t channel = 0; channel < 3; ++channel)
+                {
+                    float pixel_albedo = pixel.albedo[channel] * inv_sample_count;
+                    if (pixel_albedo < denoiser_detail::min_albedo)
+                        pixel_albedo = 1.0f;
+                    irradiance[channel] = average[channel] / pixel_albedo;
+                    color[0][channel][p] = irradiance[channel];
+                    albedo[channel][p] = pixel_albedo;
+                    normal[channel][p] = pixel.normal[channel] * inv_sample_count;
+                }
+                depth[p] = pixel.depth * inv_sample_count;
+                tile_luminance += luminance(irradiance);
+            }
+        }
+        luminance_sum.fetch_add(tile_luminance, std::memory_order_relaxed);
+    }
+
+    //multiplies the albedo back and tonemaps the result into the display buffer
+    void store_tile(const rgb_image& image, const tile& p_tile, const uint32_t source) const
+    {
+        for (uint32_t y = p_tile.y_begin; y < p_tile.y_end; ++y)
+        {
+            for (uint32_t x = p_tile.x_begin; x < p_tile.x_end; ++x)
+            {
+                const uint32_t p = y * width + x;
+                const color3 filtered{color[source][0][p] * albedo[0][p], color[source][1][p] * albedo[1][p],
+                                      color[source][2][p] * albedo[2][p]};
+                image.set_display_color_at_index(filtered, p);
+            }
+        }
+    }
+
+    //runs of eight pixels whose taps all fall inside the image take the SIMD path, the borders the scalar one
+    void filter_tile(const tile& p_tile, const filter_pass& pass)
+    {
+        const uint32_t margin = 2 * pass.step;
+        for (uint32_t y = p_tile.y_begin; y < p_tile.y_end; ++y)
+        {
+            uint32_t x = p_tile.x_begin;
+#ifdef RT_SIMD_X86
+            if (use_avx2)
+            {
+                for (; x + 8 <= p_tile.x_end && x >= margin && x + 7 + margin < width; x += 8)
+                    filter_pixels_avx2(x, y, pass);
+            }
+#endif
+            for (; x < p_tile.x_end; ++x)
+                filter_pixel(x, y, pass);
+        }
+    }
+
+    void filter_pixel(const uint32_t x, const uint32_t y, const filter_pass& pass)
+    {
+        const std::vector<float>* source = color[pass.source];
+        std::vector<float>* destination = color[pass.source ^ 1u];
+        const uint32_t p = y * width + x;
+        const float center_color[3] = {source[0][p], source[1][p], source[2][p]};
+        const float center_normal[3] = {normal[0][p], normal[1][p], normal[2][p]};
+        const float center_depth = depth[p];
+        const float inv_depth_scale = 1.0f / (settings.depth_sigma * (center_depth + denoiser_detail::min_depth));
+
+        float sum[3] = {0.0f, 0.0f, 0.0f};
+        float weight_sum{0.0f};
+        for (int ky = 0; ky < 5; ++ky)
+        {
+            const int64_t tap_y = static_cast<int64_t>(y) + (ky - 2) * static_cast<int64_t>(pass.step);
+            if (tap_y < 0 || tap_y >= height)
+                continue;
+            for (int kx = 0; kx < 5; ++kx)
+            {
+                const int64_t tap_x = static_cast<int64_t>(x) + (kx - 2) * static_cast<int64_t>(pass.step);
+                if (tap_x < 0 || tap_x >= width)
+                    continue;
+                const size_t q = static_cast<size_t>(tap_y) * width + static_cast<size_t>(tap_x);
+
+                float color_distance{0.0f};
+                float normal_distance{0.0f};
+                for (uint32_t channel = 0; channel < 3; ++channel)
+                {
+                    const float color_difference = source[channel][q] - center_color[channel];
+                    const float normal_difference = normal[channel][q] - center_normal[channel];
+                    color_distance += color_difference * color_difference;
+                    normal_distance += normal_difference * normal_difference;
+                }
+                const float depth_difference = (depth[q] - center_depth) * inv_depth_scale;
+                const float weight = denoiser_detail::kernel[kx] * denoiser_detail::kernel[ky] *
+                                     denoiser_detail::fast_exp(-(color_distance * pass.inv_color_variance +
+                                                                 normal_distance * pass.inv_normal_variance +
+                                                                 depth_difference * depth_difference));
+                for (uint32_t channel = 0; channel < 3; ++channel)
+                    sum[channel] += weight * source[channel][q];
+                weight_sum += weight;
+            }
+        }
+        //the center tap has a weight of at least kernel[2]^2
+        for (uint32_t channel = 0; channel < 3; ++channel)
+            destination[channel][p] = sum[channel] / weight_sum;
+    }
+
+#ifdef RT_SIMD_X86
+    //same as filter_pixel for the pixels [x, x + 8) of a row, every tap of them lies inside the image horizontally
+    RT_TARGET_AVX2 void filter_pixels_avx2(const uint32_t x, const uint32_t y, const filter_pass& pass)
+    {
+        const std::vector<float>* source = color[pass.source];
+        std::vector<float>* destination = color[pass.source ^ 1u];
+        const uint32_t p = y * width + x;
+        __m256 center_color[3];
+        __m256 center_normal[3];
+        for (uint32_t channel = 0; channel < 3; ++channel)
+        {
+            center_color[channel] = _mm256_loadu_ps(&source[channel][p]);
+            center_normal[channel] = _mm256_loadu_ps(&normal[channel][p]);
+        }
+        const __m256 center_depth = _mm256_loadu_ps(&depth[p]);
+        const __m256 inv_depth_scale = _mm256_div_ps(
+                _mm256_set1_ps(1.0f),
+                _mm256_mul_ps(_mm256_set1_ps(settings.depth_sigma), _mm256_add_ps(center_depth, _mm256_set1_ps(denoiser_detail::min_depth))));
+        const __m256 inv_color_variance = _mm256_set1_ps(pass.inv_color_variance);
+        const __m256 inv_normal_variance = _mm256_set1_ps(pass.inv_normal_variance);
+
+        __m256 sum[3] = {_mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps()};
+        __m256 weight_sum = _mm256_setzero_ps();
+        for (int ky = 0; ky < 5; ++ky)
+        {
+            const int64_t tap_y = static_cast<int64_t>(y) + (ky - 2) * static_cast<int64_t>(pass.step);
+            if (tap_y < 0 || tap_y >= height)
+                continue;
+            for (int kx = 0; kx < 5; ++kx)
+            {
+                const size_t q = static_cast<size_t>(tap_y) * width + x + (kx - 2) * static_cast<int64_t>(pass.step);
+
+                __m256 tap_color[3];
+                __m256 color_distance = _mm256_setzero_ps();
+                __m256 normal_distance = _mm256_setzero_ps();
+                for (uint32_t channel = 0; channel < 3; ++channel)
+                {
+                    tap_color[channel] = _mm256_loadu_ps(&source[channel][q]);
+                    const __m256 color_difference = _mm256_sub_ps(tap_color[channel], center_color[channel]);
+                    const __m256 normal_difference = _mm256_sub_ps(_mm256_loadu_ps(&normal[channel][q]), center_normal[channel]);
+                    color_distance = _mm256_fmadd_ps(color_difference, color_difference, color_distance);
+                    normal_distance = _mm256_fmadd_ps(normal_difference, normal_difference, normal_distance);
+                }
+                const __m256 depth_difference = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&depth[q]), center_depth), inv_depth_scale);
+                __m256 exponent = _mm256_mul_ps(depth_difference, depth_difference);
+                exponent = _mm256_fmadd_ps(normal_distance, inv_normal_variance, exponent);
+                exponent = _mm256_fmadd_ps(color_distance, inv_color_variance, exponent);
+                const __m256 weight = _mm256_mul_ps(_mm256_set1_ps(denoiser_detail::kernel[kx] * denoiser_detail::kernel[ky]),
+                                                    denoiser_detail::fast_exp_avx2(_mm256_sub_ps(_mm256_setzero_ps(), exponent)));
+                for (uint32_t channel = 0; channel < 3; ++channel)
+                    sum[channel] = _mm256_fmadd_ps(weight, tap_color[channel], sum[channel]);
+                weight_sum = _mm256_add_ps(weight_sum, weight);
+            }
+        }
+        for (uint32_t channel = 0; channel < 3; ++channel)
+            _mm256_storeu_ps(&destination[channel][p], _mm256_div_ps(sum[channel], weight_sum));
+    }
+
+    const bool use_avx2{cpu_supports_avx2()};
+#endif
+
+    denoiser_settings settings;
+    uint32_t width{0};
+    uint32_t height{0};
+    std::vector<float> color[2][3]; //albedo free colors, ping-pong between iterations
+    std::vector<float> albedo[3];
+    std::vector<float> normal[3];
+    std::vector<float> depth;
+};
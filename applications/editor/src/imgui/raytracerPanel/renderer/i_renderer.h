@@ -1,7 +1,9 @@
 #pragma once
+#include <future>
+
 class i_renderer
 {
 public:
 	virtual ~i_renderer() = default;
-	virtual bool render(uint32_t& current_compute_unit) = 0;
+	virtual std::shared_future<void> render() = 0;
 };
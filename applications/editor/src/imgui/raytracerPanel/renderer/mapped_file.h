@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//read only view of a whole file through the page cache, the pages are loaded when they are first read and can be
+//dropped again by the system, so a file larger than the memory can still be read once from start to end
+class mapped_file
+{
+public:
+    //a sequential file is read once from start to end, the other ones are read ahead whole as they are used whole
+    explicit mapped_file(const std::string& p_path, const bool p_sequential = false)
+    {
+#ifdef _WIN32
+        file = CreateFileA(p_path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                           p_sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size))
+            return;
+        size = static_cast<size_t>(file_size.QuadPart);
+        opened = true;
+        if (size == 0)
+            return;
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr)
+        {
+            opened = false;
+            return;
+        }
+        bytes = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        opened = bytes != nullptr;
+#else
+        descriptor = open(p_path.c_str(), O_RDONLY);
+        if (descriptor < 0)
+            return;
+        struct stat status{};
+        if (fstat(descriptor, &status) != 0)
+            return;
+        size = static_cast<size_t>(status.st_size);
+        opened = true;
+        if (size == 0)
+            return;
+        void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (view == MAP_FAILED)
+        {
+            opened = false;
+            return;
+        }
+        madvise(view, size, p_sequential ? MADV_SEQUENTIAL : MADV_WILLNEED);
+        bytes = static_cast<const char*>(view);
+#endif
+    }
+
+    ~mapped_file()
+    {
+#ifdef _WIN32
+        if (bytes != nullptr)
+            UnmapViewOfFile(bytes);
+        if (mapping != nullptr)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+#else
+        if (bytes != nullptr)
+            munmap(const_cast<char*>(bytes), size);
+        if (descriptor >= 0)
+            close(descriptor);
+#endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    [[nodiscard]] bool is_open() const { return opened; }
+    [[nodiscard]] const char* data() const { return bytes; }
+    [[nodiscard]] size_t get_size() const { return size; }
+
+private:
+    const char* bytes{nullptr};
+    size_t size{0};
+    bool opened{false};
+#ifdef _WIN32
+    HANDLE file{INVALID_HANDLE_VALUE};
+    HANDLE mapping{nullptr};
+#else
+    int descriptor{-1};
+#endif
+};
@@ -1,16 +1,48 @@
 #pragma once
+#include <cmath>
+#include <limits>
+
 #include "glm/gtx/normal.hpp"
 #include "utils.h"
 
+//Beam a ray stands for, a cone whose width grows with the distance along the ray. Camera rays carry the footprint of
+//their pixel, it picks the mip level of the textures they hit. A cone of width and spread 0 is a thin ray.
+struct ray_cone
+{
+	float width{0.0f};  //at the origin of the ray
+	float spread{0.0f}; //growth of the width per unit of distance, the angle of the cone
+
+	[[nodiscard]] float width_at(const float t) const { return width + spread * t; }
+};
+
+//A ray and the interval (t_min, t_max) of distances along it the queries search. A closest hit query shrinks t_max
+//to every hit it finds, so the objects tested after it skip everything further away. The time is the instant in the
+//shutter interval, 0 to 1, the moving objects are placed at; the rays leaving a hit keep the time of the ray reaching it.
 class ray
 {
 public:
-	ray(const point3& p_origin, const vec3& p_direction) : origin(p_origin), direction(normalize(p_direction))
+	ray(const point3& p_origin, const vec3& p_direction, const float p_t_max = std::numeric_limits<float>::max(),
+	    const float p_t_min = 0.0f)
+		: origin(p_origin), direction(normalize(p_direction)), t_min(p_t_min), t_max(p_t_max)
 	{
 	}
 
 	point3 get_origin() const { return origin; }
 	vec3 get_direction() const { return direction; }
+	float get_t_min() const { return t_min; }
+	float get_t_max() const { return t_max; }
+
+	//true when t is inside the interval
+	bool contains(const float t) const { return t > t_min && t < t_max; }
+
+	//ends the interval at a hit found at distance t
+	void set_t_max(const float t) { t_max = t; }
+
+	ray_cone get_cone() const { return cone; }
+	void set_cone(const ray_cone& p_cone) { cone = p_cone; }
+
+	float get_time() const { return time; }
+	void set_time(const float p_time) { time = p_time; }
 
 	point3 move(const float t) const
 	{
@@ -20,4 +52,44 @@ public:
 private:
 	const point3 origin{};
 	const vec3 direction;
+	const float t_min;
+	float t_max;
+	ray_cone cone{};
+	float time{0.0f};
 };
+
+//where a ray hit a surface, for the rays leaving it: the geometric normal of the surface and a bound of the rounding
+//error of the hit point on every axis
+struct surface_offset
+{
+	vec3 geometric_normal{0.0f, 0.0f, 0.0f};
+	vec3 error{0.0f, 0.0f, 0.0f};
+};
+
+//bound of the relative error of n chained float operations, gamma(n) in Higham
+constexpr float rounding_error_bound(const int n)
+{
+	constexpr float half_epsilon = std::numeric_limits<float>::epsilon() * 0.5f;
+	return static_cast<float>(n) * half_epsilon / (1.0f - static_cast<float>(n) * half_epsilon);
+}
+
+//Origin of a ray leaving a hit point towards direction. The point is pushed along the geometric normal, to the side
+//the ray leaves by, just past its error bound and then rounded away from the surface, so the ray cannot hit that
+//surface again at the start whatever the scale of the scene.
+inline point3 offset_ray_origin(const point3& p, const surface_offset& offset, const vec3& direction)
+{
+	const vec3& normal = offset.geometric_normal;
+	vec3 shift = glm::dot(glm::abs(normal), offset.error) * normal;
+	if (glm::dot(direction, normal) < 0.0f)
+		shift = -shift;
+
+	point3 origin = p + shift;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (shift[axis] > 0.0f)
+			origin[axis] = std::nextafter(origin[axis], std::numeric_limits<float>::infinity());
+		else if (shift[axis] < 0.0f)
+			origin[axis] = std::nextafter(origin[axis], -std::numeric_limits<float>::infinity());
+	}
+	return origin;
+}
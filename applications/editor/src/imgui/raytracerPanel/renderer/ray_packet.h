@@ -0,0 +1,60 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+#include <limits>
+
+#include "ray.h"
+#include "simd.h"
+#include "utils.h"
+
+//Eight coherent rays in structure of arrays layout, traversed together so every node and triangle fetched
+//from memory is tested against the whole packet. Lanes are addressed with bit masks.
+struct ray_packet
+{
+    static constexpr uint32_t size{8};
+    static constexpr uint32_t all_lanes{(1u << size) - 1};
+
+    alignas(32) float origin[3][size]{};
+    alignas(32) float direction[3][size]{};
+    alignas(32) float inv_direction[3][size]{};
+    alignas(32) float t_max[size]{};
+    ray_cone cone[size]{};
+    float time[size]{};
+
+    void set_lane(const uint32_t lane, const ray& p_ray)
+    {
+        const point3 o = p_ray.get_origin();
+        const vec3 d = p_ray.get_direction();
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            origin[axis][lane] = o[axis];
+            direction[axis][lane] = d[axis];
+            inv_direction[axis][lane] = 1.0f / d[axis];
+        }
+        t_max[lane] = std::numeric_limits<float>::max();
+        cone[lane] = p_ray.get_cone();
+        time[lane] = p_ray.get_time();
+    }
+
+    [[nodiscard]] point3 get_origin(const uint32_t lane) const { return {origin[0][lane], origin[1][lane], origin[2][lane]}; }
+    [[nodiscard]] vec3 get_direction(const uint32_t lane) const { return {direction[0][lane], direction[1][lane], direction[2][lane]}; }
+    [[nodiscard]] ray get_ray(const uint32_t lane) const
+    {
+        ray lane_ray{get_origin(lane), get_direction(lane), t_max[lane]};
+        lane_ray.set_cone(cone[lane]);
+        lane_ray.set_time(time[lane]);
+        return lane_ray;
+    }
+};
+
+//calls f(lane) for every bit set in lanes
+template<typename F>
+void for_each_lane(uint32_t lanes, F&& f)
+{
+    while (lanes != 0)
+    {
+        const uint32_t lane = std::countr_zero(lanes);
+        lanes &= lanes - 1;
+        f(lane);
+    }
+}
@@ -0,0 +1,200 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+//What the scene queries of one thread did. The counters are plain fields bumped by the thread that owns them and
+//collected per tile by the tile scheduler, so the hot path never writes memory shared with another thread.
+struct ray_counters
+{
+    uint64_t primary_rays{0};
+    uint64_t shadow_rays{0};
+    uint64_t secondary_rays{0};
+    uint64_t node_tests{0};     //ray-box tests, a node fetched by a packet counts once per lane tested
+    uint64_t triangle_tests{0}; //ray-triangle tests, counted the same way
+    uint64_t paths{0};          //paths leaving a camera hit
+    uint64_t bounces{0};        //rays traced by those paths
+    uint64_t traversal_nanoseconds{0}; //estimated from the sampled queries, see traversal_timer
+    uint64_t image_write_nanoseconds{0};
+
+    [[nodiscard]] uint64_t rays() const
+    {
+        return primary_rays + shadow_rays + secondary_rays;
+    }
+
+    [[nodiscard]] double average_bounces() const
+    {
+        return paths > 0 ? static_cast<double>(bounces) / static_cast<double>(paths) : 0.0;
+    }
+
+    ray_counters& operator+=(const ray_counters& other)
+    {
+        primary_rays += other.primary_rays;
+        shadow_rays += other.shadow_rays;
+        secondary_rays += other.secondary_rays;
+        node_tests += other.node_tests;
+        triangle_tests += other.triangle_tests;
+        paths += other.paths;
+        bounces += other.bounces;
+        traversal_nanoseconds += other.traversal_nanoseconds;
+        image_write_nanoseconds += other.image_write_nanoseconds;
+        return *this;
+    }
+
+    [[nodiscard]] ray_counters operator-(const ray_counters& other) const
+    {
+        ray_counters result;
+        result.primary_rays = primary_rays - other.primary_rays;
+        result.shadow_rays = shadow_rays - other.shadow_rays;
+        result.secondary_rays = secondary_rays - other.secondary_rays;
+        result.node_tests = node_tests - other.node_tests;
+        result.triangle_tests = triangle_tests - other.triangle_tests;
+        result.paths = paths - other.paths;
+        result.bounces = bounces - other.bounces;
+        result.traversal_nanoseconds = traversal_nanoseconds - other.traversal_nanoseconds;
+        result.image_write_nanoseconds = image_write_nanoseconds - other.image_write_nanoseconds;
+        return result;
+    }
+};
+
+//counters of the calling thread
+inline thread_local ray_counters thread_counters;
+inline thread_local uint32_t thread_timed_queries{0};
+
+//Times one scene query in traversal_sample_period and counts it for all of them: reading the clock around every query
+//would cost about as much as the query itself.
+class traversal_timer
+{
+public:
+    static constexpr uint32_t traversal_sample_period{16};
+
+    traversal_timer() : sampled(++thread_timed_queries % traversal_sample_period == 0)
+    {
+        if (sampled)
+            start = std::chrono::steady_clock::now();
+    }
+
+    ~traversal_timer()
+    {
+        if (sampled)
+            thread_counters.traversal_nanoseconds +=
+                    traversal_sample_period * std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    traversal_timer(const traversal_timer&) = delete;
+    traversal_timer& operator=(const traversal_timer&) = delete;
+
+private:
+    const bool sampled;
+    std::chrono::steady_clock::time_point start;
+};
+
+//what one worker of the tile scheduler did since the stats were last reset
+struct worker_stats
+{
+    double busy_milliseconds{0.0};
+    ray_counters counters;
+    uint32_t tiles{0};
+    uint32_t stolen_tiles{0};
+};
+
+//wall time of one tile of the last frame, by its top left pixel
+struct tile_time
+{
+    uint32_t x{0};
+    uint32_t y{0};
+    float milliseconds{0.0f};
+};
+
+//Everything the renderer measured, for the panel and the json dump. The time of the workers splits into the scene
+//traversal, the writes to the image and the rest, which is mostly shading.
+struct render_stats
+{
+    std::vector<worker_stats> workers;
+    std::vector<tile_time> tiles;
+
+    [[nodiscard]] ray_counters totals() const
+    {
+        ray_counters total;
+        for (const worker_stats& worker: workers)
+            total += worker.counters;
+        return total;
+    }
+
+    [[nodiscard]] double busy_milliseconds() const
+    {
+        double total{0.0};
+        for (const worker_stats& worker: workers)
+            total += worker.busy_milliseconds;
+        return total;
+    }
+
+    [[nodiscard]] double traversal_milliseconds() const
+    {
+        return static_cast<double>(totals().traversal_nanoseconds) * 1.0e-6;
+    }
+
+    [[nodiscard]] double image_write_milliseconds() const
+    {
+        return static_cast<double>(totals().image_write_nanoseconds) * 1.0e-6;
+    }
+
+    [[nodiscard]] double shading_milliseconds() const
+    {
+        return std::max(0.0, busy_milliseconds() - traversal_milliseconds() - image_write_milliseconds());
+    }
+
+    //min, mean and max wall time of the tiles rendered in the last frame
+    void tile_milliseconds(float& min, float& mean, float& max) const
+    {
+        min = max = mean = 0.0f;
+        uint32_t count{0};
+        for (const tile_time& time: tiles)
+        {
+            if (time.milliseconds <= 0.0f)
+                continue;
+            min = count == 0 ? time.milliseconds : std::min(min, time.milliseconds);
+            max = std::max(max, time.milliseconds);
+            mean += time.milliseconds;
+            ++count;
+        }
+        if (count > 0)
+            mean /= static_cast<float>(count);
+    }
+
+    void write_json(std::ostream& out) const
+    {
+        const ray_counters total = totals();
+        float tile_min, tile_mean, tile_max;
+        tile_milliseconds(tile_min, tile_mean, tile_max);
+
+        out << "{\n";
+        out << "  \"rays\": {\"primary\": " << total.primary_rays << ", \"shadow\": " << total.shadow_rays
+            << ", \"secondary\": " << total.secondary_rays << ", \"total\": " << total.rays() << "},\n";
+        out << "  \"node_tests\": " << total.node_tests << ",\n";
+        out << "  \"triangle_tests\": " << total.triangle_tests << ",\n";
+        out << "  \"paths\": " << total.paths << ",\n";
+        out << "  \"average_bounces\": " << total.average_bounces() << ",\n";
+        out << "  \"milliseconds\": {\"busy\": " << busy_milliseconds() << ", \"traversal\": " << traversal_milliseconds()
+            << ", \"shading\": " << shading_milliseconds() << ", \"image_write\": " << image_write_milliseconds() << "},\n";
+        out << "  \"tile_milliseconds\": {\"min\": " << tile_min << ", \"mean\": " << tile_mean << ", \"max\": " << tile_max << "},\n";
+        out << "  \"workers\": [";
+        for (size_t i = 0; i < workers.size(); ++i)
+        {
+            const worker_stats& worker = workers[i];
+            out << (i == 0 ? "\n" : ",\n") << "    {\"busy_milliseconds\": " << worker.busy_milliseconds << ", \"tiles\": " << worker.tiles
+                << ", \"stolen_tiles\": " << worker.stolen_tiles << ", \"rays\": " << worker.counters.rays()
+                << ", \"node_tests\": " << worker.counters.node_tests << ", \"triangle_tests\": " << worker.counters.triangle_tests << "}";
+        }
+        out << "\n  ],\n";
+        out << "  \"tiles\": [";
+        for (size_t i = 0; i < tiles.size(); ++i)
+        {
+            out << (i == 0 ? "\n" : ",\n") << "    {\"x\": " << tiles[i].x << ", \"y\": " << tiles[i].y << ", \"milliseconds\": " << tiles[i].milliseconds << "}";
+        }
+        out << "\n  ]\n";
+        out << "}\n";
+    }
+};
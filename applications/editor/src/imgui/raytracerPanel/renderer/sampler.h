@@ -0,0 +1,194 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "utils.h"
+
+//PCG32 (XSH RR variant), 16 bytes of state and stream increment so every pixel can own a generator on the stack
+class pcg32
+{
+public:
+    pcg32() = default;
+
+    pcg32(const uint64_t p_seed, const uint64_t p_sequence)
+    {
+        increment = (p_sequence << 1u) | 1u;
+        next_uint();
+        state += p_seed;
+        next_uint();
+    }
+
+    uint32_t next_uint()
+    {
+        const uint64_t old_state = state;
+        state = old_state * 6364136223846793005ULL + increment;
+        const auto xor_shifted = static_cast<uint32_t>(((old_state >> 18u) ^ old_state) >> 27u);
+        const auto rotation = static_cast<uint32_t>(old_state >> 59u);
+        return (xor_shifted >> rotation) | (xor_shifted << ((~rotation + 1u) & 31u));
+    }
+
+    //uniform in [0, 1)
+    float next_float()
+    {
+        return static_cast<float>(next_uint() >> 8) * 0x1p-24f;
+    }
+
+private:
+    uint64_t state{0};
+    uint64_t increment{1};
+};
+
+enum class sampler_type
+{
+    random,//independent PCG32 samples
+    sobol  //Owen scrambled Sobol (0,2) sequence, one scrambled pair per couple of dimensions
+};
+
+inline uint32_t hash_combine(uint32_t seed, const uint32_t value)
+{
+    //lowbias32 finalizer
+    seed ^= value + 0x9e3779b9u + (seed << 6u) + (seed >> 2u);
+    seed ^= seed >> 16u;
+    seed *= 0x7feb352du;
+    seed ^= seed >> 15u;
+    seed *= 0x846ca68bu;
+    seed ^= seed >> 16u;
+    return seed;
+}
+
+inline uint32_t reverse_bits(uint32_t v)
+{
+    v = ((v >> 1u) & 0x55555555u) | ((v & 0x55555555u) << 1u);
+    v = ((v >> 2u) & 0x33333333u) | ((v & 0x33333333u) << 2u);
+    v = ((v >> 4u) & 0x0F0F0F0Fu) | ((v & 0x0F0F0F0Fu) << 4u);
+    v = ((v >> 8u) & 0x00FF00FFu) | ((v & 0x00FF00FFu) << 8u);
+    return (v >> 16u) | (v << 16u);
+}
+
+//hash based nested uniform scrambling (Burley 2020), keeps the stratification of the sequence
+inline uint32_t nested_uniform_scramble(uint32_t x, const uint32_t seed)
+{
+    x = reverse_bits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverse_bits(x);
+}
+
+//second dimension of the Sobol sequence, the first one is the bit reversed index
+inline uint32_t sobol_second_dimension(uint32_t index)
+{
+    uint32_t result = 0;
+    for (uint32_t v = 1u << 31u; index != 0; index >>= 1u, v ^= v >> 1u)
+    {
+        if (index & 1u)
+            result ^= v;
+    }
+    return result;
+}
+
+//point on the unit sphere from two uniform numbers
+inline vec3 uniform_sphere_sample(const glm::vec2& u)
+{
+    const float z = 1.0f - 2.0f * u.x;
+    const float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+    const float phi = 6.28318530718f * u.y;
+    return {r * std::cos(phi), r * std::sin(phi), z};
+}
+
+//point on the unit disk from two uniform numbers, concentric squares map to concentric rings so the strata stay compact
+inline glm::vec2 concentric_disk_sample(const glm::vec2& u)
+{
+    const glm::vec2 offset = 2.0f * u - glm::vec2{1.0f, 1.0f};
+    if (offset.x == 0.0f && offset.y == 0.0f)
+        return {0.0f, 0.0f};
+    constexpr float quarter_pi{0.785398163397f};
+    if (std::abs(offset.x) > std::abs(offset.y))
+    {
+        const float theta = quarter_pi * offset.y / offset.x;
+        return offset.x * glm::vec2{std::cos(theta), std::sin(theta)};
+    }
+    const float theta = 2.0f * quarter_pi - quarter_pi * offset.x / offset.y;
+    return offset.y * glm::vec2{std::cos(theta), std::sin(theta)};
+}
+
+//Per pixel sample generator passed down the integrator. It only lives on the stack of the thread tracing the pixel,
+//so nothing is shared between workers, and it is seeded from the pixel and the pass so a render is reproducible
+//whatever the tile scheduling. The Sobol scrambling only depends on the pixel so successive passes keep extending
+//the same sequence.
+class sampler
+{
+public:
+    sampler() = default;
+
+    sampler(const uint32_t p_pixel_index, const uint32_t p_pass, const sampler_type p_type) :
+        type(p_type),
+        pass(p_pass),
+        pixel_seed(hash_combine(0x5eed5eedu, p_pixel_index)),
+        generator(hash_combine(pixel_seed, p_pass), p_pixel_index)
+    {
+    }
+
+    //restarts the dimensions for the sample_index-th sample of the pixel
+    void start_sample(const uint32_t p_sample_index)
+    {
+        sample_index = p_sample_index;
+        dimension = 0;
+    }
+
+    float next_1d()
+    {
+        if (type == sampler_type::random)
+            return generator.next_float();
+
+        const glm::vec2 point = sobol_pair(dimension / 2);
+        return (dimension++ & 1u) == 0 ? point.x : point.y;
+    }
+
+    glm::vec2 next_2d()
+    {
+        if (type == sampler_type::random)
+            return {generator.next_float(), generator.next_float()};
+
+        dimension += dimension & 1u;
+        const glm::vec2 point = sobol_pair(dimension / 2);
+        dimension += 2;
+        return point;
+    }
+
+    //Lens and shutter numbers of the sample_index-th camera ray of the pixel. Sobol takes them from dimensions far past
+    //the ones a path uses, so they are not correlated with the bounces of the same sample.
+    glm::vec3 next_camera(const uint32_t p_sample_index)
+    {
+        if (type == sampler_type::random)
+            return {generator.next_float(), generator.next_float(), generator.next_float()};
+
+        sample_index = p_sample_index;
+        const glm::vec2 lens = sobol_pair(camera_pair);
+        return glm::vec3{lens, sobol_pair(camera_pair + 1).x};
+    }
+
+    [[nodiscard]] uint32_t get_pass() const { return pass; }
+
+private:
+    static constexpr uint32_t camera_pair{0x40000000u};
+
+    glm::vec2 sobol_pair(const uint32_t pair) const
+    {
+        const uint32_t pair_seed = hash_combine(pixel_seed, pair);
+        const uint32_t index = nested_uniform_scramble(sample_index, pair_seed);
+        const uint32_t x = nested_uniform_scramble(reverse_bits(index), hash_combine(pair_seed, 0u));
+        const uint32_t y = nested_uniform_scramble(sobol_second_dimension(index), hash_combine(pair_seed, 1u));
+        return {static_cast<float>(x >> 8) * 0x1p-24f, static_cast<float>(y >> 8) * 0x1p-24f};
+    }
+
+    sampler_type type{sampler_type::random};
+    uint32_t pass{0};
+    uint32_t pixel_seed{0};
+    pcg32 generator;
+    uint32_t sample_index{0};
+    uint32_t dimension{0};
+};
@@ -0,0 +1,89 @@
+#pragma once
+#include <limits>
+
+#include "../../ray_packet.h"
+#include "../../simd.h"
+#include "../../utils.h"
+#include "glm/glm.hpp"
+
+//The far distance of the slab tests is widened by the rounding error of its computation, a ray through the edge or
+//the corner of a box would otherwise miss it and the watertight triangles inside.
+constexpr float slab_far_scale{1.0f + 2.0f * rounding_error_bound(3)};
+
+struct aabb
+{
+    point3 min{std::numeric_limits<float>::max()};
+    point3 max{std::numeric_limits<float>::lowest()};
+
+    void grow(const point3& p_point)
+    {
+        min = glm::min(min, p_point);
+        max = glm::max(max, p_point);
+    }
+
+    void grow(const aabb& p_other)
+    {
+        min = glm::min(min, p_other.min);
+        max = glm::max(max, p_other.max);
+    }
+
+    [[nodiscard]] bool empty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+
+    [[nodiscard]] point3 centroid() const { return (min + max) * 0.5f; }
+
+    [[nodiscard]] float surface_area() const
+    {
+        if (empty())
+            return 0.0f;
+        const vec3 extent = max - min;
+        return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+    }
+
+    //slab test against [0, t_max], inv_direction is 1/direction so axis aligned rays stay well defined
+    bool intersect(const point3& origin, const vec3& inv_direction, const float t_max, float& t_near) const
+    {
+        const vec3 t0 = (min - origin) * inv_direction;
+        const vec3 t1 = (max - origin) * inv_direction;
+        const vec3 t_small = glm::min(t0, t1);
+        const vec3 t_big = glm::max(t0, t1);
+
+        t_near = glm::max(glm::max(t_small.x, t_small.y), glm::max(t_small.z, 0.0f));
+        const float t_far = glm::min(glm::min(t_big.x, t_big.y), t_big.z) * slab_far_scale;
+        return t_near <= glm::min(t_far, t_max);
+    }
+
+    //slab test of every lane of the packet against [0, t_max[lane]], returns the mask of the lanes that hit
+    [[nodiscard]] uint32_t intersect(const ray_packet& packet) const
+    {
+#ifdef RT_SIMD_X86
+        uint32_t mask{0};
+        for (uint32_t half = 0; half < ray_packet::size; half += 4)
+        {
+            __m128 t_near = _mm_setzero_ps();
+            __m128 t_far = _mm_set1_ps(std::numeric_limits<float>::max());
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                const __m128 origin = _mm_loadu_ps(packet.origin[axis] + half);
+                const __m128 inv_direction = _mm_loadu_ps(packet.inv_direction[axis] + half);
+                const __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(min[axis]), origin), inv_direction);
+                const __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(max[axis]), origin), inv_direction);
+                t_near = _mm_max_ps(t_near, _mm_min_ps(t0, t1));
+                t_far = _mm_min_ps(t_far, _mm_max_ps(t0, t1));
+            }
+            t_far = _mm_min_ps(_mm_mul_ps(t_far, _mm_set1_ps(slab_far_scale)), _mm_loadu_ps(packet.t_max + half));
+            mask |= static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(t_near, t_far))) << half;
+        }
+        return mask;
+#else
+        uint32_t mask{0};
+        for (uint32_t lane = 0; lane < ray_packet::size; ++lane)
+        {
+            float t_near{};
+            const point3 origin{packet.origin[0][lane], packet.origin[1][lane], packet.origin[2][lane]};
+            const vec3 inv_direction{packet.inv_direction[0][lane], packet.inv_direction[1][lane], packet.inv_direction[2][lane]};
+            mask |= static_cast<uint32_t>(intersect(origin, inv_direction, packet.t_max[lane], t_near)) << lane;
+        }
+        return mask;
+#endif
+    }
+};
@@ -0,0 +1,390 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "aabb.h"
+#include "../../render_stats.h"
+
+struct bvh_node
+{
+    aabb bounds;
+    uint32_t offset{}; //first primitive for leaves, index of the second child for interior nodes
+    uint16_t count{};  //number of primitives in a leaf, 0 for interior nodes
+    uint16_t axis{};   //split axis, used to visit the nearest child first
+
+    [[nodiscard]] bool is_leaf() const { return count > 0; }
+};
+
+struct bvh_build_stats
+{
+    uint32_t primitive_count{};
+    uint32_t node_count{};
+    uint32_t leaf_count{};
+    uint32_t max_depth{};
+    float sah_cost{};
+    double build_milliseconds{};
+};
+
+inline std::ostream& operator<<(std::ostream& os, const bvh_build_stats& stats)
+{
+    return os << stats.primitive_count << " primitives, " << stats.node_count << " nodes, " << stats.leaf_count
+              << " leaves, depth " << stats.max_depth << ", SAH cost " << stats.sah_cost << ", built in "
+              << stats.build_milliseconds << " ms";
+}
+
+//Bounding volume hierarchy built with the binned surface area heuristic.
+//Nodes are stored depth first: the first child of a node directly follows it, the second one is at node.offset.
+//Primitives are referenced by leaf ranges, the owner reorders its primitives with primitive_order() after build().
+class bvh
+{
+public:
+    static constexpr uint32_t bin_count{16};
+    static constexpr uint32_t max_stack_depth{64};
+    static constexpr float traversal_cost{1.0f};
+
+    //p_intersection_cost is the cost of one primitive test relative to visiting a node
+    void build(const std::vector<aabb>& p_bounds, const uint32_t p_max_leaf_size, const float p_intersection_cost = 1.0f)
+    {
+        const auto start = std::chrono::steady_clock::now();
+
+        nodes.clear();
+        external_nodes = nullptr;
+        external_node_count = 0;
+        order.resize(p_bounds.size());
+        stats = {};
+        stats.primitive_count = static_cast<uint32_t>(p_bounds.size());
+        max_leaf_size = std::max(1u, p_max_leaf_size);
+        intersection_cost = p_intersection_cost;
+
+        if (!p_bounds.empty())
+        {
+            std::vector<point3> centroids;
+            centroids.reserve(p_bounds.size());
+            for (uint32_t i = 0; i < p_bounds.size(); ++i)
+            {
+                order[i] = i;
+                centroids.push_back(p_bounds[i].centroid());
+            }
+            nodes.reserve(2 * p_bounds.size());
+            build_recursive(p_bounds, centroids, 0, static_cast<uint32_t>(p_bounds.size()), 1);
+            //the reserve is a bound, a leaf of several primitives leaves most of it unused
+            nodes.shrink_to_fit();
+            compute_sah_cost();
+        }
+
+        stats.node_count = static_cast<uint32_t>(nodes.size());
+        stats.build_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    //visit_leaf(first, count, t_max) is called for every leaf whose bounds are hit before t_max, nearest leaves first.
+    //It may shrink t_max to prune farther nodes, and returns true to stop the traversal (any hit queries).
+    template<typename F>
+    void traverse(const point3& origin, const vec3& direction, float t_max, F&& visit_leaf) const
+    {
+        const bvh_node* const node_array = node_data();
+        if (node_array == nullptr)
+            return;
+
+        const vec3 inv_direction = 1.0f / direction;
+        const bool negative_direction[3] = {direction.x < 0.0f, direction.y < 0.0f, direction.z < 0.0f};
+
+        struct stack_entry
+        {
+            uint32_t node;
+            float t_near;
+        };
+        stack_entry stack[max_stack_depth];
+        uint32_t stack_size{0};
+
+        //counted locally and added once, the thread counters are not kept in a register across the leaf visits
+        uint64_t node_tests{1};
+        float t_near{};
+        if (node_array[0].bounds.intersect(origin, inv_direction, t_max, t_near))
+            stack[stack_size++] = {0, t_near};
+
+        while (stack_size > 0)
+        {
+            const auto [node_index, node_t_near] = stack[--stack_size];
+            if (node_t_near > t_max)
+                continue;
+
+            const bvh_node& node = node_array[node_index];
+            if (node.is_leaf())
+            {
+                if (visit_leaf(node.offset, static_cast<uint32_t>(node.count), t_max))
+                    break;
+                continue;
+            }
+
+            uint32_t near_child = node_index + 1;
+            uint32_t far_child = node.offset;
+            if (negative_direction[node.axis])
+                std::swap(near_child, far_child);
+
+            float t_near_child{};
+            float t_far_child{};
+            const bool hit_near = node_array[near_child].bounds.intersect(origin, inv_direction, t_max, t_near_child);
+            const bool hit_far = node_array[far_child].bounds.intersect(origin, inv_direction, t_max, t_far_child);
+            node_tests += 2;
+
+            //the nearest child goes on top of the stack so it is visited first
+            if (hit_far)
+                stack[stack_size++] = {far_child, t_far_child};
+            if (hit_near)
+                stack[stack_size++] = {near_child, t_near_child};
+        }
+        thread_counters.node_tests += node_tests;
+    }
+
+    //Packet traversal: every node is fetched once and tested against all the active lanes.
+    //visit_leaf(first, count, lanes) receives the lanes that hit the leaf and returns true to stop. Lanes may be
+    //removed from active (e.g. occluded shadow rays) and t_max shrunk in the packet while traversing.
+    template<typename F>
+    void traverse(const ray_packet& packet, uint32_t& active, F&& visit_leaf) const
+    {
+        const bvh_node* const node_array = node_data();
+        if (node_array == nullptr || active == 0)
+            return;
+
+        //children are ordered with the direction of one lane, the packet is assumed coherent
+        const uint32_t leader = std::countr_zero(active);
+        const bool negative_direction[3] = {packet.direction[0][leader] < 0.0f, packet.direction[1][leader] < 0.0f,
+                                            packet.direction[2][leader] < 0.0f};
+
+        uint32_t stack[max_stack_depth];
+        uint32_t stack_size{0};
+        stack[stack_size++] = 0;
+
+        uint64_t node_tests{0};
+        while (stack_size > 0 && active != 0)
+        {
+            const uint32_t node_index = stack[--stack_size];
+            const bvh_node& node = node_array[node_index];
+            node_tests += std::popcount(active);
+            const uint32_t lanes = node.bounds.intersect(packet) & active;
+            if (lanes == 0)
+                continue;
+
+            if (node.is_leaf())
+            {
+                if (visit_leaf(node.offset, static_cast<uint32_t>(node.count), lanes))
+                    break;
+                continue;
+            }
+
+            if (negative_direction[node.axis])
+            {
+                stack[stack_size++] = node_index + 1;
+                stack[stack_size++] = node.offset;
+            }
+            else
+            {
+                stack[stack_size++] = node.offset;
+                stack[stack_size++] = node_index + 1;
+            }
+        }
+        thread_counters.node_tests += node_tests;
+    }
+
+    //Uses nodes kept elsewhere, such as a mapped cache file, instead of building them. They are not copied and have to
+    //outlive the hierarchy, and the primitives have to be in the leaf order the nodes were built with already.
+    void assign(const bvh_node* p_nodes, const uint32_t p_node_count, const bvh_build_stats& p_stats)
+    {
+        nodes.clear();
+        order.clear();
+        external_nodes = p_node_count > 0 ? p_nodes : nullptr;
+        external_node_count = p_node_count;
+        stats = p_stats;
+    }
+
+    [[nodiscard]] bool empty() const { return node_count() == 0; }
+    [[nodiscard]] aabb bounds() const { return empty() ? aabb{} : node_data()[0].bounds; }
+    [[nodiscard]] const std::vector<uint32_t>& primitive_order() const { return order; }
+    //nullptr for an empty hierarchy
+    [[nodiscard]] const bvh_node* node_data() const { return external_nodes != nullptr ? external_nodes : nodes.empty() ? nullptr : nodes.data(); }
+    [[nodiscard]] uint32_t node_count() const { return external_nodes != nullptr ? external_node_count : static_cast<uint32_t>(nodes.size()); }
+    [[nodiscard]] const bvh_build_stats& get_build_stats() const { return stats; }
+
+private:
+    //past this depth nodes are split at the object median so the traversal stack can never overflow
+    static constexpr uint32_t max_sah_depth{max_stack_depth / 2};
+
+    struct bin
+    {
+        aabb bounds;
+        uint32_t count{};
+    };
+
+    void build_recursive(const std::vector<aabb>& p_bounds, const std::vector<point3>& p_centroids,
+                         const uint32_t begin, const uint32_t end, const uint32_t depth)
+    {
+        const auto node_index = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+        stats.max_depth = std::max(stats.max_depth, depth);
+
+        aabb node_bounds;
+        aabb centroid_bounds;
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            node_bounds.grow(p_bounds[order[i]]);
+            centroid_bounds.grow(p_centroids[order[i]]);
+        }
+        nodes[node_index].bounds = node_bounds;
+
+        const uint32_t count = end - begin;
+        if (count == 1)
+        {
+            make_leaf(node_index, begin, count);
+            return;
+        }
+
+        int best_axis{-1};
+        uint32_t best_split{0};
+        float best_cost{std::numeric_limits<float>::max()};
+        if (depth < max_sah_depth)
+        {
+            find_best_split(p_bounds, p_centroids, begin, end, centroid_bounds, best_axis, best_split, best_cost);
+        }
+
+        const float leaf_cost = intersection_cost * static_cast<float>(count) * node_bounds.surface_area();
+        const float split_cost = traversal_cost * node_bounds.surface_area() + intersection_cost * best_cost;
+        if (count <= max_leaf_size && (best_axis < 0 || leaf_cost <= split_cost))
+        {
+            make_leaf(node_index, begin, count);
+            return;
+        }
+
+        uint32_t middle{begin};
+        if (best_axis >= 0)
+        {
+            const float scale = bin_scale(centroid_bounds, best_axis);
+            const float axis_min = centroid_bounds.min[best_axis];
+            middle = static_cast<uint32_t>(std::partition(order.begin() + begin, order.begin() + end, [&](const uint32_t primitive) {
+                                                return bin_index(p_centroids[primitive][best_axis], axis_min, scale) < best_split;
+                                            }) -
+                                            order.begin());
+        }
+        else
+        {
+            best_axis = largest_axis(centroid_bounds);
+        }
+
+        if (middle == begin || middle == end)
+        {
+            middle = begin + count / 2;
+            std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](const uint32_t a, const uint32_t b) {
+                return p_centroids[a][best_axis] < p_centroids[b][best_axis];
+            });
+        }
+
+        nodes[node_index].axis = static_cast<uint16_t>(best_axis);
+        build_recursive(p_bounds, p_centroids, begin, middle, depth + 1);
+        nodes[node_index].offset = static_cast<uint32_t>(nodes.size());
+        build_recursive(p_bounds, p_centroids, middle, end, depth + 1);
+    }
+
+    void find_best_split(const std::vector<aabb>& p_bounds, const std::vector<point3>& p_centroids,
+                         const uint32_t begin, const uint32_t end, const aabb& centroid_bounds,
+                         int& best_axis, uint32_t& best_split, float& best_cost) const
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (centroid_bounds.max[axis] <= centroid_bounds.min[axis])
+                continue;
+
+            bin bins[bin_count]{};
+            const float scale = bin_scale(centroid_bounds, axis);
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                const uint32_t primitive = order[i];
+                bin& b = bins[bin_index(p_centroids[primitive][axis], centroid_bounds.min[axis], scale)];
+                b.bounds.grow(p_bounds[primitive]);
+                ++b.count;
+            }
+
+            //sweep from the right to get the cost of every plane between two bins in one pass
+            float right_area[bin_count]{};
+            uint32_t right_count[bin_count]{};
+            aabb right_bounds;
+            uint32_t right_total{0};
+            for (uint32_t i = bin_count - 1; i > 0; --i)
+            {
+                right_bounds.grow(bins[i].bounds);
+                right_total += bins[i].count;
+                right_area[i] = right_bounds.surface_area();
+                right_count[i] = right_total;
+            }
+
+            aabb left_bounds;
+            uint32_t left_total{0};
+            for (uint32_t split = 1; split < bin_count; ++split)
+            {
+                left_bounds.grow(bins[split - 1].bounds);
+                left_total += bins[split - 1].count;
+                if (left_total == 0 || right_count[split] == 0)
+                    continue;
+
+                const float cost = static_cast<float>(left_total) * left_bounds.surface_area() +
+                                   static_cast<float>(right_count[split]) * right_area[split];
+                if (cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_split = split;
+                }
+            }
+        }
+    }
+
+    void make_leaf(const uint32_t node_index, const uint32_t begin, const uint32_t count)
+    {
+        nodes[node_index].offset = begin;
+        nodes[node_index].count = static_cast<uint16_t>(count);
+        ++stats.leaf_count;
+    }
+
+    void compute_sah_cost()
+    {
+        const float root_area = nodes[0].bounds.surface_area();
+        if (root_area <= 0.0f)
+            return;
+
+        float cost{0.0f};
+        for (const bvh_node& node: nodes)
+        {
+            const float area = node.bounds.surface_area() / root_area;
+            cost += node.is_leaf() ? intersection_cost * static_cast<float>(node.count) * area : traversal_cost * area;
+        }
+        stats.sah_cost = cost;
+    }
+
+    static float bin_scale(const aabb& centroid_bounds, const int axis)
+    {
+        return static_cast<float>(bin_count) / (centroid_bounds.max[axis] - centroid_bounds.min[axis]);
+    }
+
+    static uint32_t bin_index(const float centroid, const float axis_min, const float scale)
+    {
+        return std::min(bin_count - 1, static_cast<uint32_t>(std::max(0.0f, (centroid - axis_min) * scale)));
+    }
+
+    static int largest_axis(const aabb& box)
+    {
+        const vec3 extent = box.max - box.min;
+        if (extent.x >= extent.y && extent.x >= extent.z)
+            return 0;
+        return extent.y >= extent.z ? 1 : 2;
+    }
+
+    std::vector<bvh_node> nodes;
+    const bvh_node* external_nodes{nullptr}; //set by assign, used instead of nodes
+    uint32_t external_node_count{0};
+    std::vector<uint32_t> order;
+    bvh_build_stats stats;
+    uint32_t max_leaf_size{4};
+    float intersection_cost{1.0f};
+};
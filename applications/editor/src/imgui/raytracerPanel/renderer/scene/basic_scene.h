@@ -1,4 +1,5 @@
 #pragma once
+#include <cmath>
 
 #include "camera/i_camera.h"
 #include "i_scene.h"
@@ -46,9 +47,25 @@ public:
     }
     ~basic_scene() override = default;
 
+	//the beam of a camera ray spreads over one pixel of the image
 	ray trace_camera_ray(const vec3& direction) const override
 	{
-		return camera.cast_ray(direction);
+		ray camera_ray = camera.cast_ray(direction);
+		camera_ray.set_cone({0.0f, pixel_angle()});
+		return camera_ray;
+	}
+
+	//through a point of the lens at an instant of the shutter interval, the beam keeps the spread of the pixel
+	ray trace_camera_ray(const vec3& direction, const camera_sample& sample) const override
+	{
+		ray camera_ray = camera.cast_ray(direction, sample);
+		camera_ray.set_cone({0.0f, pixel_angle()});
+		return camera_ray;
+	}
+
+	camera_features get_camera_features() const override
+	{
+		return camera.get_features();
 	}
 
 	uint32_t vertical_pixel_count() const override
@@ -76,9 +93,14 @@ public:
 		return camera.get_z_to_image();
 	}
 
-	color3 color_at(const ray& ray) const override
+	color3 color_at(const ray& ray, sampler& p_sampler) const override
 	{
-		return scene_objects.compute_color(ray, image.get_max_rays_per_pixel());
+		return scene_objects.compute_color(ray, image.get_max_rays_per_pixel(), p_sampler);
+	}
+
+	void color_at(ray_packet& packet, const uint32_t active, color3* colors, sampler* samplers, pixel_features* features) const override
+	{
+		scene_objects.compute_color(packet, active, image.get_max_rays_per_pixel(), colors, samplers, features);
 	}
 
 	void append_color_to_image(const color3& color) const override { image.append_pixel_color(color); }
@@ -87,12 +109,42 @@ public:
 	{
 		image.add_pixel_color_at_index(color, pixel_index);
 	}
+
+	void add_features_to_image(const pixel_features& features, const uint32_t& pixel_index) const override
+	{
+		image.add_pixel_features_at_index(features, pixel_index);
+	}
     uint8_t* get_image_data() const override
     {
         return image.get_pixel_data();
     }
 
+	uint32_t begin_sample_pass() const override { return image.begin_sample_pass(); }
+
+	void set_display_color(const color3& color, const uint32_t& pixel_index) const override
+	{
+		image.set_display_color_at_index(color, pixel_index);
+	}
+
+	void reset_accumulation() const override { image.reset_accumulation(); }
+
+	void reset_accumulation(const uint32_t x_begin, const uint32_t y_begin, const uint32_t x_end, const uint32_t y_end) const override
+	{
+		image.reset_accumulation(x_begin, y_begin, x_end, y_end);
+	}
+
+	uint32_t sample_count() const override { return image.get_sample_count(); }
+
+	uint32_t sample_count_at(const uint32_t& pixel_index) const override { return image.get_sample_count_at(pixel_index); }
+
+	float relative_error_at(const uint32_t& pixel_index) const override { return image.relative_error_at(pixel_index); }
+
 private:
+	float pixel_angle() const
+	{
+		return glm::length(camera.get_height()) / (std::abs(camera.get_z_to_image()) * static_cast<float>(image.get_height()));
+	}
+
 	i_image& image;
 	object_manager& scene_objects;
 	i_camera& camera;
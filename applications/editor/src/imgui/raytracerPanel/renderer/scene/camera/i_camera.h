@@ -1,11 +1,29 @@
 #pragma once
 #include "imgui/raytracerPanel/renderer/ray.h"
 
+//what a camera ray samples besides its pixel, the renderer generates camera rays with an instantiation for each
+//combination so a pinhole camera with its shutter closed keeps the plain ray generation
+struct camera_features
+{
+	bool lens{false};   //the aperture is open, rays start anywhere on the lens
+	bool shutter{false};//the shutter stays open over an interval, rays get a time inside it
+};
+
+//uniform numbers in [0, 1) picking the point on the lens and the instant in the shutter interval
+struct camera_sample
+{
+	glm::vec2 lens{0.5f, 0.5f};
+	float time{0.0f};
+};
+
 class i_camera
 {
 public:
 	virtual ~i_camera() = default;
 	virtual ray cast_ray(const vec3& direction) const = 0;
+	//cameras without an aperture or a shutter cast the pinhole ray
+	virtual ray cast_ray(const vec3& direction, const camera_sample&) const { return cast_ray(direction); }
+	virtual camera_features get_features() const { return {}; }
 	virtual vec3 get_width() const = 0;
 	virtual vec3 get_height() const = 0;
 	virtual float get_z_to_image() const = 0;
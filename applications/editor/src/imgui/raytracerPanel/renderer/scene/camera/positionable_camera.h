@@ -1,6 +1,7 @@
 #pragma once
 #include "i_camera.h"
 #include "../../ray.h"
+#include "../../sampler.h"
 #include "glm/glm.hpp"
 
 class positionable_camera final : public i_camera
@@ -14,13 +15,53 @@ public:
 		camera_to_world_v(cross(camera_to_world_w, camera_to_world_u)),
 		canvas_width(viewport_width * camera_to_world_u), canvas_height(viewport_height * camera_to_world_v),
 		camera_position(look_from),
-		canvas_bottom_left(camera_position - canvas_width * 0.5f - canvas_height * 0.5f - camera_to_world_w)
+		canvas_bottom_left(camera_position - canvas_width * 0.5f - canvas_height * 0.5f - camera_to_world_w),
+		look_at_distance(glm::length(look_from - look_at))
 	{
 	} //vup is viewup vector(orthonormal coordinates), vfov is vertical field of view
 
 
 	~positionable_camera() override = default;
 
+	//moves the camera, keeping its field of view and aspect ratio
+	void set_view(const point3 look_from, const point3 look_at, const vec3 vup)
+	{
+		camera_to_world_w = normalize(look_from - look_at);
+		camera_to_world_u = normalize(cross(vup, camera_to_world_w));
+		camera_to_world_v = cross(camera_to_world_w, camera_to_world_u);
+		canvas_width = viewport_width * camera_to_world_u;
+		canvas_height = viewport_height * camera_to_world_v;
+		camera_position = look_from;
+		canvas_bottom_left = camera_position - canvas_width * 0.5f - canvas_height * 0.5f - camera_to_world_w;
+		canvas_top_right = camera_position + viewport_width / 2.0f + viewport_height / 2.0f - vec3{0, 0, z_to_image};
+		look_at_distance = glm::length(look_from - look_at);
+	}
+
+	//changes the vertical field of view in degrees, keeping the view and the aspect ratio
+	void set_field_of_view(const float vfov)
+	{
+		const float aspect_ratio = viewport_width / viewport_height;
+		viewport_height = 2 * glm::tan(glm::radians(vfov) / 2);
+		viewport_width = viewport_height * aspect_ratio;
+		set_view(camera_position, camera_position - look_at_distance * camera_to_world_w, camera_to_world_v);
+	}
+
+	//Thin lens of the given aperture diameter, the points at focus_distance along the view axis are sharp and the rest
+	//blurs with its distance to that plane. An aperture of 0 is a pinhole, a focus distance of 0 focuses on look_at.
+	void set_lens(const float aperture, const float p_focus_distance)
+	{
+		lens_radius = std::max(0.0f, aperture * 0.5f);
+		focus_distance = std::max(0.0f, p_focus_distance);
+	}
+
+	//Interval of the scene time, 0 to 1, the shutter stays open for. The rays get a time spread over it, which blurs
+	//the objects moving during that time. An empty interval freezes the scene at its open time.
+	void set_shutter(const float open, const float close)
+	{
+		shutter_open = open;
+		shutter_close = std::max(open, close);
+	}
+
 
 	ray cast_ray(const vec3& direction) const override
 	{
@@ -30,6 +71,35 @@ public:
 		};
 	}
 
+	//The canvas is one unit away along the view axis, so the pinhole direction scaled by the focus distance reaches the
+	//plane in focus, which the rays leaving every point of the lens converge to.
+	ray cast_ray(const vec3& direction, const camera_sample& sample) const override
+	{
+		const vec3 pinhole_direction = canvas_bottom_left + direction.x * canvas_width + direction.y * canvas_height - camera_position;
+		point3 origin = camera_position;
+		vec3 lens_direction = pinhole_direction;
+		if (lens_radius > 0.0f)
+		{
+			const glm::vec2 disk = lens_radius * concentric_disk_sample(sample.lens);
+			const vec3 lens_offset = disk.x * camera_to_world_u + disk.y * camera_to_world_v;
+			origin += lens_offset;
+			lens_direction = pinhole_direction * get_focus_distance() - lens_offset;
+		}
+		ray camera_ray{origin, lens_direction};
+		camera_ray.set_time(shutter_open + sample.time * (shutter_close - shutter_open));
+		return camera_ray;
+	}
+
+	camera_features get_features() const override
+	{
+		return {lens_radius > 0.0f, shutter_close > shutter_open};
+	}
+
+	float get_focus_distance() const
+	{
+		return focus_distance > 0.0f ? focus_distance : look_at_distance;
+	}
+
 	vec3 get_width() const override
 	{
 		return canvas_width;
@@ -52,18 +122,24 @@ private:
 									   This is an arbitrary value, it being 1 is only for simplification of calculations(this is the focal length). */
 
 
-	const float viewport_height; //Value of 2 units to fit Normalized Device Coordinates [-1:1]
-	const float viewport_width;
+	float viewport_height; //Value of 2 units to fit Normalized Device Coordinates [-1:1]
+	float viewport_width;
 
 	vec3 camera_to_world_w;
 	vec3 camera_to_world_u;
 	vec3 camera_to_world_v;
 
-	const vec3 canvas_width;
-	const vec3 canvas_height;
-	const point3 camera_position; //Negative z goes towards the scene.
-	const point3 canvas_bottom_left;
-	const point3 canvas_top_right{
+	vec3 canvas_width;
+	vec3 canvas_height;
+	point3 camera_position; //Negative z goes towards the scene.
+	point3 canvas_bottom_left;
+	point3 canvas_top_right{
 		camera_position + viewport_width / 2.0f + viewport_height / 2.0f - vec3{0, 0, z_to_image}
 	};
+	float look_at_distance;
+
+	float lens_radius{0.0f};
+	float focus_distance{0.0f};
+	float shutter_open{0.0f};
+	float shutter_close{0.0f};
 };
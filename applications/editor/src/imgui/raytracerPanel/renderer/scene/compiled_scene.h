@@ -0,0 +1,583 @@
+#pragma once
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "acceleration/bvh.h"
+#include "objects/i_object.h"
+#include "objects/box.h"
+#include "objects/mesh_instance.h"
+#include "objects/moving_mesh_instance.h"
+#include "objects/sphere.h"
+#include "objects/triangle_mesh.h"
+#include "objects/materials/emissive.h"
+#include "objects/materials/glass.h"
+#include "objects/materials/metal.h"
+#include "objects/materials/textures/base_color.h"
+#include "objects/materials/textures/checker.h"
+#include "objects/materials/textures/image_texture.h"
+#include "../render_stats.h"
+#include "../sampler.h"
+#include "../spectrum.h"
+
+//closest hit of a ray, the surface is shaded once when the hit is found and the result travels with it
+struct surface_hit
+{
+    point3 t;
+    vec3 normal;
+    glm::vec2 uv;
+    float uv_scale;  //see i_object::intersect
+    surface_offset offset;
+    ray_cone cone;   //beam of the ray at the hit, the rays leaving it start from its width
+    float footprint; //width of the beam on the surface, larger than the one of the beam at grazing angles
+    uint32_t material;
+    color3 albedo;
+    float shininess;
+    float specular_weight;
+    color3 emission;
+    uint32_t light;//light sampling the emissive surface hit, no_light for the other surfaces
+    float time;    //of the ray that reached the hit, the rays leaving it see the scene at the same instant
+};
+
+enum class object_type : uint8_t
+{
+    sphere,
+    box,
+    triangle_mesh,
+    mesh_instance,
+    moving_mesh_instance,
+    generic//any other i_object, intersected and shaded through its virtual interface
+};
+
+enum class material_type : uint8_t
+{
+    metal,
+    glass,
+    dispersive_glass,//glass whose index varies with the wavelength
+    emissive,
+    generic,       //any other i_material, shaded through its virtual interface
+    generic_object //shaded by the i_object itself, for generic objects whose material is not exposed
+};
+
+enum class texture_type : uint8_t
+{
+    base_color,
+    checker,
+    image,
+    generic
+};
+
+struct object_record
+{
+    object_type type;
+    uint32_t index;   //into the array of its type
+    uint32_t material;//into materials
+};
+
+struct material_record
+{
+    material_type type;
+    uint32_t index;  //into the array of its type
+    uint32_t texture;//into textures
+    float shininess;
+    float specular_weight;
+    color3 emission{0.0f, 0.0f, 0.0f};
+    uint32_t light{std::numeric_limits<uint32_t>::max()};
+};
+
+struct texture_record
+{
+    texture_type type;
+    color3 color;
+    uint32_t even;
+    uint32_t odd;
+    const i_texture* source;
+    const image_texture* image{nullptr};
+};
+
+//meshes sharing an emissive material, they are sampled as one area light
+struct emitter
+{
+    uint32_t material;
+    color3 radiance;
+    std::vector<const triangle_mesh*> meshes;
+};
+
+//Flat form of the scene the integrator runs on. Objects, materials and textures are copied into arrays of their
+//concrete type and reached through a switch on the record type, so the intersection and shading of the built-in
+//types are direct calls the compiler can inline instead of chains of virtual calls. Types it does not know keep
+//working through their virtual interface.
+class compiled_scene
+{
+public:
+    static constexpr uint32_t no_material{std::numeric_limits<uint32_t>::max()};
+    static constexpr uint32_t no_light{std::numeric_limits<uint32_t>::max()};
+
+    compiled_scene() = default;
+    compiled_scene(const compiled_scene&) = default;
+    compiled_scene(compiled_scene&&) noexcept = default;
+    compiled_scene& operator=(compiled_scene&&) noexcept = default;
+    //the typed arrays hold objects with const members, a copy is built and moved in instead of assigned element-wise
+    compiled_scene& operator=(const compiled_scene& other)
+    {
+        return *this = compiled_scene{other};
+    }
+    ~compiled_scene() = default;
+
+    //builds the top level hierarchy over the objects and the records in its leaf order
+    void compile(const std::vector<i_object*>& p_objects)
+    {
+        clear();
+
+        std::vector<aabb> object_bounds;
+        object_bounds.reserve(p_objects.size());
+        for (const auto& object: p_objects)
+        {
+            object_bounds.push_back(object->bounds());
+        }
+        object_bvh.build(object_bounds, max_objects_per_leaf);
+
+        std::unordered_map<const i_material*, uint32_t> compiled_materials;
+        std::unordered_map<const i_texture*, uint32_t> compiled_textures;
+        for (const uint32_t index: object_bvh.primitive_order())
+        {
+            objects.push_back(compile_object(p_objects[index], compiled_materials, compiled_textures));
+        }
+    }
+
+    [[nodiscard]] const bvh& get_bvh() const
+    {
+        return object_bvh;
+    }
+
+    //closest hit inside the interval of the ray, the hit is shaded before returning. Every hit found ends the interval
+    //of a copy of the ray, which the objects and the nodes tested next are pruned against.
+    bool intersect(const ray& p_ray, surface_hit& hit) const
+    {
+        ray traced{p_ray};
+        uint32_t hit_object{no_object};
+        object_bvh.traverse(traced.get_origin(), traced.get_direction(), traced.get_t_max(), [&](const uint32_t first, const uint32_t count, float& t_max) {
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                if (intersect_object(objects[i], traced, hit))
+                {
+                    hit_object = i;
+                }
+            }
+            t_max = traced.get_t_max();
+            return false;
+        });
+        if (hit_object == no_object)
+            return false;
+
+        hit.material = objects[hit_object].material;
+        hit.time = traced.get_time();
+        set_footprint(traced, traced.get_t_max(), hit);
+        shade(hit);
+        return true;
+    }
+
+    //any hit query inside the interval of the ray, stops at the first object found along it
+    bool occluded(const ray& p_ray) const
+    {
+        bool hit_something{false};
+        surface_hit hit;
+        object_bvh.traverse(p_ray.get_origin(), p_ray.get_direction(), p_ray.get_t_max(), [&](const uint32_t first, const uint32_t count, float&) {
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                ray shadow_ray{p_ray};
+                if (intersect_object(objects[i], shadow_ray, hit))
+                {
+                    hit_something = true;
+                    return true;
+                }
+            }
+            return false;
+        });
+        return hit_something;
+    }
+
+    //closest hit for every active lane of the packet, lanes that miss keep no_material
+    void intersect(ray_packet& packet, const uint32_t active, packet_hits& hits) const
+    {
+        for_each_lane(active, [&](const uint32_t lane) { hits.material[lane] = no_material; });
+
+        uint32_t lanes_to_trace{active};
+        object_bvh.traverse(packet, lanes_to_trace, [&](const uint32_t first, const uint32_t count, const uint32_t lanes) {
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                for_each_lane(intersect_object(objects[i], packet, lanes, hits), [&](const uint32_t lane) {
+                    hits.material[lane] = objects[i].material;
+                });
+            }
+            return false;
+        });
+    }
+
+    //any hit query for every active lane closer than its t_max, returns the mask of the occluded lanes
+    uint32_t occluded(ray_packet& packet, const uint32_t active) const
+    {
+        uint32_t occluded_lanes{0};
+        uint32_t lanes_to_trace{active};
+        packet_hits hits;
+        object_bvh.traverse(packet, lanes_to_trace, [&](const uint32_t first, const uint32_t count, const uint32_t lanes) {
+            for (uint32_t i = first; i < first + count && (lanes & ~occluded_lanes) != 0; ++i)
+            {
+                occluded_lanes |= intersect_object(objects[i], packet, lanes & ~occluded_lanes, hits);
+            }
+            lanes_to_trace &= ~occluded_lanes;
+            return lanes_to_trace == 0;
+        });
+        return occluded_lanes;
+    }
+
+    //beam of a ray reaching a hit at the given distance and its footprint on the surface, for the texture lookups
+    static void set_footprint(const ray& p_ray, const float distance, surface_hit& hit)
+    {
+        const ray_cone cone = p_ray.get_cone();
+        hit.cone = {cone.width_at(distance), cone.spread};
+        const float cos_theta = std::abs(glm::dot(hit.offset.geometric_normal, p_ray.get_direction()));
+        hit.footprint = hit.cone.width / std::max(cos_theta, min_footprint_cosine);
+    }
+
+    //fills the albedo and shininess of a hit whose position, uv, footprint and material are known
+    void shade(surface_hit& hit) const
+    {
+        const material_record& material = materials[hit.material];
+        hit.shininess = material.shininess;
+        hit.specular_weight = material.specular_weight;
+        hit.emission = material.emission;
+        hit.light = material.light;
+        switch (material.type)
+        {
+            case material_type::emissive:
+                hit.albedo = {0.0f, 0.0f, 0.0f};
+                break;
+            case material_type::generic:
+                hit.albedo = generic_materials[material.index]->color_at(hit.t, hit.uv);
+                break;
+            case material_type::generic_object:
+                hit.albedo = generic_objects[material.index]->color_at(hit.t, hit.uv);
+                break;
+            default:
+                hit.albedo = texture_color(material.texture, hit.t, hit.uv, hit.footprint * hit.uv_scale);
+                break;
+        }
+    }
+
+    [[nodiscard]] float specular_weight(const uint32_t material) const
+    {
+        return materials[material].specular_weight;
+    }
+
+    [[nodiscard]] const std::vector<emitter>& get_emitters() const
+    {
+        return emitters;
+    }
+
+    //light the hits on the emitter report, for the bsdf rays to be weighted against the sampling of that light
+    void set_emitter_light(const uint32_t p_emitter, const uint32_t light)
+    {
+        materials[emitters[p_emitter].material].light = light;
+    }
+
+    //specular direction of the material, the dispersive ones sample and weigh the wavelengths of the path
+    void alter_ray_direction(const uint32_t material, const ray& incident_ray, const vec3& normal, vec3& next_direction,
+                             sampler& p_sampler, hero_wavelengths& wavelengths) const
+    {
+        const material_record& record = materials[material];
+        switch (record.type)
+        {
+            case material_type::metal:
+                metals[record.index].alter_ray_direction(incident_ray, normal, next_direction, p_sampler);
+                break;
+            case material_type::glass:
+                glasses[record.index].alter_ray_direction(incident_ray, normal, next_direction, p_sampler);
+                break;
+            case material_type::dispersive_glass:
+                glasses[record.index].alter_ray_direction(incident_ray, normal, next_direction, wavelengths, p_sampler);
+                break;
+            case material_type::emissive:
+                next_direction = normal;
+                break;
+            case material_type::generic:
+                generic_materials[record.index]->alter_ray_direction(incident_ray, normal, next_direction, p_sampler);
+                break;
+            case material_type::generic_object:
+                generic_objects[record.index]->alter_ray_direction(incident_ray, normal, next_direction, p_sampler);
+                break;
+        }
+    }
+
+private:
+    static constexpr uint32_t max_objects_per_leaf{2};
+    static constexpr uint32_t no_object{std::numeric_limits<uint32_t>::max()};
+    //bounds how far the footprint of a beam stretches at grazing angles
+    static constexpr float min_footprint_cosine{0.05f};
+
+    void clear()
+    {
+        objects.clear();
+        materials.clear();
+        emitters.clear();
+        textures.clear();
+        spheres.clear();
+        boxes.clear();
+        meshes.clear();
+        instances.clear();
+        moving_instances.clear();
+        metals.clear();
+        glasses.clear();
+        generic_objects.clear();
+        generic_materials.clear();
+    }
+
+    //keeps the hit if the object finds one inside the interval of the ray, the object then ends the interval at it
+    template<typename Object>
+    static bool keep_closer(const Object& object, ray& p_ray, surface_hit& hit)
+    {
+        point3 t;
+        vec3 normal;
+        glm::vec2 uv;
+        float uv_scale;
+        surface_offset offset;
+        if (!object.intersect(p_ray, t, normal, uv, uv_scale, offset))
+            return false;
+
+        hit.t = t;
+        hit.normal = normal;
+        hit.uv = uv;
+        hit.uv_scale = uv_scale;
+        hit.offset = offset;
+        return true;
+    }
+
+    bool intersect_object(const object_record& object, ray& p_ray, surface_hit& hit) const
+    {
+        switch (object.type)
+        {
+            case object_type::sphere:
+                return keep_closer(spheres[object.index], p_ray, hit);
+            case object_type::box:
+                return keep_closer(boxes[object.index], p_ray, hit);
+            case object_type::triangle_mesh:
+                return keep_closer(*meshes[object.index], p_ray, hit);
+            case object_type::mesh_instance:
+                return keep_closer(*instances[object.index], p_ray, hit);
+            case object_type::moving_mesh_instance:
+                return keep_closer(*moving_instances[object.index], p_ray, hit);
+            case object_type::generic:
+                return keep_closer(*generic_objects[object.index], p_ray, hit);
+        }
+        return false;
+    }
+
+    //lane by lane packet test for the objects without a packet path
+    template<typename Object>
+    static uint32_t intersect_lanes(const Object& object, ray_packet& packet, const uint32_t lanes, packet_hits& hits)
+    {
+        uint32_t hit_lanes{0};
+        for_each_lane(lanes, [&](const uint32_t lane) {
+            surface_hit hit;
+            ray lane_ray{packet.get_ray(lane)};
+            if (keep_closer(object, lane_ray, hit))
+            {
+                packet.t_max[lane] = lane_ray.get_t_max();
+                hits.t[lane] = hit.t;
+                hits.normal[lane] = hit.normal;
+                hits.uv[lane] = hit.uv;
+                hits.uv_scale[lane] = hit.uv_scale;
+                hits.offset[lane] = hit.offset;
+                hit_lanes |= 1u << lane;
+            }
+        });
+        return hit_lanes;
+    }
+
+    uint32_t intersect_object(const object_record& object, ray_packet& packet, const uint32_t lanes, packet_hits& hits) const
+    {
+        switch (object.type)
+        {
+            case object_type::sphere:
+                return intersect_lanes(spheres[object.index], packet, lanes, hits);
+            case object_type::box:
+                return intersect_lanes(boxes[object.index], packet, lanes, hits);
+            case object_type::triangle_mesh:
+                return meshes[object.index]->intersect_packet(packet, lanes, hits);
+            case object_type::mesh_instance:
+                return instances[object.index]->intersect_packet(packet, lanes, hits);
+            case object_type::moving_mesh_instance:
+                return intersect_lanes(*moving_instances[object.index], packet, lanes, hits);
+            case object_type::generic:
+                return generic_objects[object.index]->intersect_packet(packet, lanes, hits);
+        }
+        return 0;
+    }
+
+    //footprint is the width of the lookup in uv units, only the image textures filter over it
+    color3 texture_color(uint32_t texture, const point3& p, const glm::vec2& uv, const float footprint) const
+    {
+        //checkers nest other textures, walked down until a leaf color
+        for (;;)
+        {
+            const texture_record& record = textures[texture];
+            switch (record.type)
+            {
+                case texture_type::base_color:
+                    return record.color;
+                case texture_type::checker:
+                    texture = checker::is_odd(p) ? record.odd : record.even;
+                    break;
+                case texture_type::image:
+                    return record.image->sample(uv, footprint);
+                case texture_type::generic:
+                    return record.source->color_at(p, uv);
+            }
+        }
+    }
+
+    static float compute_specular_weight(const float shininess)
+    {
+        // Dynamic specular weight based on material shininess
+        return std::min(1.0f, std::max(0.1f, 1.0f - std::exp(-0.1f * shininess)));
+    }
+
+    object_record compile_object(const i_object* object, std::unordered_map<const i_material*, uint32_t>& compiled_materials,
+                                 std::unordered_map<const i_texture*, uint32_t>& compiled_textures)
+    {
+        if (const auto* typed = dynamic_cast<const sphere*>(object))
+        {
+            spheres.push_back(*typed);
+            return {object_type::sphere, static_cast<uint32_t>(spheres.size() - 1), compile_material(typed->get_material(), compiled_materials, compiled_textures)};
+        }
+        if (const auto* typed = dynamic_cast<const box*>(object))
+        {
+            boxes.push_back(*typed);
+            return {object_type::box, static_cast<uint32_t>(boxes.size() - 1), compile_material(typed->get_material(), compiled_materials, compiled_textures)};
+        }
+        if (const auto* typed = dynamic_cast<const triangle_mesh*>(object))
+        {
+            meshes.push_back(typed);
+            const uint32_t material = compile_material(typed->get_material(), compiled_materials, compiled_textures);
+            if (materials[material].type == material_type::emissive)
+            {
+                add_emitter(material, typed);
+            }
+            return {object_type::triangle_mesh, static_cast<uint32_t>(meshes.size() - 1), material};
+        }
+        //emissive instances glow when hit but are not sampled as area lights
+        if (const auto* typed = dynamic_cast<const mesh_instance*>(object))
+        {
+            instances.push_back(typed);
+            return {object_type::mesh_instance, static_cast<uint32_t>(instances.size() - 1), compile_material(typed->get_material(), compiled_materials, compiled_textures)};
+        }
+        //the lanes of a packet may have different times, they are traced one by one
+        if (const auto* typed = dynamic_cast<const moving_mesh_instance*>(object))
+        {
+            moving_instances.push_back(typed);
+            return {object_type::moving_mesh_instance, static_cast<uint32_t>(moving_instances.size() - 1),
+                    compile_material(typed->get_material(), compiled_materials, compiled_textures)};
+        }
+
+        generic_objects.push_back(object);
+        const auto index = static_cast<uint32_t>(generic_objects.size() - 1);
+        materials.push_back({material_type::generic_object, index, 0, object->get_shininess(), compute_specular_weight(object->get_shininess())});
+        return {object_type::generic, index, static_cast<uint32_t>(materials.size() - 1)};
+    }
+
+    uint32_t compile_material(const i_material* material, std::unordered_map<const i_material*, uint32_t>& compiled_materials,
+                              std::unordered_map<const i_texture*, uint32_t>& compiled_textures)
+    {
+        if (const auto found = compiled_materials.find(material); found != compiled_materials.end())
+            return found->second;
+
+        material_record record{material_type::generic, 0, 0, material->get_shininess(), compute_specular_weight(material->get_shininess())};
+        if (const auto* typed = dynamic_cast<const metal*>(material))
+        {
+            metals.push_back(*typed);
+            record.type = material_type::metal;
+            record.index = static_cast<uint32_t>(metals.size() - 1);
+            record.texture = compile_texture(typed->get_texture(), compiled_textures);
+        }
+        else if (const auto* typed = dynamic_cast<const glass*>(material))
+        {
+            glasses.push_back(*typed);
+            record.type = typed->is_dispersive() ? material_type::dispersive_glass : material_type::glass;
+            record.index = static_cast<uint32_t>(glasses.size() - 1);
+            record.texture = compile_texture(typed->get_texture(), compiled_textures);
+        }
+        else if (const auto* typed = dynamic_cast<const emissive*>(material))
+        {
+            record.type = material_type::emissive;
+            record.emission = typed->get_radiance();
+        }
+        else
+        {
+            generic_materials.push_back(material);
+            record.index = static_cast<uint32_t>(generic_materials.size() - 1);
+        }
+
+        materials.push_back(record);
+        return compiled_materials[material] = static_cast<uint32_t>(materials.size() - 1);
+    }
+
+    void add_emitter(const uint32_t material, const triangle_mesh* mesh)
+    {
+        for (auto& existing: emitters)
+        {
+            if (existing.material == material)
+            {
+                existing.meshes.push_back(mesh);
+                return;
+            }
+        }
+        emitters.push_back({material, materials[material].emission, {mesh}});
+    }
+
+    uint32_t compile_texture(const i_texture* texture, std::unordered_map<const i_texture*, uint32_t>& compiled_textures)
+    {
+        if (const auto found = compiled_textures.find(texture); found != compiled_textures.end())
+            return found->second;
+
+        texture_record record{texture_type::generic, {}, 0, 0, texture};
+        if (const auto* typed = dynamic_cast<const base_color*>(texture))
+        {
+            record.type = texture_type::base_color;
+            record.color = typed->get_color();
+        }
+        else if (const auto* typed = dynamic_cast<const checker*>(texture))
+        {
+            record.type = texture_type::checker;
+            record.even = compile_texture(typed->get_even(), compiled_textures);
+            record.odd = compile_texture(typed->get_odd(), compiled_textures);
+        }
+        else if (const auto* typed = dynamic_cast<const image_texture*>(texture))
+        {
+            record.type = texture_type::image;
+            record.image = typed;
+        }
+
+        textures.push_back(record);
+        return compiled_textures[texture] = static_cast<uint32_t>(textures.size() - 1);
+    }
+
+    bvh object_bvh;
+    std::vector<object_record> objects;
+    std::vector<material_record> materials;
+    std::vector<texture_record> textures;
+    std::vector<emitter> emitters;
+
+    std::vector<sphere> spheres;
+    std::vector<box> boxes;
+    std::vector<const triangle_mesh*> meshes;
+    std::vector<const mesh_instance*> instances;
+    std::vector<const moving_mesh_instance*> moving_instances;
+    std::vector<metal> metals;
+    std::vector<glass> glasses;
+
+    std::vector<const i_object*> generic_objects;
+    std::vector<const i_material*> generic_materials;
+};
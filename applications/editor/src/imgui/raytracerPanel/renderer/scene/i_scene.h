@@ -1,5 +1,8 @@
 #pragma once
 #include "../ray.h"
+#include "../ray_packet.h"
+#include "../sampler.h"
+#include "camera/i_camera.h"
 #include "object_manager.h"
 
 class i_scene
@@ -7,13 +10,24 @@ class i_scene
 public:
 	virtual ~i_scene() = default;
 	virtual ray trace_camera_ray(const vec3& direction) const = 0;
+	virtual ray trace_camera_ray(const vec3& direction, const camera_sample& sample) const = 0;
+	virtual camera_features get_camera_features() const = 0;
 	virtual uint32_t vertical_pixel_count() const = 0;
 	virtual uint32_t horizontal_pixel_count() const = 0;
 	virtual vec3 viewport_height() const = 0;
 	virtual vec3 viewport_width() const = 0;
 	virtual float z_to_image() const = 0;
-	virtual color3 color_at(const ray& ray) const = 0;
+	virtual color3 color_at(const ray& ray, sampler& p_sampler) const = 0;
+	virtual void color_at(ray_packet& packet, uint32_t active, color3* colors, sampler* samplers, pixel_features* features) const = 0;
 	virtual void append_color_to_image(const color3& color) const = 0;
 	virtual void add_color_to_image(const color3& color, const uint32_t& pixel_index) const = 0;
+	virtual void add_features_to_image(const pixel_features& features, const uint32_t& pixel_index) const = 0;
 	virtual uint8_t* get_image_data() const = 0;
+	virtual uint32_t begin_sample_pass() const = 0;
+	virtual void set_display_color(const color3& color, const uint32_t& pixel_index) const = 0;
+	virtual void reset_accumulation() const = 0;
+	virtual void reset_accumulation(uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end) const = 0;
+	virtual uint32_t sample_count() const = 0;
+	virtual uint32_t sample_count_at(const uint32_t& pixel_index) const = 0;
+	virtual float relative_error_at(const uint32_t& pixel_index) const = 0;
 };
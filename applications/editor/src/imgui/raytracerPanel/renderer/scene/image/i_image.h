@@ -12,4 +12,14 @@ public:
 	virtual uint8_t* get_pixel_data() const = 0;
 	virtual uint32_t get_nb_channels() const = 0;
 	virtual void add_pixel_color_at_index(const color3& color, const uint32_t& pixel_index) const = 0;
+	virtual const color3* get_accumulation_data() const = 0;
+	virtual void add_pixel_features_at_index(const pixel_features& features, const uint32_t& pixel_index) const = 0;
+	virtual const pixel_features* get_feature_data() const = 0;
+	virtual uint32_t get_sample_count() const = 0;
+	virtual uint32_t get_sample_count_at(const uint32_t& pixel_index) const = 0;
+	virtual float relative_error_at(const uint32_t& pixel_index) const = 0;
+	virtual void set_display_color_at_index(const color3& color, const uint32_t& pixel_index) const = 0;
+	virtual void reset_accumulation() = 0;
+	virtual void reset_accumulation(uint32_t x_begin, uint32_t y_begin, uint32_t x_end, uint32_t y_end) = 0;
+	virtual uint32_t begin_sample_pass() = 0;
 };
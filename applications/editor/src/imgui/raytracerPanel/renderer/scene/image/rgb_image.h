@@ -1,5 +1,8 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <limits>
 
 #include "i_image.h"
 #include "../../utils.h"
@@ -11,6 +14,16 @@ inline float clamp(float x, float min, float max)
 	return x;
 }
 
+enum class tone_mapping
+{
+	clamp,   //radiance above 1 saturates
+	reinhard //x / (1 + x), keeps highlights
+};
+
+//The 8 bit display buffer is tonemapped from a floating point HDR buffer that accumulates the samples of every pass
+//since the last reset_accumulation(), so progressive passes refine the running average. Every pixel counts its own
+//samples, adaptive sampling skips the pixels that already converged, and keeps the second moment of their luminance
+//to estimate how far the average still is from the converged value.
 class rgb_image final : public i_image
 {
 public:
@@ -21,14 +34,27 @@ public:
 		aspect_ratio(
 			width / static_cast<float>(height)),
 		pixel_count(height * p_width * p_nb_channels),
-		pixels(new uint8_t[pixel_count]), max_rays_per_pixel(p_max_rays_per_pixel)
+		pixels(new uint8_t[pixel_count]), max_rays_per_pixel(p_max_rays_per_pixel),
+		accumulation(new color3[width * height]),
+		features(new pixel_features[width * height]),
+		pixel_sample_counts(new uint32_t[width * height]),
+		luminance_moments(new float[width * height])
 	{
+		reset_accumulation();
 	}
 
 	~rgb_image() override
 	{
 		delete[] pixels;
 		pixels = nullptr;
+		delete[] accumulation;
+		accumulation = nullptr;
+		delete[] features;
+		features = nullptr;
+		delete[] pixel_sample_counts;
+		pixel_sample_counts = nullptr;
+		delete[] luminance_moments;
+		luminance_moments = nullptr;
 	}
 
 	void append_pixel_color(const color3& color) override
@@ -38,12 +64,106 @@ public:
 		pixels[current_pixel_index++] = clamp(pow(color.b, 1.0f / 2.2f), 0.0f, 1.0f) * 255.0f;
 	}
 
+	//adds one sample of the current pass to the pixel and refreshes its display value from the running average
 	void add_pixel_color_at_index(const color3& color, const uint32_t& pixel_index) const override
+	{
+		accumulation[pixel_index] += color;
+		const float sample_luminance = luminance(color);
+		luminance_moments[pixel_index] += sample_luminance * sample_luminance;
+		const color3 average = accumulation[pixel_index] / static_cast<float>(++pixel_sample_counts[pixel_index]);
+
+		uint32_t rgb_pixel_index = pixel_index * 3;
+		pixels[rgb_pixel_index++] = to_display(average.r);
+		pixels[rgb_pixel_index++] = to_display(average.g);
+		pixels[rgb_pixel_index] = to_display(average.b);
+	}
+
+	//the features are summed like the colors, the denoiser averages them with the same sample count
+	void add_pixel_features_at_index(const pixel_features& pixel, const uint32_t& pixel_index) const override
+	{
+		pixel_features& sum = features[pixel_index];
+		sum.albedo += pixel.albedo;
+		sum.normal += pixel.normal;
+		sum.depth += pixel.depth;
+	}
+
+	//overwrites the display value of a pixel without touching the accumulated samples
+	void set_display_color_at_index(const color3& color, const uint32_t& pixel_index) const override
 	{
 		uint32_t rgb_pixel_index = pixel_index * 3;
-		pixels[rgb_pixel_index++] = clamp(pow(color.r, 1.0f / 2.2f), 0.0f, 1.0f) * 255.0f; //float between [0-1] to RGB
-		pixels[rgb_pixel_index++] = clamp(pow(color.g, 1.0f / 2.2f), 0.0f, 1.0f) * 255.0f;
-		pixels[rgb_pixel_index] = clamp(pow(color.b, 1.0f / 2.2f), 0.0f, 1.0f) * 255.0f;
+		pixels[rgb_pixel_index++] = to_display(color.r);
+		pixels[rgb_pixel_index++] = to_display(color.g);
+		pixels[rgb_pixel_index] = to_display(color.b);
+	}
+
+	void reset_accumulation() override
+	{
+		std::fill(accumulation, accumulation + width * height, color3{0.0f, 0.0f, 0.0f});
+		std::fill(features, features + width * height, pixel_features{});
+		std::fill(pixel_sample_counts, pixel_sample_counts + width * height, 0u);
+		std::fill(luminance_moments, luminance_moments + width * height, 0.0f);
+		sample_count = 0;
+	}
+
+	//drops the samples of the pixels of a rectangle only, the pass count and the display values stay
+	void reset_accumulation(const uint32_t x_begin, const uint32_t y_begin, const uint32_t x_end, const uint32_t y_end) override
+	{
+		for (uint32_t y = y_begin; y < y_end; ++y)
+		{
+			const uint32_t row_begin = y * width + x_begin;
+			const uint32_t row_end = y * width + x_end;
+			std::fill(accumulation + row_begin, accumulation + row_end, color3{0.0f, 0.0f, 0.0f});
+			std::fill(features + row_begin, features + row_end, pixel_features{});
+			std::fill(pixel_sample_counts + row_begin, pixel_sample_counts + row_end, 0u);
+			std::fill(luminance_moments + row_begin, luminance_moments + row_end, 0.0f);
+		}
+	}
+
+	//standard error of the average luminance relative to the average, infinite until two samples allow an estimate
+	float relative_error_at(const uint32_t& pixel_index) const override
+	{
+		const uint32_t count = pixel_sample_counts[pixel_index];
+		if (count < 2)
+			return std::numeric_limits<float>::infinity();
+		const float inv_count = 1.0f / static_cast<float>(count);
+		const float mean = luminance(accumulation[pixel_index]) * inv_count;
+		const float variance = std::max(0.0f, luminance_moments[pixel_index] * inv_count - mean * mean) / static_cast<float>(count - 1);
+		return std::sqrt(variance) / (mean + dark_luminance);
+	}
+
+	//to call before a pass writes its samples, returns the number of passes started since the reset, the samples of a
+	//pixel may be fewer when adaptive sampling skipped it
+	uint32_t begin_sample_pass() override
+	{
+		return ++sample_count;
+	}
+
+	//copies a rectangle of the display buffer into a tightly packed destination
+	void copy_region(const uint32_t x, const uint32_t y, const uint32_t region_width, const uint32_t region_height,
+	                 uint8_t* destination) const
+	{
+		const uint32_t row_bytes = region_width * nb_channels;
+		for (uint32_t row = 0; row < region_height; ++row)
+		{
+			std::copy_n(pixels + ((y + row) * width + x) * nb_channels, row_bytes, destination + row * row_bytes);
+		}
+	}
+
+	void set_tone_mapping(const tone_mapping p_tone_mapping, const float p_exposure)
+	{
+		tone_mapping_operator = p_tone_mapping;
+		exposure = p_exposure;
+	}
+
+	//tonemaps the display buffer again from the running averages, after the operator or the exposure changed
+	void refresh_display() const
+	{
+		for (uint32_t pixel_index = 0; pixel_index < width * height; ++pixel_index)
+		{
+			const uint32_t count = pixel_sample_counts[pixel_index];
+			if (count > 0)
+				set_display_color_at_index(accumulation[pixel_index] / static_cast<float>(count), pixel_index);
+		}
 	}
 
 	uint32_t get_width() const override { return width; }
@@ -51,8 +171,22 @@ public:
 	uint32_t get_max_rays_per_pixel() const override { return max_rays_per_pixel; }
 	uint8_t* get_pixel_data() const override { return pixels; }
 	uint32_t get_nb_channels() const override { return nb_channels; }
+	const color3* get_accumulation_data() const override { return accumulation; }
+	const pixel_features* get_feature_data() const override { return features; }
+	uint32_t get_sample_count_at(const uint32_t& pixel_index) const override { return pixel_sample_counts[pixel_index]; }
+	uint32_t get_sample_count() const override { return sample_count; }
 
 private:
+	uint8_t to_display(float radiance) const
+	{
+		radiance *= exposure;
+		if (tone_mapping_operator == tone_mapping::reinhard)
+		{
+			radiance = radiance / (1.0f + radiance);
+		}
+		return static_cast<uint8_t>(clamp(std::pow(radiance, 1.0f / 2.2f), 0.0f, 1.0f) * 255.0f); //gamma corrected [0-1] to RGB
+	}
+
 	uint32_t current_pixel_index{0};
 	const int nb_channels;
 	const uint32_t width;
@@ -61,4 +195,14 @@ private:
 	const uint32_t pixel_count;
 	uint8_t* pixels;
 	const int max_rays_per_pixel;
+
+	color3* accumulation;
+	pixel_features* features;
+	uint32_t* pixel_sample_counts;
+	float* luminance_moments;
+	uint32_t sample_count{0};
+	//errors of pixels darker than this are measured against it, noise hidden in the dark does not need more samples
+	static constexpr float dark_luminance{0.01f};
+	tone_mapping tone_mapping_operator{tone_mapping::clamp};
+	float exposure{1.0f};
 };
@@ -1,15 +1,18 @@
 #pragma once
+#include <algorithm>
+#include <bit>
 #include <vector>
 
+#include "compiled_scene.h"
 #include "glm/gtc/constants.hpp"
 #include "objects/i_object.h"
+#include "objects/lights/alias_table.h"
+#include "objects/lights/area_light.h"
+#include "objects/lights/environment_light.h"
 #include "objects/lights/i_light.h"
+#include "../sampler.h"
+#include "../spectrum.h"
 
-#include <random>
-inline std::random_device rd;
-inline std::mt19937 rng(rd());
-inline std::uniform_real_distribution<float> dist(0.0f, 1.0f);
-constexpr float EPSILON = 0.001f;
 inline void make_orthonormal_basis(const vec3& normal, vec3& tangent_x, vec3& tangent_y)
 {
     if (std::abs(normal.x) > std::abs(normal.y))
@@ -24,6 +27,17 @@ inline void make_orthonormal_basis(const vec3& normal, vec3& tangent_x, vec3& ta
     tangent_y = cross(normal, tangent_x);
 }
 
+//State a path carries from one bounce to the next. It has a fixed size and lives on the stack of the thread tracing
+//the path, the spectral paths allocate nothing either.
+struct path_state
+{
+    vec3 incident_direction{0.0f, 0.0f, 0.0f};
+    surface_hit hit{};
+    color3 throughput{1.0f, 1.0f, 1.0f}; //albedos of the surfaces met, the same for every wavelength
+    hero_wavelengths wavelengths{};       //sampled at the first dispersive material met
+    color3 tint{1.0f, 1.0f, 1.0f};        //rgb weight of the wavelengths, white before they are sampled
+};
+
 class object_manager
 {
 public:
@@ -36,11 +50,22 @@ public:
             delete object;
             object = nullptr;
         }
+        for (auto& mesh: shared_meshes)
+        {
+            delete mesh;
+            mesh = nullptr;
+        }
         for (auto& light: lights)
         {
             delete light;
             light = nullptr;
         }
+        for (auto& light: area_lights)
+        {
+            delete light;
+            light = nullptr;
+        }
+        delete environment;
     }
 
     void add_object(i_object* object)
@@ -48,15 +73,74 @@ public:
         objects.push_back(object);
     }
 
+    //keeps a mesh that is only placed in the scene through mesh_instance objects, it is not traversed by itself
+    const triangle_mesh* add_shared_mesh(const triangle_mesh* mesh)
+    {
+        shared_meshes.push_back(mesh);
+        return mesh;
+    }
+
+    //deletes a shared mesh no instance places anymore
+    void remove_shared_mesh(const triangle_mesh* mesh)
+    {
+        if (const auto found = std::find(shared_meshes.begin(), shared_meshes.end(), mesh); found != shared_meshes.end())
+        {
+            delete *found;
+            shared_meshes.erase(found);
+        }
+    }
+
+    //deletes the objects and lights added so far, the shared meshes stay for new instances to place them. The
+    //acceleration structure is to build again before the next frame.
+    void clear_objects()
+    {
+        for (auto& object: objects)
+        {
+            delete object;
+        }
+        objects.clear();
+        for (auto& light: lights)
+        {
+            delete light;
+        }
+        lights.clear();
+    }
+
+    //compiles the objects into the flat scene the integrator runs on, to call once every object has been added
+    void build_acceleration_structure()
+    {
+        compiled.compile(objects);
+        build_light_table();
+    }
+
+    [[nodiscard]] const bvh& get_bvh() const
+    {
+        return compiled.get_bvh();
+    }
+
+    [[nodiscard]] const compiled_scene& get_compiled_scene() const
+    {
+        return compiled;
+    }
+
     void add_light(const i_light* light)
     {
         lights.push_back(light);
     }
 
-    static vec3 sample_hemisphere(const vec3& normal)
+    //radiance of the rays leaving the scene, the constant background color is used without one
+    void set_environment(const environment_light* p_environment)
     {
-        const float u1 = dist(rng);
-        const float u2 = dist(rng);
+        delete environment;
+        environment = p_environment;
+        build_light_table();
+    }
+
+    //cosine weighted direction around the normal from two uniform numbers
+    static vec3 sample_hemisphere(const vec3& normal, const glm::vec2& u)
+    {
+        const float u1 = u.x;
+        const float u2 = u.y;
 
         const float r = std::sqrt(u1);
         const float phi = 2 * glm::pi<float>() * u2;
@@ -74,124 +158,345 @@ public:
         return sample_vec;
     }
 
-    void local_illumination(const i_object* closest_hit_object, const point3& closest_hit_t,
-                            const vec3& closest_hit_normal, const glm::vec2& closest_hit_uv,
-                            color3& local_color, const i_light* light)
+    //power heuristic with an exponent of 2
+    static float mis_weight(const float pdf, const float other_pdf)
+    {
+        const float squared = pdf * pdf;
+        const float sum = squared + other_pdf * other_pdf;
+        return sum > 0.0f ? squared / sum : 0.0f;
+    }
+
+    //picks a light by power and a direction towards it from the hit, false when the sample cannot light the hit
+    bool sample_light(const surface_hit& hit, sampler& p_sampler, uint32_t& light, light_sample& sample) const
     {
-        vec3 direction_to_light{};
-        light->direction_to(closest_hit_t, direction_to_light);
-        ray shadow_ray{closest_hit_t + EPSILON, direction_to_light};
-        bool hit_something{false};
-        point3 t{0.0f, 0.0f, 0.0f};
-        vec3 normal{0.0f, 0.0f, 0.0f};
-        glm::vec2 uv;
-        for (const auto& object: objects)
+        const float u = p_sampler.next_1d();
+        const glm::vec2 u_light = p_sampler.next_2d();
+        if (light_distribution.empty())
         {
-            if (object->intersect(shadow_ray, t, normal, uv))
-            {
-                hit_something = true;
-                break;
-            }
+            return false;
         }
-        if (!hit_something)
+        light = light_distribution.sample(u);
+        sample = sampled_lights[light]->sample(hit.t, u_light);
+        return sample.pdf > 0.0f && luminance(sample.radiance) > 0.0f;
+    }
+
+    //contribution of an unoccluded light sample
+    color3 shade_light(const surface_hit& hit, const light_sample& sample, const uint32_t light) const
+    {
+        const float selection_pdf = light_distribution.pdf(light);
+        if (sampled_lights[light]->is_delta())
         {
             // Lambertian reflectance for the diffuse component
-            color3 diffuse = std::max(0.0f, glm::dot(closest_hit_normal, direction_to_light)) * closest_hit_object->color_at(closest_hit_t, closest_hit_uv);
+            color3 diffuse = std::max(0.0f, glm::dot(hit.normal, sample.direction)) * hit.albedo;
             // Blinn-Phong model for the specular component
-            vec3 view_dir = glm::normalize(vec3{0.0f, 2.5f, 0.0f} - closest_hit_t);
-            vec3 half_vec = (direction_to_light + view_dir ) / glm::length<3>(direction_to_light + view_dir);
+            vec3 view_dir = glm::normalize(vec3{0.0f, 2.5f, 0.0f} - hit.t);
+            vec3 half_vec = (sample.direction + view_dir ) / glm::length<3>(sample.direction + view_dir);
 
-            color3 specular = std::pow(std::max(0.0f, glm::dot(closest_hit_normal, half_vec)), closest_hit_object->get_shininess()) * closest_hit_object->color_at(closest_hit_t, closest_hit_uv);
-            local_color += light->emit(closest_hit_t, closest_hit_normal) * (diffuse + specular);
+            color3 specular = std::pow(std::max(0.0f, glm::dot(hit.normal, half_vec)), hit.shininess) * hit.albedo;
+            return sample.radiance * (diffuse + specular) / selection_pdf;
         }
-    }
-    void closest_intersection(const ray& incident_ray,
-                              i_object*& closest_hit_object, point3& closest_hit_t, vec3& closest_hit_normal,
-                              glm::vec2& closest_hit_uv) const
-    {
-        point3 t{};
-        vec3 normal{};
-        glm::vec2 uv{};
-        for (const auto& object: objects)
+
+        //lights with an extent are only sampled for the diffuse lobe, the specular one is left to the bsdf rays
+        const float cos_theta = glm::dot(hit.normal, sample.direction);
+        if (cos_theta <= 0.0f)
         {
-            if (object->intersect(incident_ray, t, normal, uv))
-            {
-                if (t.z > closest_hit_t.z)
-                {
-                    closest_hit_normal = normal;
-                    closest_hit_t = t;
-                    closest_hit_object = object;
-                    closest_hit_uv = uv;
-                }
-            }
+            return {0.0f, 0.0f, 0.0f};
         }
+        const float diffuse_pdf = (1.0f - hit.specular_weight) * cos_theta / glm::pi<float>();
+        const float light_pdf = selection_pdf * sample.pdf;
+        return sample.radiance * hit.albedo * (diffuse_pdf * mis_weight(light_pdf, diffuse_pdf) / light_pdf);
     }
 
-color3 compute_color(const ray& incident_ray, const uint32_t max_rays)
+color3 compute_color(const ray& incident_ray, const uint32_t max_rays, sampler& p_sampler) const
 {
     if (max_rays == 0)
     {
         return {0.0f, 0.0f, 0.0f};
     }
 
-    i_object* closest_hit_object = nullptr;
-    point3 closest_hit_t{std::numeric_limits<float>::lowest()};
-    vec3 closest_hit_normal{};
-    glm::vec2 closest_hit_uv{};
+    surface_hit hit;
+    if (!timed_intersect(incident_ray, hit, thread_counters.primary_rays))
+    {
+        return environment_radiance(incident_ray.get_direction());
+    }
 
-    closest_intersection(incident_ray, closest_hit_object, closest_hit_t, closest_hit_normal, closest_hit_uv);
+    color3 total_color = hit.emission;
+    for (uint32_t i = 0; i < samples_per_pixel; ++i)
+    {
+        p_sampler.start_sample(p_sampler.get_pass() * samples_per_pixel + i);
+        total_color += (direct_illumination(hit, p_sampler) + trace_path(incident_ray.get_direction(), hit, max_rays, p_sampler)) /
+                       static_cast<float>(samples_per_pixel);
+    }
+    return total_color;
+}
 
-    if (closest_hit_object == nullptr)
+//next event estimation, one light picked by power is sampled with a shadow ray stopping before it
+color3 direct_illumination(const surface_hit& hit, sampler& p_sampler) const
+{
+    uint32_t light;
+    light_sample sample;
+    if (!sample_light(hit, p_sampler, light, sample))
+    {
+        return {0.0f, 0.0f, 0.0f};
+    }
+    ++thread_counters.shadow_rays;
+    bool occluded;
+    {
+        const traversal_timer timer;
+        ray shadow_ray{offset_ray_origin(hit.t, hit.offset, sample.direction), sample.direction, sample.distance * shadow_distance_scale};
+        shadow_ray.set_time(hit.time);
+        occluded = compiled.occluded(shadow_ray);
+    }
+    if (occluded)
     {
-        return {0.015f, 0.03f, 0.0525f}; // Background color
+        return {0.0f, 0.0f, 0.0f};
     }
+    return shade_light(hit, sample, light);
+}
 
-    color3 total_color{0.0f, 0.0f, 0.0f};
+//Packet version of compute_color for coherent rays: the closest hits and the shadow rays of every sample are traced
+//as packets, the rays bouncing off the hits are traced one by one.
+//the features of the primary hits are written for the denoiser
+void compute_color(ray_packet& packet, const uint32_t active, const uint32_t max_rays, color3* colors, sampler* samplers,
+                   pixel_features* features) const
+{
+    for_each_lane(active, [&](const uint32_t lane) {
+        colors[lane] = {0.0f, 0.0f, 0.0f};
+        features[lane] = {};
+    });
+    if (max_rays == 0)
+    {
+        return;
+    }
 
-    // Local illumination (direct from lights)
-    for (const auto& light: lights)
+    packet_hits hits;
+    thread_counters.primary_rays += std::popcount(active);
     {
-        color3 local_color{0.0f, 0.0f, 0.0f};
-        local_illumination(closest_hit_object, closest_hit_t, closest_hit_normal, closest_hit_uv, local_color, light);
-        total_color += local_color;
+        const traversal_timer timer;
+        compiled.intersect(packet, active, hits);
     }
 
-        // Global illumination (indirect)
-        constexpr int num_samples = 16;
+    uint32_t hit_lanes{0};
+    surface_hit surfaces[ray_packet::size];
+    for_each_lane(active, [&](const uint32_t lane) {
+        if (hits.material[lane] == compiled_scene::no_material)
+        {
+            colors[lane] = environment_radiance(packet.get_direction(lane));
+            features[lane].albedo = colors[lane];
+            return;
+        }
+        hit_lanes |= 1u << lane;
+        surfaces[lane].t = hits.t[lane];
+        surfaces[lane].normal = hits.normal[lane];
+        surfaces[lane].uv = hits.uv[lane];
+        surfaces[lane].uv_scale = hits.uv_scale[lane];
+        surfaces[lane].offset = hits.offset[lane];
+        surfaces[lane].material = hits.material[lane];
+        surfaces[lane].time = packet.time[lane];
+        compiled_scene::set_footprint(packet.get_ray(lane), packet.t_max[lane], surfaces[lane]);
+        compiled.shade(surfaces[lane]);
+        colors[lane] = surfaces[lane].emission;
+        features[lane] = {surfaces[lane].albedo + surfaces[lane].emission, surfaces[lane].normal,
+                          glm::length(surfaces[lane].t - packet.get_origin(lane))};
+    });
 
-        // Dynamic specular weight based on material shininess
-        const float specular_weight = std::min(1.0f, std::max(0.1f, 1.0f - exp(-0.1f * closest_hit_object->get_shininess())));
+    const float sample_weight = 1.0f / static_cast<float>(samples_per_pixel);
+    for (uint32_t i = 0; i < samples_per_pixel; ++i)
+    {
+        ray_packet shadow_packet;
+        light_sample samples[ray_packet::size];
+        uint32_t sampled_light[ray_packet::size];
+        uint32_t shadow_lanes{0};
+        for_each_lane(hit_lanes, [&](const uint32_t lane) {
+            samplers[lane].start_sample(samplers[lane].get_pass() * samples_per_pixel + i);
+            if (sample_light(surfaces[lane], samplers[lane], sampled_light[lane], samples[lane]))
+            {
+                shadow_packet.set_lane(lane, ray{offset_ray_origin(surfaces[lane].t, surfaces[lane].offset, samples[lane].direction),
+                                                 samples[lane].direction});
+                shadow_packet.t_max[lane] = samples[lane].distance * shadow_distance_scale;
+                shadow_packet.time[lane] = surfaces[lane].time;
+                shadow_lanes |= 1u << lane;
+            }
+        });
+
+        thread_counters.shadow_rays += std::popcount(shadow_lanes);
+        uint32_t occluded_lanes;
+        {
+            const traversal_timer timer;
+            occluded_lanes = compiled.occluded(shadow_packet, shadow_lanes);
+        }
+        const uint32_t lit_lanes = shadow_lanes & ~occluded_lanes;
+        for_each_lane(lit_lanes, [&](const uint32_t lane) {
+            colors[lane] += shade_light(surfaces[lane], samples[lane], sampled_light[lane]) * sample_weight;
+        });
 
-        color3 global_illumination{0.0f, 0.0f, 0.0f};
+        for_each_lane(hit_lanes, [&](const uint32_t lane) {
+            colors[lane] += trace_path(packet.get_direction(lane), surfaces[lane], max_rays, samplers[lane]) * sample_weight;
+        });
+    }
+}
 
-        for (int i = 0; i < num_samples; ++i)
+//Iterative path tracer starting at a hit whose direct light is already accounted for: the throughput carries the
+//albedos of the surfaces met so far, every new hit adds its lights through next event estimation and paths are cut
+//by russian roulette once they have bounced a few times. Emitters and the environment reached by a diffuse bounce
+//are weighted against the light sampling that could have found them too.
+color3 trace_path(const vec3& incident_direction, const surface_hit& hit, const uint32_t max_rays, sampler& p_sampler) const
+{
+    color3 radiance{0.0f, 0.0f, 0.0f};
+    path_state path{incident_direction, hit};
+
+    ++thread_counters.paths;
+    const uint64_t secondary_before = thread_counters.secondary_rays;
+    for (uint32_t bounce = 1; bounce < max_rays; ++bounce)
+    {
+        path.throughput *= path.hit.albedo;
+        if (std::max(path.throughput.r, std::max(path.throughput.g, path.throughput.b)) <= 0.0f)
         {
-            vec3 sample_direction;
-            float specular_prob = dist(rng);
+            break;
+        }
 
-            if (specular_prob < specular_weight)
+        if (bounce >= russian_roulette_start_bounce)
+        {
+            const color3 weight = path.throughput * path.tint;
+            const float survival_probability = std::min(0.95f, std::max(weight.r, std::max(weight.g, weight.b)));
+            if (p_sampler.next_1d() >= survival_probability)
             {
-                // Specular component
-                closest_hit_object->alter_ray_direction(incident_ray, closest_hit_normal, sample_direction);
-                ray next_ray = {closest_hit_t + EPSILON, sample_direction};
-                global_illumination += compute_color(next_ray, max_rays - 1);
+                break;
             }
-            else
+            path.throughput /= survival_probability;
+        }
+
+        float bsdf_pdf;
+        const ray next_ray = scatter(path.incident_direction, path.hit, p_sampler, bsdf_pdf, path.wavelengths);
+        if (path.wavelengths.sampled)
+        {
+            path.tint = path.wavelengths.tint();
+        }
+        const point3 origin = next_ray.get_origin();
+        path.incident_direction = next_ray.get_direction();
+        if (!timed_intersect(next_ray, path.hit, thread_counters.secondary_rays))
+        {
+            float weight{1.0f};
+            if (environment != nullptr && bsdf_pdf > 0.0f)
             {
-                sample_direction  = sample_hemisphere(closest_hit_normal);
-                ray next_ray = {closest_hit_t + EPSILON, sample_direction};
-                global_illumination += compute_color(next_ray, max_rays - 1);
+                const float light_pdf = light_distribution.pdf(environment_light_index) * environment->pdf(origin, path.incident_direction, 0.0f, {});
+                weight = mis_weight(bsdf_pdf, light_pdf);
             }
+            radiance += path.throughput * path.tint * environment_radiance(path.incident_direction) * weight;
+            break;
         }
-        global_illumination /= static_cast<float>(num_samples);
 
-        global_illumination *= closest_hit_object->color_at(closest_hit_t, closest_hit_uv);
+        if (luminance(path.hit.emission) > 0.0f)
+        {
+            float weight{1.0f};
+            if (path.hit.light != compiled_scene::no_light && bsdf_pdf > 0.0f)
+            {
+                const float light_pdf = light_distribution.pdf(path.hit.light) *
+                                        sampled_lights[path.hit.light]->pdf(origin, path.incident_direction, glm::distance(origin, path.hit.t), path.hit.normal);
+                weight = mis_weight(bsdf_pdf, light_pdf);
+            }
+            radiance += path.throughput * path.tint * path.hit.emission * weight;
+        }
+        radiance += path.throughput * path.tint * direct_illumination(path.hit, p_sampler);
+    }
+    thread_counters.bounces += thread_counters.secondary_rays - secondary_before;
+    return radiance;
+}
 
-        total_color += global_illumination;
+//closest hit query, counted with the rays of its kind and timed with the traversal
+bool timed_intersect(const ray& p_ray, surface_hit& hit, uint64_t& ray_count) const
+{
+    ++ray_count;
+    const traversal_timer timer;
+    return compiled.intersect(p_ray, hit);
+}
+
+//picks the specular lobe of the material with a probability growing with its shininess, a cosine weighted diffuse
+//direction otherwise. pdf is the solid angle density of the diffuse direction, 0 for the specular lobe that light
+//sampling never reaches. The ray carries on the beam and the time of the one that reached the hit. A dispersive
+//material samples the wavelengths of the path the first time it is met and weighs them.
+ray scatter(const vec3& incident_direction, const surface_hit& hit, sampler& p_sampler, float& pdf, hero_wavelengths& wavelengths) const
+{
+    vec3 sample_direction;
+    if (p_sampler.next_1d() < hit.specular_weight)
+    {
+        compiled.alter_ray_direction(hit.material, ray{hit.t, incident_direction}, hit.normal, sample_direction, p_sampler, wavelengths);
+        pdf = 0.0f;
+    }
+    else
+    {
+        sample_direction = sample_hemisphere(hit.normal, p_sampler.next_2d());
+        pdf = (1.0f - hit.specular_weight) * std::max(0.0f, glm::dot(hit.normal, sample_direction)) / glm::pi<float>();
+    }
+    ray next_ray{offset_ray_origin(hit.t, hit.offset, sample_direction), sample_direction};
+    next_ray.set_cone(hit.cone);
+    next_ray.set_time(hit.time);
+    return next_ray;
+}
+
+color3 environment_radiance(const vec3& direction) const
+{
+    return environment != nullptr ? environment->radiance(direction) : background_color;
+}
 
-        return total_color;
+//paths sampled per pixel for the indirect light, progressive rendering uses 1 and averages over passes instead
+void set_samples_per_pixel(const uint32_t p_samples_per_pixel)
+{
+    samples_per_pixel = std::max(1u, p_samples_per_pixel);
 }
+
+uint32_t get_samples_per_pixel() const { return samples_per_pixel; }
+
 private:
+    static inline const color3 background_color{0.015f, 0.03f, 0.0525f};
+    static constexpr uint32_t default_samples_per_pixel{16};
+    static constexpr uint32_t russian_roulette_start_bounce{3};
+    //shadow rays towards a light sample stop just before it so they do not hit the emitter itself
+    static constexpr float shadow_distance_scale{0.999f};
+
+    //every light the integrator samples: the lights added, one area light per emissive material and the environment
+    void build_light_table()
+    {
+        for (const auto& light: area_lights)
+        {
+            delete light;
+        }
+        area_lights.clear();
+        sampled_lights.assign(lights.begin(), lights.end());
+
+        const std::vector<emitter>& emitters = compiled.get_emitters();
+        for (uint32_t i = 0; i < emitters.size(); ++i)
+        {
+            compiled.set_emitter_light(i, static_cast<uint32_t>(sampled_lights.size()));
+            area_lights.push_back(new area_light{emitters[i].meshes, emitters[i].radiance});
+            sampled_lights.push_back(area_lights.back());
+        }
+        if (environment != nullptr)
+        {
+            environment_light_index = static_cast<uint32_t>(sampled_lights.size());
+            sampled_lights.push_back(environment);
+        }
+
+        const aabb scene_bounds = compiled.get_bvh().bounds();
+        const float scene_radius = scene_bounds.empty() ? 1.0f : 0.5f * glm::length(scene_bounds.max - scene_bounds.min);
+        std::vector<float> powers;
+        powers.reserve(sampled_lights.size());
+        for (const auto& light: sampled_lights)
+        {
+            powers.push_back(light->power(scene_radius));
+        }
+        light_distribution.build(powers);
+    }
+
+    uint32_t samples_per_pixel{default_samples_per_pixel};
+
     std::vector<i_object*> objects{};
+    std::vector<const triangle_mesh*> shared_meshes{};
     std::vector<const i_light*> lights{};
+    std::vector<const area_light*> area_lights{};
+    const environment_light* environment{nullptr};
+    std::vector<const i_light*> sampled_lights{};
+    alias_table light_distribution;
+    uint32_t environment_light_index{0};
+    compiled_scene compiled;
 };
@@ -10,12 +10,14 @@ public:
     {
     }
 
-    bool intersect(const ray& p_ray, point3& t, vec3& normal, glm::vec2& uv) const override
+    bool intersect(ray& p_ray, point3& t, vec3& normal, glm::vec2& uv, float& uv_scale, surface_offset& offset) const override
     {
-        vec3 inv_dir = 1.0f / p_ray.get_direction();
+        const point3 origin = p_ray.get_origin();
+        const vec3 direction = p_ray.get_direction();
+        vec3 inv_dir = 1.0f / direction;
 
-        vec3 t_min = (min - p_ray.get_origin()) * inv_dir;
-        vec3 t_max = (max - p_ray.get_origin()) * inv_dir;
+        vec3 t_min = (min - origin) * inv_dir;
+        vec3 t_max = (max - origin) * inv_dir;
 
         vec3 min_values = glm::min(t_min, t_max);
         vec3 max_values = glm::max(t_min, t_max);
@@ -23,23 +25,42 @@ public:
         float t_near = glm::max(glm::max(min_values.x, min_values.y), min_values.z);
         float t_far = glm::min(glm::min(max_values.x, max_values.y), max_values.z);
 
-        if (t_far < 0.0f || t_near > t_far) {
+        if (!(t_far > p_ray.get_t_min()) || t_near > t_far) {
             return false;
         }
 
-        t = p_ray.get_origin() + t_near * p_ray.get_direction();
-        normal = glm::vec3(t.x > min.x, t.y > min.y, t.z > min.z) - glm::vec3(t.x < max.x, t.y < max.y, t.z < max.z);
+        //a ray starting inside, or on the face it leaves by, hits the face it leaves the box through
+        const bool leaving = !(t_near > p_ray.get_t_min());
+        const float distance = leaving ? t_far : t_near;
+        if (!p_ray.contains(distance)) {
+            return false;
+        }
+        p_ray.set_t_max(distance);
+        //the face hit is the one of the slab giving the distance, comparing the hit point to the bounds can cancel to a null normal
+        const vec3& slab_values = leaving ? max_values : min_values;
+        const int axis = distance == slab_values.x ? 0 : (distance == slab_values.y ? 1 : 2);
+        const bool positive_face = (direction[axis] > 0.0f) == leaving;
+        normal = vec3{0.0f, 0.0f, 0.0f};
+        normal[axis] = positive_face ? 1.0f : -1.0f;
+
+        //the coordinate across the face is put exactly on it, the others carry the error of the distance
+        t = origin + distance * direction;
+        t[axis] = positive_face ? max[axis] : min[axis];
+        offset.geometric_normal = normal;
+        offset.error = rounding_error_bound(7) * (glm::abs(origin) + glm::abs(distance * direction));
+        offset.error[axis] = 0.0f;
 
         vec3 size = max - min;
         uv.x = (t.x - min.x) / size.x;
         uv.y = (t.y - min.y) / size.y;
+        uv_scale = 0.0f;
 
         return true;
     }
 
-    bool alter_ray_direction(const ray& incident_ray, const vec3& normal, vec3& next_direction) const override
+    bool alter_ray_direction(const ray& incident_ray, const vec3& normal, vec3& next_direction, sampler& p_sampler) const override
     {
-        return material->alter_ray_direction(incident_ray, normal, next_direction);
+        return material->alter_ray_direction(incident_ray, normal, next_direction, p_sampler);
     }
 
     color3 color_at(const point3& t, const glm::vec2& uv) const override
@@ -52,6 +73,13 @@ public:
         return material->get_shininess();
     }
 
+    aabb bounds() const override
+    {
+        return {min, max};
+    }
+
+    [[nodiscard]] const i_material* get_material() const { return material; }
+
 private:
     const point3 min{};
     const point3 max{};
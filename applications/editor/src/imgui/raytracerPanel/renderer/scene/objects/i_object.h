@@ -3,12 +3,56 @@
 #include "glm/gtx/norm.hpp"
 #include "glm/gtx/intersect.hpp"
 #include "materials/i_material.h"
+#include "../acceleration/aabb.h"
+#include "../../ray_packet.h"
+
+//per lane results of a packet query
+struct packet_hits
+{
+    uint32_t material[ray_packet::size]{};
+    point3 t[ray_packet::size];
+    vec3 normal[ray_packet::size];
+    glm::vec2 uv[ray_packet::size];
+    float uv_scale[ray_packet::size];
+    surface_offset offset[ray_packet::size];
+};
+
 class i_object
 {
 public:
 	virtual ~i_object() = default;
-	virtual bool intersect(const ray& ray, point3& t, vec3& normal, glm::vec2& uv) const = 0;
-	virtual bool alter_ray_direction(const ray& incident_ray, const vec3& normal, vec3& next_direction) const = 0;
+	//Keeps only a hit inside the interval of the ray, which then ends at the hit. The offset gives the rays leaving
+	//the hit where to start, see offset_ray_origin. uv_scale is the length in uv units of a unit length on the surface
+	//around the hit, which sizes the texture lookups, 0 when the surface has no texture coordinates.
+	virtual bool intersect(ray& ray, point3& t, vec3& normal, glm::vec2& uv, float& uv_scale, surface_offset& offset) const = 0;
+	virtual bool alter_ray_direction(const ray& incident_ray, const vec3& normal, vec3& next_direction, sampler& p_sampler) const = 0;
 	virtual color3 color_at(const point3& t, const glm::vec2& uv) const = 0;
     virtual float get_shininess() const = 0;
+    virtual aabb bounds() const = 0;
+
+    //Intersects the lanes of the packet, keeping only hits closer than the lane's t_max which is then updated.
+    //Returns the mask of the lanes that hit. Objects without a packet path test the lanes one by one.
+    virtual uint32_t intersect_packet(ray_packet& packet, const uint32_t lanes, packet_hits& hits) const
+    {
+        uint32_t hit_lanes{0};
+        for_each_lane(lanes, [&](const uint32_t lane) {
+            ray lane_ray = packet.get_ray(lane);
+            point3 t{};
+            vec3 normal{};
+            glm::vec2 uv{};
+            float uv_scale{0.0f};
+            surface_offset offset;
+            if (intersect(lane_ray, t, normal, uv, uv_scale, offset))
+            {
+                packet.t_max[lane] = lane_ray.get_t_max();
+                hits.t[lane] = t;
+                hits.normal[lane] = normal;
+                hits.uv[lane] = uv;
+                hits.uv_scale[lane] = uv_scale;
+                hits.offset[lane] = offset;
+                hit_lanes |= 1u << lane;
+            }
+        });
+        return hit_lanes;
+    }
 };
@@ -0,0 +1,99 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+//Walker's alias method (Vose's construction): an index is picked with a probability proportional to its weight in
+//constant time, from a single uniform number.
+class alias_table
+{
+public:
+    alias_table() = default;
+
+    explicit alias_table(const std::vector<float>& weights)
+    {
+        build(weights);
+    }
+
+    void build(const std::vector<float>& weights)
+    {
+        const auto count = static_cast<uint32_t>(weights.size());
+        probability.assign(count, 1.0f);
+        alias.resize(count);
+        pdfs.assign(count, 0.0f);
+        total = 0.0f;
+        for (const float weight: weights)
+        {
+            total += weight;
+        }
+        if (count == 0)
+        {
+            return;
+        }
+
+        std::vector<float> scaled(count);
+        std::vector<uint32_t> small;
+        std::vector<uint32_t> large;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            alias[i] = i;
+            //all weights null, falls back to a uniform choice
+            pdfs[i] = total > 0.0f ? weights[i] / total : 1.0f / static_cast<float>(count);
+            scaled[i] = pdfs[i] * static_cast<float>(count);
+            (scaled[i] < 1.0f ? small : large).push_back(i);
+        }
+        while (!small.empty() && !large.empty())
+        {
+            const uint32_t lighter = small.back();
+            small.pop_back();
+            const uint32_t heavier = large.back();
+            large.pop_back();
+
+            probability[lighter] = scaled[lighter];
+            alias[lighter] = heavier;
+            scaled[heavier] = scaled[heavier] + scaled[lighter] - 1.0f;
+            (scaled[heavier] < 1.0f ? small : large).push_back(heavier);
+        }
+        //what is left only differs from 1 by rounding
+        for (const uint32_t i: small)
+            probability[i] = 1.0f;
+        for (const uint32_t i: large)
+            probability[i] = 1.0f;
+    }
+
+    //index for a uniform number in [0, 1), remapped receives a new uniform number made of what the choice left unused
+    uint32_t sample(const float u, float& remapped) const
+    {
+        const float scaled = u * static_cast<float>(probability.size());
+        const uint32_t cell = std::min(static_cast<uint32_t>(scaled), static_cast<uint32_t>(probability.size() - 1));
+        const float fraction = std::min(scaled - static_cast<float>(cell), one_minus_epsilon);
+        if (fraction < probability[cell])
+        {
+            remapped = std::min(fraction / probability[cell], one_minus_epsilon);
+            return cell;
+        }
+        remapped = std::min((fraction - probability[cell]) / (1.0f - probability[cell]), one_minus_epsilon);
+        return alias[cell];
+    }
+
+    uint32_t sample(const float u) const
+    {
+        float remapped;
+        return sample(u, remapped);
+    }
+
+    //probability of picking index
+    [[nodiscard]] float pdf(const uint32_t index) const { return pdfs[index]; }
+    //sum of the weights the table was built from
+    [[nodiscard]] float get_total() const { return total; }
+    [[nodiscard]] uint32_t size() const { return static_cast<uint32_t>(probability.size()); }
+    [[nodiscard]] bool empty() const { return probability.empty(); }
+
+private:
+    static constexpr float one_minus_epsilon{0x1.fffffep-1f};
+
+    std::vector<float> probability;
+    std::vector<uint32_t> alias;
+    std::vector<float> pdfs;
+    float total{0.0f};
+};
@@ -0,0 +1,93 @@
+#pragma once
+#include <cmath>
+#include <vector>
+
+#include "alias_table.h"
+#include "i_light.h"
+#include "../triangle_mesh.h"
+
+//Light emitted by the triangles of the meshes sharing an emissive material. A triangle is picked by area, then a point
+//uniformly on it. Both sides of the triangles emit.
+class area_light final : public i_light
+{
+public:
+    area_light(const std::vector<const triangle_mesh*>& meshes, const color3& p_radiance) : radiance(p_radiance)
+    {
+        std::vector<float> areas;
+        for (const triangle_mesh* mesh: meshes)
+        {
+            const triangle_arrays arrays = mesh->arrays();
+            for (uint32_t i = 0; i < mesh->get_triangle_count(); ++i)
+            {
+                triangle corners;
+                for (uint32_t axis = 0; axis < 3; ++axis)
+                {
+                    corners.v0[axis] = arrays.v0[axis][i];
+                    corners.edge1[axis] = arrays.v1[axis][i] - arrays.v0[axis][i];
+                    corners.edge2[axis] = arrays.v2[axis][i] - arrays.v0[axis][i];
+                }
+                const vec3 cross = glm::cross(corners.edge1, corners.edge2);
+                const float area = 0.5f * glm::length(cross);
+                corners.normal = area > 0.0f ? cross / (2.0f * area) : vec3{0.0f, 1.0f, 0.0f};
+                triangles.push_back(corners);
+                areas.push_back(area);
+                total_area += area;
+            }
+        }
+        triangle_distribution.build(areas);
+    }
+
+    light_sample sample(const point3& position, const glm::vec2& u) const override
+    {
+        light_sample result;
+        if (triangles.empty() || total_area <= 0.0f)
+            return result;
+
+        float remapped;
+        const triangle& picked = triangles[triangle_distribution.sample(u.x, remapped)];
+        //uniform point on the triangle
+        const float root = std::sqrt(remapped);
+        const point3 point = picked.v0 + root * (1.0f - u.y) * picked.edge1 + root * u.y * picked.edge2;
+
+        const vec3 to_light = point - position;
+        const float distance_squared = glm::dot(to_light, to_light);
+        if (distance_squared <= 0.0f)
+            return result;
+
+        result.distance = std::sqrt(distance_squared);
+        result.direction = to_light / result.distance;
+        result.pdf = pdf(position, result.direction, result.distance, picked.normal);
+        result.radiance = result.pdf > 0.0f ? radiance : color3{0.0f, 0.0f, 0.0f};
+        return result;
+    }
+
+    [[nodiscard]] float pdf(const point3&, const vec3& direction, const float distance, const vec3& light_normal) const override
+    {
+        const float cos_light = std::abs(glm::dot(light_normal, direction));
+        if (cos_light <= 0.0f || total_area <= 0.0f)
+            return 0.0f;
+        //area density converted to solid angle
+        return distance * distance / (cos_light * total_area);
+    }
+
+    [[nodiscard]] float power(float) const override
+    {
+        return 2.0f * glm::pi<float>() * total_area * luminance(radiance);
+    }
+
+    [[nodiscard]] float get_area() const { return total_area; }
+
+private:
+    struct triangle
+    {
+        point3 v0;
+        vec3 edge1;
+        vec3 edge2;
+        vec3 normal;
+    };
+
+    const color3 radiance;
+    std::vector<triangle> triangles;
+    alias_table triangle_distribution;
+    float total_area{0.0f};
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include "glm/gtc/constants.hpp"
+#include "i_light.h"
+
+//light arriving from infinitely far along one direction, like the sun
+class directional_light final :
+	public i_light
+{
+public:
+	//p_direction is the one the light travels along
+	directional_light(const vec3& p_direction, const color3& p_color, const float p_intensity) :
+		to_light(-normalize(p_direction)), color(p_color), intensity(p_intensity)
+	{
+	}
+
+	light_sample sample(const point3&, const glm::vec2&) const override
+	{
+		light_sample result;
+		result.direction = to_light;
+		result.distance = infinite_distance;
+		result.radiance = color * intensity;
+		result.pdf = 1.0f;
+		return result;
+	}
+
+	[[nodiscard]] float pdf(const point3&, const vec3&, float, const vec3&) const override
+	{
+		return 0.0f;
+	}
+
+	//falls on the disk of the scene
+	[[nodiscard]] float power(const float scene_radius) const override
+	{
+		return glm::pi<float>() * scene_radius * scene_radius * intensity * luminance(color);
+	}
+
+	[[nodiscard]] bool is_delta() const override
+	{
+		return true;
+	}
+
+private:
+	static constexpr float infinite_distance{1.0e30f};
+
+	const vec3 to_light;
+	const color3 color;
+	const float intensity;
+};
@@ -0,0 +1,88 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "alias_table.h"
+#include "glm/gtc/constants.hpp"
+#include "i_light.h"
+
+//Light coming from every direction, read from a latitude-longitude HDR image: the top row looks along +y and the
+//centre column along -z. Texels are picked by their luminance weighted by the solid angle they cover.
+class environment_light final : public i_light
+{
+public:
+    environment_light(std::vector<color3> p_texels, const uint32_t p_width, const uint32_t p_height, const float p_intensity = 1.0f)
+        : texels(std::move(p_texels)), width(p_width), height(p_height), intensity(p_intensity)
+    {
+        std::vector<float> weights(texels.size());
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            const float sin_theta = std::sin(glm::pi<float>() * (static_cast<float>(y) + 0.5f) / static_cast<float>(height));
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                weights[y * width + x] = luminance(texels[y * width + x]) * sin_theta;
+            }
+        }
+        texel_distribution.build(weights);
+    }
+
+    [[nodiscard]] color3 radiance(const vec3& direction) const
+    {
+        return texels[texel_index(direction)] * intensity;
+    }
+
+    light_sample sample(const point3&, const glm::vec2& u) const override
+    {
+        float remapped;
+        const uint32_t index = texel_distribution.sample(u.x, remapped);
+        const float phi = ((static_cast<float>(index % width) + remapped) / static_cast<float>(width) - 0.5f) * 2.0f * glm::pi<float>();
+        const float theta = (static_cast<float>(index / width) + u.y) / static_cast<float>(height) * glm::pi<float>();
+        const float sin_theta = std::sin(theta);
+
+        light_sample result;
+        result.direction = {sin_theta * std::sin(phi), std::cos(theta), -sin_theta * std::cos(phi)};
+        result.distance = std::numeric_limits<float>::max();
+        result.pdf = texel_pdf(index, sin_theta);
+        result.radiance = result.pdf > 0.0f ? texels[index] * intensity : color3{0.0f, 0.0f, 0.0f};
+        return result;
+    }
+
+    [[nodiscard]] float pdf(const point3&, const vec3& direction, float, const vec3&) const override
+    {
+        const float sin_theta = std::sqrt(std::max(0.0f, 1.0f - direction.y * direction.y));
+        return texel_pdf(texel_index(direction), sin_theta);
+    }
+
+    [[nodiscard]] float power(const float scene_radius) const override
+    {
+        //radiance integrated over the sphere of directions, falling on the disk of the scene
+        const float solid_angle_per_texel = 2.0f * glm::pi<float>() * glm::pi<float>() / static_cast<float>(width * height);
+        return glm::pi<float>() * scene_radius * scene_radius * texel_distribution.get_total() * solid_angle_per_texel * intensity;
+    }
+
+private:
+    [[nodiscard]] uint32_t texel_index(const vec3& direction) const
+    {
+        const float u = 0.5f + std::atan2(direction.x, -direction.z) / (2.0f * glm::pi<float>());
+        const float v = std::acos(std::clamp(direction.y, -1.0f, 1.0f)) / glm::pi<float>();
+        const uint32_t x = std::min(static_cast<uint32_t>(std::max(0.0f, u) * static_cast<float>(width)), width - 1);
+        const uint32_t y = std::min(static_cast<uint32_t>(std::max(0.0f, v) * static_cast<float>(height)), height - 1);
+        return y * width + x;
+    }
+
+    //density of the texel converted from image area to solid angle
+    [[nodiscard]] float texel_pdf(const uint32_t index, const float sin_theta) const
+    {
+        if (sin_theta <= 0.0f)
+            return 0.0f;
+        return texel_distribution.pdf(index) * static_cast<float>(width * height) / (2.0f * glm::pi<float>() * glm::pi<float>() * sin_theta);
+    }
+
+    const std::vector<color3> texels;
+    const uint32_t width;
+    const uint32_t height;
+    const float intensity;
+    alias_table texel_distribution;
+};
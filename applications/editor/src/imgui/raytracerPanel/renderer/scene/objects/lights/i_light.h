@@ -1,9 +1,26 @@
 #pragma once
+#include "glm/vec2.hpp"
+#include "../../../utils.h"
+
+//a direction towards a light as seen from a shaded point
+struct light_sample
+{
+	vec3 direction{};  //unit vector towards the light
+	float distance{0}; //to the sampled point, shadow rays stop before it
+	color3 radiance{}; //arriving along direction
+	float pdf{0};      //solid angle density of direction, 1 for delta lights
+};
 
 class i_light
 {
 public:
 	virtual ~i_light() = default;
-	virtual color3 emit(const point3& to, const vec3& surface_normal) const = 0;
-	virtual void direction_to(const point3& start_position, vec3& direction) const = 0;
+	//picks a point of the light seen from position with two uniform numbers
+	virtual light_sample sample(const point3& position, const glm::vec2& u) const = 0;
+	//solid angle density sample() gives to direction, when it reaches the light at distance on a surface oriented by light_normal
+	[[nodiscard]] virtual float pdf(const point3& position, const vec3& direction, float distance, const vec3& light_normal) const = 0;
+	//emitted power the lights are picked by, the scene radius scales the lights at infinity
+	[[nodiscard]] virtual float power(float scene_radius) const = 0;
+	//delta lights can only be reached by sampling them, never by a ray leaving a surface
+	[[nodiscard]] virtual bool is_delta() const { return false; }
 };
@@ -1,4 +1,5 @@
 #pragma once
+#include "glm/gtc/constants.hpp"
 #include "i_light.h"
 
 class point_light final :
@@ -10,18 +11,43 @@ public:
 	{
 	}
 
-	[[nodiscard]] color3 emit(const point3& to, const vec3& surface_normal) const override
+	[[nodiscard]] color3 emit(const point3& to, const vec3& surface_normal) const
 	{
 		const float distance = glm::distance(position, to);
 
 		return color * (1.0f / (1.0f + 0.5f * distance + 0.01f * distance * distance)) * intensity;
 	}
 
-	void direction_to(const point3& start_position, vec3& direction) const override
+	void direction_to(const point3& start_position, vec3& direction) const
 	{
 		direction = normalize(position - start_position);
 	}
 
+	light_sample sample(const point3& p_position, const glm::vec2&) const override
+	{
+		light_sample result;
+		direction_to(p_position, result.direction);
+		result.distance = glm::distance(position, p_position);
+		result.radiance = emit(p_position, result.direction);
+		result.pdf = 1.0f;
+		return result;
+	}
+
+	[[nodiscard]] float pdf(const point3&, const vec3&, float, const vec3&) const override
+	{
+		return 0.0f;
+	}
+
+	[[nodiscard]] float power(float) const override
+	{
+		return 4.0f * glm::pi<float>() * intensity * luminance(color);
+	}
+
+	[[nodiscard]] bool is_delta() const override
+	{
+		return true;
+	}
+
 private:
 	const point3 position;
 	const color3 color;
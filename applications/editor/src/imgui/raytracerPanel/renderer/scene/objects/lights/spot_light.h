@@ -0,0 +1,61 @@
+#pragma once
+#include <algorithm>
+
+#include "glm/gtc/constants.hpp"
+#include "i_light.h"
+
+//point light restricted to a cone, full inside the inner angle and fading out to the outer one
+class spot_light final :
+	public i_light
+{
+public:
+	spot_light(const point3& p_position, const vec3& p_direction, const color3& p_color, const float p_intensity,
+	           const float p_inner_degrees, const float p_outer_degrees) :
+		position(p_position), direction(normalize(p_direction)), color(p_color), intensity(p_intensity),
+		cos_inner(glm::cos(glm::radians(p_inner_degrees))), cos_outer(glm::cos(glm::radians(std::max(p_inner_degrees, p_outer_degrees))))
+	{
+	}
+
+	light_sample sample(const point3& p_position, const glm::vec2&) const override
+	{
+		light_sample result;
+		result.direction = normalize(position - p_position);
+		result.distance = glm::distance(position, p_position);
+		result.radiance = color * (intensity * cone_falloff(-result.direction) /
+		                           (1.0f + 0.5f * result.distance + 0.01f * result.distance * result.distance));
+		result.pdf = 1.0f;
+		return result;
+	}
+
+	[[nodiscard]] float pdf(const point3&, const vec3&, float, const vec3&) const override
+	{
+		return 0.0f;
+	}
+
+	//solid angle of the outer cone
+	[[nodiscard]] float power(float) const override
+	{
+		return 2.0f * glm::pi<float>() * (1.0f - cos_outer) * intensity * luminance(color);
+	}
+
+	[[nodiscard]] bool is_delta() const override
+	{
+		return true;
+	}
+
+private:
+	[[nodiscard]] float cone_falloff(const vec3& from_light) const
+	{
+		const float cos_angle = glm::dot(direction, from_light);
+		if (cos_inner <= cos_outer)
+			return cos_angle >= cos_outer ? 1.0f : 0.0f;
+		return glm::clamp((cos_angle - cos_outer) / (cos_inner - cos_outer), 0.0f, 1.0f);
+	}
+
+	const point3 position;
+	const vec3 direction;
+	const color3 color;
+	const float intensity;
+	const float cos_inner;
+	const float cos_outer;
+};
@@ -0,0 +1,32 @@
+#pragma once
+#include "i_material.h"
+
+//Surface emitting light and reflecting none. Meshes using it become area lights of the scene.
+class emissive final : public i_material
+{
+public:
+    explicit emissive(const color3& p_radiance) : radiance(p_radiance)
+    {
+    }
+
+    bool alter_ray_direction(const ray&, const vec3& normal, vec3& next_direction, sampler&) const override
+    {
+        next_direction = normal;
+        return false;
+    }
+
+    [[nodiscard]] color3 color_at(const point3&, const glm::vec2&) const override
+    {
+        return {0.0f, 0.0f, 0.0f};
+    }
+
+    [[nodiscard]] float get_shininess() const override
+    {
+        return 0.0f;
+    }
+
+    [[nodiscard]] const color3& get_radiance() const { return radiance; }
+
+private:
+    const color3 radiance;
+};
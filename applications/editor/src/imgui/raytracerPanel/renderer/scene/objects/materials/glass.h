@@ -2,7 +2,11 @@
 
 #include "i_material.h"
 #include "textures/i_texture.h"
+#include "../../../spectrum.h"
 
+//Dielectric refracting or reflecting the rays. With an Abbe number the refractive index is the one of the Fraunhofer
+//d line and varies with the wavelength by the Cauchy equation n = A + B / wavelength^2, fitted to the F and C lines:
+//a lower Abbe number disperses more, 0 keeps the same index for every wavelength.
 class glass final : public i_material
 {
 public:
@@ -11,12 +15,16 @@ public:
           const float
                   p_refractive_index,
           const float
-                  shininess) : albedo(p_texture),
-                               refractive_index(p_refractive_index), shininess(shininess)
+                  shininess,
+          const float
+                  abbe_number = 0.0f) : albedo(p_texture),
+                               refractive_index(p_refractive_index), shininess(shininess),
+                               cauchy_b(abbe_number > 0.0f ? (p_refractive_index - 1.0f) / (abbe_number * (1.0f / (f_line * f_line) - 1.0f / (c_line * c_line))) : 0.0f),
+                               cauchy_a(p_refractive_index - cauchy_b / (d_line * d_line))
     {
     }
 
-    bool alter_ray_direction(const ray& incident_ray, const vec3& normal, vec3& next_direction) const override
+    bool alter_ray_direction(const ray& incident_ray, const vec3& normal, vec3& next_direction, sampler& p_sampler) const override
     {
         vec3 glass_normal = normal;
         float cos_theta = dot(glass_normal, incident_ray.get_direction());
@@ -53,11 +61,14 @@ public:
         }
         const float x = 1.0f - cosX;
         const float R = R0 + (1.0f - R0) * x * x * x * x * x;// Schlick approximation
-        if (refracts && ((rand() / (RAND_MAX + 1.0)) >= R))
+        bool refracted{false};
+        if (refracts && p_sampler.next_1d() >= R)
         {
             next_direction = refract(glass_direction, glass_normal, eta);
+            //refract returns a null vector past the critical angle, which the check above does not always catch
+            refracted = next_direction != vec3{0.0f, 0.0f, 0.0f};
         }
-        else
+        if (!refracted)
         {
             next_direction = reflect(glass_direction, glass_normal);
         }
@@ -65,6 +76,62 @@ public:
         return true;
     }
 
+    //Dispersive interface for the wavelengths of a path, sampled on the first one met. The hero wavelength picks
+    //between reflection and refraction with its own Fresnel reflectance and the others are weighted by the ratio of
+    //theirs, so a reflection, the same for every wavelength, keeps them all. A refraction bends each one its own way,
+    //the hero takes it alone.
+    void alter_ray_direction(const ray& incident_ray, const vec3& normal, vec3& next_direction, hero_wavelengths& wavelengths,
+                             sampler& p_sampler) const
+    {
+        if (!wavelengths.sampled)
+            wavelengths.sample(p_sampler.next_1d());
+
+        const vec3 direction = normalize(incident_ray.get_direction());
+        vec3 facing_normal = normal;
+        float cos_incident = -dot(normal, direction);
+        const bool entering = cos_incident > 0.0f;
+        if (!entering)
+        {
+            facing_normal = -normal;
+            cos_incident = -cos_incident;
+        }
+
+        //eta is the ratio of the index on the incident side to the one on the transmitted side, the exact Fresnel
+        //reflectance of unpolarized light is 1 past the critical angle
+        constexpr uint32_t count{hero_wavelengths::count};
+        alignas(16) float eta[count];
+        alignas(16) float reflectance[count];
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const float micrometers = wavelengths.wavelength[i] * 1.0e-3f;
+            const float index = cauchy_a + cauchy_b / (micrometers * micrometers);
+            eta[i] = entering ? 1.0f / index : index;
+            const float sin2_transmitted = eta[i] * eta[i] * (1.0f - cos_incident * cos_incident);
+            const float cos_transmitted = std::sqrt(std::max(0.0f, 1.0f - sin2_transmitted));
+            const float parallel = (cos_incident - eta[i] * cos_transmitted) / (cos_incident + eta[i] * cos_transmitted);
+            const float perpendicular = (eta[i] * cos_incident - cos_transmitted) / (eta[i] * cos_incident + cos_transmitted);
+            reflectance[i] = sin2_transmitted >= 1.0f ? 1.0f : 0.5f * (parallel * parallel + perpendicular * perpendicular);
+        }
+
+        if (p_sampler.next_1d() < reflectance[0])
+        {
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                wavelengths.weight[i] *= reflectance[i] / reflectance[0];
+            }
+            next_direction = reflect(direction, facing_normal);
+            return;
+        }
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            wavelengths.weight[i] *= (1.0f - reflectance[i]) / (1.0f - reflectance[0]);
+        }
+        wavelengths.terminate_secondary();
+        next_direction = normalize(refract(direction, facing_normal, eta[0]));
+    }
+
+    [[nodiscard]] bool is_dispersive() const { return cauchy_b > 0.0f; }
+
     [[nodiscard]] color3 color_at(const point3& t, const glm::vec2& uv) const override
     {
         return albedo->color_at(t, uv);
@@ -74,8 +141,17 @@ public:
         return shininess;
     }
 
+    [[nodiscard]] const i_texture* get_texture() const { return albedo; }
+
 private:
     const i_texture* albedo;
+    //Fraunhofer lines the index and the Abbe number are given at, in micrometers
+    static constexpr float c_line{0.6563f};
+    static constexpr float d_line{0.5876f};
+    static constexpr float f_line{0.4861f};
+
     const float refractive_index;
     const float shininess;
+    const float cauchy_b;
+    const float cauchy_a;
 };
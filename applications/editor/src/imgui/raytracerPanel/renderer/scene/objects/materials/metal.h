@@ -1,6 +1,6 @@
 #pragma once
-#include "glm/gtc/random.hpp"
 #include "i_material.h"
+#include "textures/i_texture.h"
 
 class metal final : public i_material
 {
@@ -14,11 +14,11 @@ public:
     {
     }
 
-    bool alter_ray_direction(const ray& incident_ray, const vec3& normal, vec3& next_direction) const override
+    bool alter_ray_direction(const ray& incident_ray, const vec3& normal, vec3& next_direction, sampler& p_sampler) const override
     {
         const vec3 reflection = reflect(incident_ray.get_direction(), normal);
 
-        next_direction = reflection + diffusion * glm::sphericalRand(0.05f);
+        next_direction = reflection + diffusion * 0.05f * uniform_sphere_sample(p_sampler.next_2d());
 
         next_direction = normalize(next_direction);
         if (glm::abs(next_direction.x) < 0.00001f && glm::abs(next_direction.y) < 0.00001f && glm::abs(next_direction.z) < 0.00001f)
@@ -38,6 +38,8 @@ public:
         return shininess;
     }
 
+    [[nodiscard]] const i_texture* get_texture() const { return albedo; }
+
 private:
     const float shininess;
     const i_texture* albedo;
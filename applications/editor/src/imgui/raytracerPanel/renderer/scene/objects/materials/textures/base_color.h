@@ -14,6 +14,8 @@ public:
 		return *color;
 	}
 
+	[[nodiscard]] const color3& get_color() const { return *color; }
+
 private:
 	const color3* color;
 };
@@ -22,12 +22,20 @@ public:
 
 	color3 color_at(const point3& p, const glm::vec2& uv) const override
 	{
-		const float sines = glm::sin(10.0f * p.x) * glm::sin(10.0f * p.y) * glm::sin(10.0f * p.z);
-		if (sines < 0)
+		if (is_odd(p))
 			return odd->color_at(p, uv);
 		return even->color_at(p, uv);
 	}
 
+	static bool is_odd(const point3& p)
+	{
+		const float sines = glm::sin(10.0f * p.x) * glm::sin(10.0f * p.y) * glm::sin(10.0f * p.z);
+		return sines < 0;
+	}
+
+	[[nodiscard]] const i_texture* get_even() const { return even; }
+	[[nodiscard]] const i_texture* get_odd() const { return odd; }
+
 	~checker() override
 	{
 		delete even_color;
@@ -0,0 +1,192 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "i_texture.h"
+#include "../../../../utils.h"
+#include "glm/glm.hpp"
+
+//Image sampled with trilinear filtering over a pyramid of mip levels, each half the size of the one before. Every
+//level is stored in tiles of 4x4 texels of 4 bytes, one 64 byte cache line per tile, so the 2x2 texels of a bilinear
+//lookup come from a single line unless they straddle two tiles. The texels keep their 8 bit sRGB encoding and are
+//decoded to linear colors through a table when they are read. The image repeats outside [0, 1].
+class image_texture final : public i_texture
+{
+public:
+    //p_texels are 8 bit sRGB colors, 3 bytes per texel, the rows from the top of the image
+    image_texture(const uint8_t* p_texels, const uint32_t p_width, const uint32_t p_height)
+        : max_extent(static_cast<float>(std::max(p_width, p_height)))
+    {
+        build(p_texels, p_width, p_height);
+    }
+
+    color3 color_at(const point3&, const glm::vec2& uv) const override
+    {
+        return bilinear(levels.front(), uv);
+    }
+
+    //color over a footprint of the given width in uv units, which picks the two levels blended
+    [[nodiscard]] color3 sample(const glm::vec2& uv, const float footprint) const
+    {
+        const float texels = footprint * max_extent;
+        if (!(texels > 1.0f))
+            return bilinear(levels.front(), uv);
+
+        const float level = std::min(std::log2(texels), static_cast<float>(levels.size() - 1));
+        const auto fine = static_cast<uint32_t>(level);
+        const float blend = level - static_cast<float>(fine);
+        const color3 color = bilinear(levels[fine], uv);
+        if (blend <= 0.0f || fine + 1 >= levels.size())
+            return color;
+        return glm::mix(color, bilinear(levels[fine + 1], uv), blend);
+    }
+
+    [[nodiscard]] uint32_t get_width() const { return levels.front().width; }
+    [[nodiscard]] uint32_t get_height() const { return levels.front().height; }
+    [[nodiscard]] uint32_t get_level_count() const { return static_cast<uint32_t>(levels.size()); }
+
+    //bytes held by the tiles of every level
+    [[nodiscard]] size_t memory_bytes() const
+    {
+        size_t bytes{0};
+        for (const mip_level& level: levels)
+            bytes += level.tiles.capacity() * sizeof(texel_tile);
+        return bytes;
+    }
+
+private:
+    static constexpr uint32_t tile_size{4};
+
+    struct alignas(64) texel_tile
+    {
+        uint32_t texels[tile_size * tile_size];
+    };
+
+    struct mip_level
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t tiles_x;
+        std::vector<texel_tile> tiles;
+
+        [[nodiscard]] uint32_t texel(const uint32_t x, const uint32_t y) const
+        {
+            return tiles[(y / tile_size) * tiles_x + x / tile_size].texels[(y % tile_size) * tile_size + x % tile_size];
+        }
+    };
+
+    static std::array<float, 256> make_decode_table()
+    {
+        std::array<float, 256> table{};
+        for (uint32_t i = 0; i < 256; ++i)
+        {
+            const float c = static_cast<float>(i) / 255.0f;
+            table[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        return table;
+    }
+
+    static inline const std::array<float, 256> srgb_to_linear{make_decode_table()};
+
+    static uint32_t encode(const float linear)
+    {
+        const float c = std::clamp(linear, 0.0f, 1.0f);
+        const float srgb = c <= 0.0031308f ? 12.92f * c : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+        return static_cast<uint32_t>(srgb * 255.0f + 0.5f);
+    }
+
+    static color3 decode(const uint32_t texel)
+    {
+        return {srgb_to_linear[texel & 0xff], srgb_to_linear[(texel >> 8) & 0xff], srgb_to_linear[(texel >> 16) & 0xff]};
+    }
+
+    //texel coordinate of a repeated texture coordinate, a non finite one reads the origin
+    static float wrap(const float coordinate)
+    {
+        const float wrapped = coordinate - std::floor(coordinate);
+        return std::isfinite(wrapped) ? wrapped : 0.0f;
+    }
+
+    static color3 bilinear(const mip_level& level, const glm::vec2& uv)
+    {
+        const float x = wrap(uv.x) * static_cast<float>(level.width) - 0.5f;
+        const float y = (1.0f - wrap(uv.y)) * static_cast<float>(level.height) - 0.5f;
+        const float floor_x = std::floor(x);
+        const float floor_y = std::floor(y);
+        const float tx = x - floor_x;
+        const float ty = y - floor_y;
+
+        //a lookup before the first texel of a row or a column blends it with the last one
+        const uint32_t x0 = floor_x < 0.0f ? level.width - 1 : std::min(static_cast<uint32_t>(floor_x), level.width - 1);
+        const uint32_t y0 = floor_y < 0.0f ? level.height - 1 : std::min(static_cast<uint32_t>(floor_y), level.height - 1);
+        const uint32_t x1 = x0 + 1 == level.width ? 0 : x0 + 1;
+        const uint32_t y1 = y0 + 1 == level.height ? 0 : y0 + 1;
+
+        const color3 top = glm::mix(decode(level.texel(x0, y0)), decode(level.texel(x1, y0)), tx);
+        const color3 bottom = glm::mix(decode(level.texel(x0, y1)), decode(level.texel(x1, y1)), tx);
+        return glm::mix(top, bottom, ty);
+    }
+
+    //level 0 holds the texels as they are, every next level averages 2x2 texels of the one before in linear space
+    void build(const uint8_t* p_texels, const uint32_t p_width, const uint32_t p_height)
+    {
+        uint32_t width = std::max(p_width, 1u);
+        uint32_t height = std::max(p_height, 1u);
+        std::vector<color3> linear(static_cast<size_t>(width) * height);
+        for (size_t i = 0; i < linear.size(); ++i)
+        {
+            linear[i] = p_texels != nullptr && p_width > 0 && p_height > 0
+                                ? color3{srgb_to_linear[p_texels[3 * i + 0]], srgb_to_linear[p_texels[3 * i + 1]], srgb_to_linear[p_texels[3 * i + 2]]}
+                                : color3{0.0f, 0.0f, 0.0f};
+        }
+
+        for (;;)
+        {
+            store_level(linear, width, height);
+            if (width == 1 && height == 1)
+                break;
+
+            const uint32_t next_width = std::max(width / 2, 1u);
+            const uint32_t next_height = std::max(height / 2, 1u);
+            std::vector<color3> next(static_cast<size_t>(next_width) * next_height);
+            for (uint32_t y = 0; y < next_height; ++y)
+            {
+                const uint32_t y0 = std::min(2 * y, height - 1);
+                const uint32_t y1 = std::min(2 * y + 1, height - 1);
+                for (uint32_t x = 0; x < next_width; ++x)
+                {
+                    const uint32_t x0 = std::min(2 * x, width - 1);
+                    const uint32_t x1 = std::min(2 * x + 1, width - 1);
+                    next[static_cast<size_t>(y) * next_width + x] =
+                            0.25f * (linear[static_cast<size_t>(y0) * width + x0] + linear[static_cast<size_t>(y0) * width + x1] +
+                                     linear[static_cast<size_t>(y1) * width + x0] + linear[static_cast<size_t>(y1) * width + x1]);
+                }
+            }
+            linear = std::move(next);
+            width = next_width;
+            height = next_height;
+        }
+    }
+
+    void store_level(const std::vector<color3>& linear, const uint32_t width, const uint32_t height)
+    {
+        mip_level level{width, height, (width + tile_size - 1) / tile_size, {}};
+        level.tiles.resize(static_cast<size_t>(level.tiles_x) * ((height + tile_size - 1) / tile_size), texel_tile{});
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                const color3& color = linear[static_cast<size_t>(y) * width + x];
+                level.tiles[(y / tile_size) * level.tiles_x + x / tile_size].texels[(y % tile_size) * tile_size + x % tile_size] =
+                        encode(color.r) | encode(color.g) << 8 | encode(color.b) << 16;
+            }
+        }
+        levels.push_back(std::move(level));
+    }
+
+    const float max_extent;
+    std::vector<mip_level> levels;
+};
@@ -0,0 +1,288 @@
+#pragma once
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <system_error>
+
+#include "triangle_mesh.h"
+#include "../../mapped_file.h"
+
+//64 bit hash of a range of bytes, read 8 at a time in four independent lanes so it runs at the speed of the memory
+inline uint64_t hash_bytes(const void* p_bytes, const size_t size, const uint64_t seed)
+{
+    constexpr uint64_t multiplier{0x9e3779b97f4a7c15ull};
+    const auto* bytes = static_cast<const unsigned char*>(p_bytes);
+    uint64_t lanes[4] = {seed, seed ^ 0x243f6a8885a308d3ull, seed ^ 0x13198a2e03707344ull, seed ^ 0xa4093822299f31d0ull};
+    size_t i{0};
+    for (; i + 32 <= size; i += 32)
+    {
+        for (uint32_t lane = 0; lane < 4; ++lane)
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes + i + 8 * lane, sizeof(word));
+            lanes[lane] = std::rotl(lanes[lane] ^ word, 31) * multiplier;
+        }
+    }
+    uint64_t hash = size;
+    for (const uint64_t lane: lanes)
+    {
+        hash = std::rotl(hash ^ lane, 27) * multiplier;
+    }
+    for (; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    return hash ^ hash >> 33;
+}
+
+//A triangle mesh built once and written to disk with its hierarchy, so the next runs map it instead of reading the
+//obj and building the BVH again. The file is the header followed by every array of mesh_arrays at a 64 byte aligned
+//offset, laid out as the mesh uses them, and the mapped arrays are used in place: there are no pointers to fix up as
+//the nodes hold indices only. The cache is keyed by a hash of the content of the source file, of the settings the
+//caller transforms it with and of the layout and build settings of this version, a cache with another key is ignored
+//and written again. It is meant for the machine that wrote it, the byte order and the float format are not checked.
+class mesh_cache
+{
+public:
+    //the key of a source file with the given settings hash, false when the file cannot be read
+    static bool source_key(const std::string& p_source_path, const uint64_t p_settings_hash, uint64_t& key)
+    {
+        const mapped_file source(p_source_path, true);
+        if (!source.is_open())
+            return false;
+        key = hash_bytes(source.data(), source.get_size(), build_settings_hash() ^ p_settings_hash);
+        return true;
+    }
+
+    //<directory>/<source file name>-<key>.rtcache, the key in the name tells the caches of a source apart
+    static std::string path_for(const std::filesystem::path& p_directory, const std::string& p_source_path, const uint64_t key)
+    {
+        std::ostringstream name;
+        name << std::filesystem::path(p_source_path).filename().string() << '-' << std::hex << std::setw(16) << std::setfill('0') << key
+             << ".rtcache";
+        return (p_directory / name.str()).string();
+    }
+
+    //maps the cache file when there is one written for the key, is_valid() tells if it was found and is complete
+    mesh_cache(const std::string& p_path, const uint64_t p_key)
+    {
+        auto mapped = std::make_shared<const mapped_file>(p_path);
+        if (!mapped->is_open() || mapped->get_size() < sizeof(header))
+            return;
+
+        header file_header{};
+        std::memcpy(&file_header, mapped->data(), sizeof(header));
+        if (std::memcmp(file_header.magic, magic, sizeof(magic)) != 0 || file_header.version != format_version || file_header.key != p_key)
+            return;
+        const layout sections = layout_of(file_header);
+        if (sections.total_bytes != mapped->get_size())
+            return;
+
+        const char* base = mapped->data();
+        const auto coordinates = [&](const uint32_t corner, const uint32_t axis) {
+            return reinterpret_cast<const float*>(base + sections.corners + (3 * corner + axis) * sections.corner_stride);
+        };
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            arrays.corners.v0[axis] = coordinates(0, axis);
+            arrays.corners.v1[axis] = coordinates(1, axis);
+            arrays.corners.v2[axis] = coordinates(2, axis);
+        }
+        arrays.vertex_indices = reinterpret_cast<const uint32_t*>(base + sections.vertex_indices);
+        arrays.normals = reinterpret_cast<const vec3*>(base + sections.normals);
+        arrays.texcoords = file_header.has_texcoords ? reinterpret_cast<const glm::vec2*>(base + sections.texcoords) : nullptr;
+        arrays.uv_scales = file_header.has_texcoords ? reinterpret_cast<const float*>(base + sections.uv_scales) : nullptr;
+        arrays.triangle_count = file_header.triangle_count;
+        arrays.vertex_count = file_header.vertex_count;
+        arrays.nodes = reinterpret_cast<const bvh_node*>(base + sections.nodes);
+        arrays.node_count = file_header.node_count;
+        arrays.bvh_stats = file_header.bvh_stats;
+        texture_name.assign(base + sections.texture_name, file_header.texture_name_bytes);
+        file = std::move(mapped);
+    }
+
+    [[nodiscard]] bool is_valid() const { return file != nullptr; }
+
+    //the diffuse map of the material of the source, relative to it, empty without one
+    [[nodiscard]] const std::string& get_texture_name() const { return texture_name; }
+
+    //a mesh using the mapped arrays, which stay mapped as long as it lives
+    [[nodiscard]] triangle_mesh* create_mesh(const i_material* p_material) const
+    {
+        return new triangle_mesh{p_material, arrays, file};
+    }
+
+    //written to a temporary file renamed once complete, so a cache is never read half written. The caches of the same
+    //source file name with another key are removed then, an edit of the obj or of the settings leaves one file behind.
+    static bool write(const std::string& p_path, const uint64_t p_key, const triangle_mesh& p_mesh, const std::string& p_texture_name)
+    {
+        const mesh_arrays source = p_mesh.get_mesh_arrays();
+        header file_header{};
+        std::memcpy(file_header.magic, magic, sizeof(magic));
+        file_header.version = format_version;
+        file_header.triangle_count = source.triangle_count;
+        file_header.vertex_count = source.vertex_count;
+        file_header.node_count = source.node_count;
+        file_header.has_texcoords = source.texcoords != nullptr ? 1 : 0;
+        file_header.texture_name_bytes = static_cast<uint32_t>(p_texture_name.size());
+        file_header.key = p_key;
+        file_header.bvh_stats = source.bvh_stats;
+        const layout sections = layout_of(file_header);
+
+        std::error_code error;
+        std::filesystem::create_directories(std::filesystem::path(p_path).parent_path(), error);
+        const std::string temporary_path = p_path + ".tmp";
+        {
+            std::ofstream stream(temporary_path, std::ios::binary | std::ios::trunc);
+            if (!stream)
+                return false;
+            size_t written{0};
+            const auto put = [&](const size_t offset, const void* bytes, const size_t size) {
+                static constexpr char zeros[section_alignment]{};
+                stream.write(zeros, static_cast<std::streamsize>(offset - written));
+                stream.write(static_cast<const char*>(bytes), static_cast<std::streamsize>(size));
+                written = offset + size;
+            };
+            const size_t padded = static_cast<size_t>(source.triangle_count) + triangle_padding;
+            const float* const* corner_sources[3] = {source.corners.v0, source.corners.v1, source.corners.v2};
+            put(0, &file_header, sizeof(header));
+            for (uint32_t corner = 0; corner < 3; ++corner)
+            {
+                for (uint32_t axis = 0; axis < 3; ++axis)
+                {
+                    put(sections.corners + (3 * corner + axis) * sections.corner_stride, corner_sources[corner][axis], padded * sizeof(float));
+                }
+            }
+            put(sections.vertex_indices, source.vertex_indices, 3 * static_cast<size_t>(source.triangle_count) * sizeof(uint32_t));
+            put(sections.normals, source.normals, static_cast<size_t>(source.vertex_count) * sizeof(vec3));
+            if (source.texcoords != nullptr)
+            {
+                put(sections.texcoords, source.texcoords, static_cast<size_t>(source.vertex_count) * sizeof(glm::vec2));
+                put(sections.uv_scales, source.uv_scales, static_cast<size_t>(source.triangle_count) * sizeof(float));
+            }
+            put(sections.nodes, source.nodes, static_cast<size_t>(source.node_count) * sizeof(bvh_node));
+            put(sections.texture_name, p_texture_name.data(), p_texture_name.size());
+            put(sections.total_bytes, nullptr, 0);
+            if (!stream)
+                return false;
+        }
+        std::filesystem::rename(temporary_path, p_path, error);
+        if (error)
+        {
+            std::filesystem::remove(temporary_path, error);
+            return false;
+        }
+        remove_stale(p_path);
+        return true;
+    }
+
+private:
+    static constexpr char magic[8] = {'R', 'T', 'M', 'E', 'S', 'H', '\0', '\0'};
+    static constexpr uint32_t format_version{1};
+    static constexpr size_t section_alignment{64};
+
+    struct header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t triangle_count;
+        uint32_t vertex_count;
+        uint32_t node_count;
+        uint32_t has_texcoords;
+        uint32_t texture_name_bytes;
+        uint64_t key;
+        bvh_build_stats bvh_stats;
+    };
+
+    //byte offsets of the arrays in the file
+    struct layout
+    {
+        size_t corners;
+        size_t corner_stride; //between the 9 corner coordinate arrays
+        size_t vertex_indices;
+        size_t normals;
+        size_t texcoords;
+        size_t uv_scales;
+        size_t nodes;
+        size_t texture_name;
+        size_t total_bytes;
+    };
+
+    //removes the <source file name>-<other key>.rtcache files next to the cache at p_path, failures leave them there
+    static void remove_stale(const std::filesystem::path& p_path)
+    {
+        constexpr size_t key_digits{16};
+        const std::string extension{".rtcache"};
+        const std::string file_name = p_path.filename().string();
+        if (file_name.size() < key_digits + extension.size())
+            return;
+        const std::string prefix = file_name.substr(0, file_name.size() - key_digits - extension.size());
+
+        std::error_code error;
+        for (std::filesystem::directory_iterator entry(p_path.parent_path(), error), end; !error && entry != end; entry.increment(error))
+        {
+            const std::string name = entry->path().filename().string();
+            if (name != file_name && name.size() == file_name.size() && name.starts_with(prefix) && name.ends_with(extension) &&
+                name.find_first_not_of("0123456789abcdef", prefix.size()) == name.size() - extension.size())
+            {
+                std::error_code remove_error;
+                std::filesystem::remove(entry->path(), remove_error);
+            }
+        }
+    }
+
+    static size_t align(const size_t offset)
+    {
+        return (offset + section_alignment - 1) / section_alignment * section_alignment;
+    }
+
+    static layout layout_of(const header& p_header)
+    {
+        const size_t triangles = p_header.triangle_count;
+        const size_t vertices = p_header.vertex_count;
+        layout sections{};
+        sections.corners = align(sizeof(header));
+        sections.corner_stride = align((triangles + triangle_padding) * sizeof(float));
+        sections.vertex_indices = sections.corners + 9 * sections.corner_stride;
+        sections.normals = align(sections.vertex_indices + 3 * triangles * sizeof(uint32_t));
+        size_t end = sections.normals + vertices * sizeof(vec3);
+        if (p_header.has_texcoords)
+        {
+            sections.texcoords = align(end);
+            sections.uv_scales = align(sections.texcoords + vertices * sizeof(glm::vec2));
+            end = sections.uv_scales + triangles * sizeof(float);
+        }
+        sections.nodes = align(end);
+        sections.texture_name = sections.nodes + p_header.node_count * sizeof(bvh_node);
+        sections.total_bytes = sections.texture_name + p_header.texture_name_bytes;
+        return sections;
+    }
+
+    //what the arrays depend on besides the source, a change of any makes the caches written before stale
+    static uint64_t build_settings_hash()
+    {
+        const uint64_t settings[] = {format_version,
+                                     sizeof(bvh_node),
+                                     sizeof(vec3),
+                                     sizeof(glm::vec2),
+                                     triangle_padding,
+                                     bvh::bin_count,
+                                     bvh::max_stack_depth,
+                                     triangle_mesh::max_triangles_per_leaf,
+                                     std::bit_cast<uint32_t>(triangle_mesh::triangle_intersection_cost),
+                                     std::bit_cast<uint32_t>(bvh::traversal_cost)};
+        return hash_bytes(settings, sizeof(settings), 0);
+    }
+
+    std::shared_ptr<const mapped_file> file;
+    mesh_arrays arrays{};
+    std::string texture_name;
+};
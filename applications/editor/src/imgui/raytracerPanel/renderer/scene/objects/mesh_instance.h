@@ -0,0 +1,164 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "i_object.h"
+#include "triangle_mesh.h"
+#include "../../ray.h"
+#include "../../ray_packet.h"
+#include "../../utils.h"
+#include "glm/mat3x3.hpp"
+#include "glm/mat4x4.hpp"
+#include "materials/i_material.h"
+
+
+//A triangle mesh placed in the scene by an affine transform. The mesh is shared by every instance placing it and the
+//rays are moved into its space for the traversal, so a copy costs two matrices whatever the size of the mesh. The
+//material defaults to the one of the mesh.
+class mesh_instance final : public i_object
+{
+public:
+    mesh_instance(const triangle_mesh* p_mesh, const glm::mat4& p_object_to_world, const i_material* p_material = nullptr)
+        : mesh(p_mesh),
+          material(p_material != nullptr ? p_material : p_mesh->get_material()),
+          object_to_world(p_object_to_world),
+          world_to_object(glm::inverse(p_object_to_world)),
+          direction_to_object(world_to_object),
+          normal_to_world(glm::transpose(direction_to_object)),
+          absolute_to_world(absolute(glm::mat3(object_to_world))),
+          absolute_to_object(absolute(glm::mat3(world_to_object))),
+          absolute_world_translation(glm::abs(vec3(object_to_world[3]))),
+          absolute_object_translation(glm::abs(vec3(world_to_object[3])))
+    {
+    }
+
+    //the local ray is normalized, its interval and the uv scale are scaled by the length the transform gives the direction
+    bool intersect(ray& p_ray, point3& t, vec3& normal, glm::vec2& uv, float& uv_scale, surface_offset& offset) const override
+    {
+        const vec3 scaled_direction = direction_to_object * p_ray.get_direction();
+        const float scale = glm::length(scaled_direction);
+        const vec3 local_direction = scaled_direction / scale;
+        float shift;
+        const point3 local_origin = to_object(p_ray.get_origin(), local_direction, &shift);
+        ray local_ray{local_origin, local_direction, p_ray.get_t_max() * scale - shift, std::max(0.0f, p_ray.get_t_min() * scale - shift)};
+        point3 local_t;
+        vec3 local_normal;
+        surface_offset local_offset;
+        if (!mesh->intersect(local_ray, local_t, local_normal, uv, uv_scale, local_offset))
+            return false;
+
+        uv_scale *= scale;
+        p_ray.set_t_max((local_ray.get_t_max() + shift) / scale);
+        to_world(local_t, local_offset, t, offset);
+        normal = glm::normalize(normal_to_world * local_normal);
+        return true;
+    }
+
+    //the directions are left unnormalized in object space so distances along the rays, and t_max, stay the same
+    uint32_t intersect_packet(ray_packet& packet, const uint32_t lanes, packet_hits& hits) const override
+    {
+        ray_packet local;
+        float shift[ray_packet::size]{};
+        for_each_lane(lanes, [&](const uint32_t lane) {
+            const vec3 direction = direction_to_object * packet.get_direction(lane);
+            const point3 origin = to_object(packet.get_origin(lane), direction, &shift[lane]);
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                local.origin[axis][lane] = origin[axis];
+                local.direction[axis][lane] = direction[axis];
+                local.inv_direction[axis][lane] = 1.0f / direction[axis];
+            }
+            local.t_max[lane] = packet.t_max[lane] - shift[lane];
+        });
+
+        packet_hits local_hits;
+        const uint32_t hit_lanes = mesh->intersect_packet(local, lanes, local_hits);
+        for_each_lane(hit_lanes, [&](const uint32_t lane) {
+            packet.t_max[lane] = local.t_max[lane] + shift[lane];
+            to_world(local_hits.t[lane], local_hits.offset[lane], hits.t[lane], hits.offset[lane]);
+            hits.normal[lane] = glm::normalize(normal_to_world * local_hits.normal[lane]);
+            hits.uv[lane] = local_hits.uv[lane];
+            hits.uv_scale[lane] = local_hits.uv_scale[lane] * glm::length(local.get_direction(lane));
+        });
+        return hit_lanes;
+    }
+
+    bool alter_ray_direction(const ray& incident_ray, const vec3& normal, vec3& next_direction, sampler& p_sampler) const override
+    {
+        return material->alter_ray_direction(incident_ray, normal, next_direction, p_sampler);
+    }
+
+    [[nodiscard]] color3 color_at(const point3& t, const glm::vec2& uv) const override
+    {
+        return material->color_at(t, uv);
+    }
+
+    float get_shininess() const override
+    {
+        return material->get_shininess();
+    }
+
+    //box around the transformed corners of the mesh bounds
+    aabb bounds() const override
+    {
+        const aabb local = mesh->bounds();
+        aabb world;
+        for (uint32_t corner = 0; corner < 8; ++corner)
+        {
+            const point3 p{(corner & 1) != 0 ? local.max.x : local.min.x, (corner & 2) != 0 ? local.max.y : local.min.y,
+                           (corner & 4) != 0 ? local.max.z : local.min.z};
+            world.grow(point3(object_to_world * glm::vec4(p, 1.0f)));
+        }
+        return world;
+    }
+
+    [[nodiscard]] const triangle_mesh* get_mesh() const { return mesh; }
+    [[nodiscard]] const i_material* get_material() const { return material; }
+    [[nodiscard]] const glm::mat4& get_transform() const { return object_to_world; }
+
+private:
+    //Ray origin moved to object space, then along the ray past the rounding error of the transform: a ray leaving the
+    //surface of the instance would otherwise start behind it in object space. shift receives the distance moved.
+    [[nodiscard]] point3 to_object(const point3& p, const vec3& local_direction, float* shift = nullptr) const
+    {
+        const vec3 error = rounding_error_bound(3) * (absolute_to_object * glm::abs(p) + absolute_object_translation);
+        const float distance = glm::dot(glm::abs(local_direction), error) / glm::dot(local_direction, local_direction);
+        if (shift != nullptr)
+            *shift = distance;
+        return point3(world_to_object * glm::vec4(p, 1.0f)) + distance * local_direction;
+    }
+
+    //hit point moved to world space, its error bound grows with the rounding of the transform
+    void to_world(const point3& local_t, const surface_offset& local_offset, point3& t, surface_offset& offset) const
+    {
+        constexpr float transform_error{rounding_error_bound(3)};
+        t = point3(object_to_world * glm::vec4(local_t, 1.0f));
+        offset.error = (1.0f + transform_error) * (absolute_to_world * local_offset.error) +
+                       transform_error * (absolute_to_world * glm::abs(local_t) + absolute_world_translation);
+        const vec3 geometric_normal = normal_to_world * local_offset.geometric_normal;
+        const float length_squared = glm::dot(geometric_normal, geometric_normal);
+        offset.geometric_normal = length_squared > 0.0f ? geometric_normal / std::sqrt(length_squared) : vec3{0.0f, 0.0f, 0.0f};
+    }
+
+    static glm::mat3 absolute(glm::mat3 m)
+    {
+        for (uint32_t column = 0; column < 3; ++column)
+        {
+            m[column] = glm::abs(m[column]);
+        }
+        return m;
+    }
+
+    const triangle_mesh* mesh;
+    const i_material* material;
+    const glm::mat4 object_to_world;
+    const glm::mat4 world_to_object;
+    const glm::mat3 direction_to_object;
+    const glm::mat3 normal_to_world; //inverse transpose of the linear part, keeps normals perpendicular under scaling
+    //absolute values of the linear parts and the translations, for the error bounds
+    const glm::mat3 absolute_to_world;
+    const glm::mat3 absolute_to_object;
+    const vec3 absolute_world_translation;
+    const vec3 absolute_object_translation;
+};
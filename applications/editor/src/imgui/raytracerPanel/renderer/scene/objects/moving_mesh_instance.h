@@ -0,0 +1,69 @@
+#pragma once
+#include "i_object.h"
+#include "mesh_instance.h"
+#include "triangle_mesh.h"
+#include "../../ray.h"
+#include "glm/mat4x4.hpp"
+#include "materials/i_material.h"
+
+
+//A triangle mesh instance moving while the shutter is open: its transform goes linearly from the start one at time 0
+//to the end one at time 1 and every ray sees the mesh at its own time. Each point of the mesh then moves on a straight
+//line, so the box around the bounds at both ends holds the mesh at any time and no hierarchy is built again for a time
+//sample. The matrices are blended, a rotation over a large angle shrinks the mesh midway.
+class moving_mesh_instance final : public i_object
+{
+public:
+    moving_mesh_instance(const triangle_mesh* p_mesh, const glm::mat4& p_start_transform, const glm::mat4& p_end_transform,
+                         const i_material* p_material = nullptr)
+        : mesh(p_mesh),
+          material(p_material != nullptr ? p_material : p_mesh->get_material()),
+          start_transform(p_start_transform),
+          end_transform(p_end_transform)
+    {
+    }
+
+    //the instance at the time of the ray is placed on the stack, inverting its transform costs less than the traversal
+    bool intersect(ray& p_ray, point3& t, vec3& normal, glm::vec2& uv, float& uv_scale, surface_offset& offset) const override
+    {
+        return at(p_ray.get_time()).intersect(p_ray, t, normal, uv, uv_scale, offset);
+    }
+
+    bool alter_ray_direction(const ray& incident_ray, const vec3& normal, vec3& next_direction, sampler& p_sampler) const override
+    {
+        return material->alter_ray_direction(incident_ray, normal, next_direction, p_sampler);
+    }
+
+    [[nodiscard]] color3 color_at(const point3& t, const glm::vec2& uv) const override
+    {
+        return material->color_at(t, uv);
+    }
+
+    float get_shininess() const override
+    {
+        return material->get_shininess();
+    }
+
+    //box around the bounds of both ends of the motion
+    aabb bounds() const override
+    {
+        aabb world = at(0.0f).bounds();
+        world.grow(at(1.0f).bounds());
+        return world;
+    }
+
+    //the instance placed where the mesh is at the given time
+    [[nodiscard]] mesh_instance at(const float time) const
+    {
+        return mesh_instance{mesh, start_transform * (1.0f - time) + end_transform * time, material};
+    }
+
+    [[nodiscard]] const triangle_mesh* get_mesh() const { return mesh; }
+    [[nodiscard]] const i_material* get_material() const { return material; }
+
+private:
+    const triangle_mesh* mesh;
+    const i_material* material;
+    const glm::mat4 start_transform;
+    const glm::mat4 end_transform;
+};
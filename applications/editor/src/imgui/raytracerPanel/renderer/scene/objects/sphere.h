@@ -1,6 +1,9 @@
 #pragma once
+#include <algorithm>
+#include <cmath>
 
-
+#include "i_object.h"
+#include "materials/i_material.h"
 
 class sphere final : public i_object
 {
@@ -11,15 +14,47 @@ public:
 	{
 	}
 
-	bool intersect(const ray& p_ray, point3& t, vec3& normal, glm::vec2& uv) const override
+	//Roots of the quadratic taken in the forms that keep their precision: the discriminant from the distance of the
+	//center to the line of the ray, the root near zero from c / q. A root within the rounding error of c is the ray
+	//starting on the sphere and is not a hit, the offset origin of a ray leaving the sphere stays clear of it.
+	//The nearest root inside the interval of the ray is kept.
+	bool intersect(ray& p_ray, point3& t, vec3& normal, glm::vec2& uv, float& uv_scale, surface_offset& offset) const override
 	{
-		const point3 acne_corrected_origin = p_ray.move(0.001f); //cetaphil
-		return glm::intersectRaySphere(acne_corrected_origin, glm::normalize(p_ray.get_direction()), center, radius, t, normal);
+		const vec3 to_origin = p_ray.get_origin() - center;
+		const vec3 direction = p_ray.get_direction();
+		const float b = glm::dot(to_origin, direction);
+		const float distance_to_line = glm::length(to_origin - b * direction);
+		const float discriminant = (radius + distance_to_line) * (radius - distance_to_line);
+		if (discriminant < 0.0f)
+			return false;
+
+		const float q = b > 0.0f ? -(b + std::sqrt(discriminant)) : std::sqrt(discriminant) - b;
+		if (q == 0.0f)
+			return false;
+		const float length2 = glm::dot(to_origin, to_origin);
+		const float c = length2 - radius2;
+		const float c_error = rounding_error_bound(4) * (length2 + radius2);
+		const float near_root = std::abs(c) <= c_error ? 0.0f : c / q;
+		const float t0 = std::min(q, near_root);
+		const float t1 = std::max(q, near_root);
+		const float distance = p_ray.contains(t0) ? t0 : t1;
+		if (!p_ray.contains(distance))
+			return false;
+		p_ray.set_t_max(distance);
+
+		//moved back onto the sphere, which bounds its error by the magnitude of the point
+		const vec3 from_center = p_ray.move(distance) - center;
+		t = center + from_center * (radius / glm::length(from_center));
+		normal = (t - center) / radius;
+		offset.geometric_normal = normal;
+		offset.error = rounding_error_bound(5) * glm::abs(t);
+		uv_scale = 0.0f;
+		return true;
 	}
 
-	bool alter_ray_direction(const ray& incident_ray, const vec3& normal, vec3& next_direction) const override
+	bool alter_ray_direction(const ray& incident_ray, const vec3& normal, vec3& next_direction, sampler& p_sampler) const override
 	{
-		return material->alter_ray_direction(incident_ray, normal, next_direction);
+		return material->alter_ray_direction(incident_ray, normal, next_direction, p_sampler);
 	}
 
 	color3 color_at(const point3& t, const glm::vec2& uv) const override
@@ -31,6 +66,13 @@ public:
         {
             return material->get_shininess();
         }
+
+	aabb bounds() const override
+	{
+		return {center - vec3{radius}, center + vec3{radius}};
+	}
+
+	[[nodiscard]] const i_material* get_material() const { return material; }
 private:
 	const point3 center{};
 	float radius{};
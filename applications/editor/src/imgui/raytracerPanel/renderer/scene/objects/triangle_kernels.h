@@ -0,0 +1,499 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <random>
+#include <utility>
+
+#include "../../ray_packet.h"
+#include "../../simd.h"
+#include "../../utils.h"
+#include "glm/glm.hpp"
+
+//Pointers to the structure of arrays of a triangle_mesh, the three corners of every triangle. Every array is padded
+//with triangle_padding zeroed entries so the wide kernels can always load a full register past the last triangle.
+struct triangle_arrays
+{
+    const float* v0[3];
+    const float* v1[3];
+    const float* v2[3];
+};
+
+//A ray prepared for the watertight test of Woop, Benthin and Wald. The axes are permuted so the largest component of
+//the direction is z, then the corners are moved to the origin and sheared so the ray runs along z: the test is left
+//with 2D edge functions of the sheared corners.
+struct watertight_ray
+{
+    watertight_ray(const point3& p_origin, const vec3& direction)
+    {
+        const vec3 magnitude = glm::abs(direction);
+        const uint32_t kz = magnitude.x > magnitude.y ? (magnitude.x > magnitude.z ? 0 : 2) : (magnitude.y > magnitude.z ? 1 : 2);
+        uint32_t kx = (kz + 1) % 3;
+        uint32_t ky = (kx + 1) % 3;
+        //keeps the winding of the triangles
+        if (direction[kz] < 0.0f)
+            std::swap(kx, ky);
+
+        axis[0] = kx;
+        axis[1] = ky;
+        axis[2] = kz;
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            origin[k] = p_origin[axis[k]];
+        }
+        shear[0] = direction[kx] / direction[kz];
+        shear[1] = direction[ky] / direction[kz];
+        shear[2] = 1.0f / direction[kz];
+    }
+
+    //corner i of the arrays in sheared space, z is left to be scaled by shear[2]
+    [[nodiscard]] vec3 transform(const float* const corner[3], const uint32_t i) const
+    {
+        const float z = corner[axis[2]][i] - origin[2];
+        return {corner[axis[0]][i] - origin[0] - shear[0] * z, corner[axis[1]][i] - origin[1] - shear[1] * z, z};
+    }
+
+    uint32_t axis[3];//kx, ky, kz
+    float origin[3]; //in the permuted axes
+    float shear[3];
+};
+
+//Tests the triangles [first, first + count) against one ray and keeps the nearest hit in (t_min, t_max).
+//On a hit t_max, hit_index and barycentric are updated and true is returned.
+using triangle_kernel = bool (*)(const triangle_arrays& triangles, uint32_t first, uint32_t count,
+                                 const watertight_ray& ray, float t_min, float& t_max,
+                                 uint32_t& hit_index, glm::vec2& barycentric);
+
+enum class triangle_kernel_type
+{
+    scalar,
+    sse,
+    avx2
+};
+
+constexpr uint32_t triangle_padding{8};
+
+inline const char* triangle_kernel_name(const triangle_kernel_type type)
+{
+    switch (type)
+    {
+        case triangle_kernel_type::sse:
+            return "sse 4-wide";
+        case triangle_kernel_type::avx2:
+            return "avx2 8-wide";
+        default:
+            return "scalar";
+    }
+}
+
+//The kernels must not fuse the products of the edge functions, which would break their symmetry
+RT_UNFUSED_BEGIN
+
+//Watertight test, both faces are hit. The two triangles sharing an edge compute its edge function from the same
+//sheared corners with the same operations, the results only differ by their sign so no ray slips between them. An
+//edge function rounding to zero counts as inside on both sides: a ray exactly on an edge hits both triangles.
+inline bool intersect_triangles_scalar(const triangle_arrays& triangles, const uint32_t first, const uint32_t count,
+                                       const watertight_ray& ray, const float t_min, float& t_max,
+                                       uint32_t& hit_index, glm::vec2& barycentric)
+{
+    bool hit{false};
+    for (uint32_t i = first; i < first + count; ++i)
+    {
+        const vec3 a = ray.transform(triangles.v0, i);
+        const vec3 b = ray.transform(triangles.v1, i);
+        const vec3 c = ray.transform(triangles.v2, i);
+
+        //one product per statement, compilers may fuse the operations of an expression
+        const float cx_by = c.x * b.y, cy_bx = c.y * b.x;
+        const float ax_cy = a.x * c.y, ay_cx = a.y * c.x;
+        const float bx_ay = b.x * a.y, by_ax = b.y * a.x;
+        const float u = cx_by - cy_bx;
+        const float v = ax_cy - ay_cx;
+        const float w = bx_ay - by_ax;
+        if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f))
+            continue;
+
+        const float determinant = u + v + w;
+        if (determinant == 0.0f)
+            continue;
+        const float inv_determinant = 1.0f / determinant;
+
+        const float distance = (u * a.z + v * b.z + w * c.z) * ray.shear[2] * inv_determinant;
+        if (distance > t_min && distance < t_max)
+        {
+            t_max = distance;
+            hit_index = i;
+            barycentric = {v * inv_determinant, w * inv_determinant};
+            hit = true;
+        }
+    }
+    return hit;
+}
+
+#ifdef RT_SIMD_X86
+//watertight test of four triangle and ray pairs given by their corners in the permuted axes, the operations of the
+//scalar kernel in the same order
+struct sse_triangle_hits
+{
+    __m128 mask;
+    __m128 distance;
+    __m128 u;
+    __m128 v;
+};
+
+inline sse_triangle_hits watertight_test_sse(const __m128 (&corners)[3][3], const __m128 (&origin)[3], const __m128 (&shear)[3],
+                                             const __m128 t_min, const __m128 t_max)
+{
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    const __m128 az = _mm_sub_ps(corners[0][2], origin[2]);
+    const __m128 bz = _mm_sub_ps(corners[1][2], origin[2]);
+    const __m128 cz = _mm_sub_ps(corners[2][2], origin[2]);
+    const __m128 ax = _mm_sub_ps(_mm_sub_ps(corners[0][0], origin[0]), _mm_mul_ps(shear[0], az));
+    const __m128 ay = _mm_sub_ps(_mm_sub_ps(corners[0][1], origin[1]), _mm_mul_ps(shear[1], az));
+    const __m128 bx = _mm_sub_ps(_mm_sub_ps(corners[1][0], origin[0]), _mm_mul_ps(shear[0], bz));
+    const __m128 by = _mm_sub_ps(_mm_sub_ps(corners[1][1], origin[1]), _mm_mul_ps(shear[1], bz));
+    const __m128 cx = _mm_sub_ps(_mm_sub_ps(corners[2][0], origin[0]), _mm_mul_ps(shear[0], cz));
+    const __m128 cy = _mm_sub_ps(_mm_sub_ps(corners[2][1], origin[1]), _mm_mul_ps(shear[1], cz));
+
+    const __m128 u = _mm_sub_ps(_mm_mul_ps(cx, by), _mm_mul_ps(cy, bx));
+    const __m128 v = _mm_sub_ps(_mm_mul_ps(ax, cy), _mm_mul_ps(ay, cx));
+    const __m128 w = _mm_sub_ps(_mm_mul_ps(bx, ay), _mm_mul_ps(by, ax));
+    const __m128 all_positive = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero)), _mm_cmpge_ps(w, zero));
+    const __m128 all_negative = _mm_and_ps(_mm_and_ps(_mm_cmple_ps(u, zero), _mm_cmple_ps(v, zero)), _mm_cmple_ps(w, zero));
+
+    const __m128 determinant = _mm_add_ps(_mm_add_ps(u, v), w);
+    const __m128 inv_determinant = _mm_div_ps(one, determinant);
+    const __m128 scaled = _mm_add_ps(_mm_add_ps(_mm_mul_ps(u, az), _mm_mul_ps(v, bz)), _mm_mul_ps(w, cz));
+    const __m128 distance = _mm_mul_ps(_mm_mul_ps(scaled, shear[2]), inv_determinant);
+
+    __m128 mask = _mm_or_ps(all_positive, all_negative);
+    mask = _mm_and_ps(mask, _mm_cmpneq_ps(determinant, zero));
+    mask = _mm_and_ps(mask, _mm_cmpgt_ps(distance, t_min));
+    mask = _mm_and_ps(mask, _mm_cmplt_ps(distance, t_max));
+    return {mask, distance, _mm_mul_ps(v, inv_determinant), _mm_mul_ps(w, inv_determinant)};
+}
+
+inline bool intersect_triangles_sse(const triangle_arrays& triangles, const uint32_t first, const uint32_t count,
+                                    const watertight_ray& ray, const float t_min, float& t_max,
+                                    uint32_t& hit_index, glm::vec2& barycentric)
+{
+    const __m128 origin[3] = {_mm_set1_ps(ray.origin[0]), _mm_set1_ps(ray.origin[1]), _mm_set1_ps(ray.origin[2])};
+    const __m128 shear[3] = {_mm_set1_ps(ray.shear[0]), _mm_set1_ps(ray.shear[1]), _mm_set1_ps(ray.shear[2])};
+    const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    const __m128 near_limit = _mm_set1_ps(t_min);
+    const float* const* const vertices[3] = {triangles.v0, triangles.v1, triangles.v2};
+    const float* arrays[3][3];
+    for (uint32_t corner = 0; corner < 3; ++corner)
+    {
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            arrays[corner][k] = vertices[corner][ray.axis[k]];
+        }
+    }
+
+    bool hit{false};
+    for (uint32_t base = first; base < first + count; base += 4)
+    {
+        const __m128 corners[3][3] = {
+                {_mm_loadu_ps(arrays[0][0] + base), _mm_loadu_ps(arrays[0][1] + base), _mm_loadu_ps(arrays[0][2] + base)},
+                {_mm_loadu_ps(arrays[1][0] + base), _mm_loadu_ps(arrays[1][1] + base), _mm_loadu_ps(arrays[1][2] + base)},
+                {_mm_loadu_ps(arrays[2][0] + base), _mm_loadu_ps(arrays[2][1] + base), _mm_loadu_ps(arrays[2][2] + base)}};
+
+        const sse_triangle_hits result = watertight_test_sse(corners, origin, shear, near_limit, _mm_set1_ps(t_max));
+        const __m128 mask = _mm_and_ps(result.mask, _mm_cmplt_ps(lane, _mm_set1_ps(static_cast<float>(first + count - base))));
+
+        int lanes = _mm_movemask_ps(mask);
+        if (lanes == 0)
+            continue;
+
+        alignas(16) float distances[4], us[4], vs[4];
+        _mm_store_ps(distances, result.distance);
+        _mm_store_ps(us, result.u);
+        _mm_store_ps(vs, result.v);
+        while (lanes != 0)
+        {
+            const int i = std::countr_zero(static_cast<unsigned>(lanes));
+            lanes &= lanes - 1;
+            if (distances[i] < t_max)
+            {
+                t_max = distances[i];
+                hit_index = base + i;
+                barycentric = {us[i], vs[i]};
+                hit = true;
+            }
+        }
+    }
+    return hit;
+}
+
+//the corners are sheared with fused operations, which is safe as every triangle sharing a corner shears it the same
+//way, the edge functions are not fused
+RT_TARGET_AVX2 inline bool intersect_triangles_avx2(const triangle_arrays& triangles, const uint32_t first, const uint32_t count,
+                                                    const watertight_ray& ray, const float t_min, float& t_max,
+                                                    uint32_t& hit_index, glm::vec2& barycentric)
+{
+    const __m256 ox = _mm256_set1_ps(ray.origin[0]), oy = _mm256_set1_ps(ray.origin[1]), oz = _mm256_set1_ps(ray.origin[2]);
+    const __m256 sx = _mm256_set1_ps(ray.shear[0]), sy = _mm256_set1_ps(ray.shear[1]), sz = _mm256_set1_ps(ray.shear[2]);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 lane = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    const __m256 near_limit = _mm256_set1_ps(t_min);
+    const uint32_t kx = ray.axis[0], ky = ray.axis[1], kz = ray.axis[2];
+
+    bool hit{false};
+    for (uint32_t base = first; base < first + count; base += 8)
+    {
+        const __m256 az = _mm256_sub_ps(_mm256_loadu_ps(triangles.v0[kz] + base), oz);
+        const __m256 bz = _mm256_sub_ps(_mm256_loadu_ps(triangles.v1[kz] + base), oz);
+        const __m256 cz = _mm256_sub_ps(_mm256_loadu_ps(triangles.v2[kz] + base), oz);
+        const __m256 ax = _mm256_fnmadd_ps(sx, az, _mm256_sub_ps(_mm256_loadu_ps(triangles.v0[kx] + base), ox));
+        const __m256 ay = _mm256_fnmadd_ps(sy, az, _mm256_sub_ps(_mm256_loadu_ps(triangles.v0[ky] + base), oy));
+        const __m256 bx = _mm256_fnmadd_ps(sx, bz, _mm256_sub_ps(_mm256_loadu_ps(triangles.v1[kx] + base), ox));
+        const __m256 by = _mm256_fnmadd_ps(sy, bz, _mm256_sub_ps(_mm256_loadu_ps(triangles.v1[ky] + base), oy));
+        const __m256 cx = _mm256_fnmadd_ps(sx, cz, _mm256_sub_ps(_mm256_loadu_ps(triangles.v2[kx] + base), ox));
+        const __m256 cy = _mm256_fnmadd_ps(sy, cz, _mm256_sub_ps(_mm256_loadu_ps(triangles.v2[ky] + base), oy));
+
+        const __m256 u = _mm256_sub_ps(_mm256_mul_ps(cx, by), _mm256_mul_ps(cy, bx));
+        const __m256 v = _mm256_sub_ps(_mm256_mul_ps(ax, cy), _mm256_mul_ps(ay, cx));
+        const __m256 w = _mm256_sub_ps(_mm256_mul_ps(bx, ay), _mm256_mul_ps(by, ax));
+        const __m256 all_positive = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_GE_OQ), _mm256_cmp_ps(v, zero, _CMP_GE_OQ)),
+                                                  _mm256_cmp_ps(w, zero, _CMP_GE_OQ));
+        const __m256 all_negative = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(u, zero, _CMP_LE_OQ), _mm256_cmp_ps(v, zero, _CMP_LE_OQ)),
+                                                  _mm256_cmp_ps(w, zero, _CMP_LE_OQ));
+
+        const __m256 determinant = _mm256_add_ps(_mm256_add_ps(u, v), w);
+        const __m256 inv_determinant = _mm256_div_ps(one, determinant);
+        const __m256 scaled = _mm256_fmadd_ps(u, az, _mm256_fmadd_ps(v, bz, _mm256_mul_ps(w, cz)));
+        const __m256 distance = _mm256_mul_ps(_mm256_mul_ps(scaled, sz), inv_determinant);
+
+        __m256 mask = _mm256_or_ps(all_positive, all_negative);
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(determinant, zero, _CMP_NEQ_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(distance, near_limit, _CMP_GT_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(distance, _mm256_set1_ps(t_max), _CMP_LT_OQ));
+        mask = _mm256_and_ps(mask, _mm256_cmp_ps(lane, _mm256_set1_ps(static_cast<float>(first + count - base)), _CMP_LT_OQ));
+
+        int lanes = _mm256_movemask_ps(mask);
+        if (lanes == 0)
+            continue;
+
+        alignas(32) float distances[8], us[8], vs[8];
+        _mm256_store_ps(distances, distance);
+        _mm256_store_ps(us, _mm256_mul_ps(v, inv_determinant));
+        _mm256_store_ps(vs, _mm256_mul_ps(w, inv_determinant));
+        while (lanes != 0)
+        {
+            const int i = std::countr_zero(static_cast<unsigned>(lanes));
+            lanes &= lanes - 1;
+            if (distances[i] < t_max)
+            {
+                t_max = distances[i];
+                hit_index = base + i;
+                barycentric = {us[i], vs[i]};
+                hit = true;
+            }
+        }
+    }
+    return hit;
+}
+#endif
+
+inline bool triangle_kernel_supported(const triangle_kernel_type type)
+{
+    switch (type)
+    {
+#ifdef RT_SIMD_X86
+        case triangle_kernel_type::sse:
+            return true;
+        case triangle_kernel_type::avx2:
+            return cpu_supports_avx2();
+#endif
+        case triangle_kernel_type::scalar:
+            return true;
+        default:
+            return false;
+    }
+}
+
+inline triangle_kernel get_triangle_kernel(const triangle_kernel_type type)
+{
+    switch (type)
+    {
+#ifdef RT_SIMD_X86
+        case triangle_kernel_type::sse:
+            return intersect_triangles_sse;
+        case triangle_kernel_type::avx2:
+            return intersect_triangles_avx2;
+#endif
+        default:
+            return intersect_triangles_scalar;
+    }
+}
+
+//widest kernel the cpu can run, detected once
+inline triangle_kernel_type best_triangle_kernel_type()
+{
+    static const triangle_kernel_type best = [] {
+        if (triangle_kernel_supported(triangle_kernel_type::avx2))
+            return triangle_kernel_type::avx2;
+        if (triangle_kernel_supported(triangle_kernel_type::sse))
+            return triangle_kernel_type::sse;
+        return triangle_kernel_type::scalar;
+    }();
+    return best;
+}
+
+//The lanes of a packet prepared for the watertight test. The lanes of a half of the packet sharing their axes, the
+//common case for coherent rays, read the corners of a triangle as broadcasts, the others gather them lane by lane.
+struct watertight_packet
+{
+    static constexpr uint32_t halves{ray_packet::size / 4};
+
+    watertight_packet(const ray_packet& packet, const uint32_t lanes)
+    {
+        bool first_of_half[halves];
+        std::fill(std::begin(first_of_half), std::end(first_of_half), true);
+        std::fill(std::begin(uniform_axes), std::end(uniform_axes), true);
+        for_each_lane(lanes, [&](const uint32_t lane) {
+            const watertight_ray ray{packet.get_origin(lane), packet.get_direction(lane)};
+            const uint32_t half = lane / 4;
+            for (uint32_t k = 0; k < 3; ++k)
+            {
+                axis[k][lane] = ray.axis[k];
+                origin[k][lane] = ray.origin[k];
+                shear[k][lane] = ray.shear[k];
+                if (first_of_half[half])
+                    half_axis[half][k] = ray.axis[k];
+                else if (half_axis[half][k] != ray.axis[k])
+                    uniform_axes[half] = false;
+            }
+            first_of_half[half] = false;
+        });
+    }
+
+    alignas(16) float origin[3][ray_packet::size]{};
+    alignas(16) float shear[3][ray_packet::size]{};
+    uint32_t axis[3][ray_packet::size]{};
+    uint32_t half_axis[halves][3]{};
+    bool uniform_axes[halves];
+};
+
+//Tests the triangles [first, first + count) against the lanes of a packet, the triangles are broadcast and the rays
+//fill the SIMD registers. The nearest hit in (t_min, t_max[lane]) updates t_max, hit_index and barycentric per lane.
+inline uint32_t intersect_triangles_packet(const triangle_arrays& triangles, const uint32_t first, const uint32_t count,
+                                           ray_packet& packet, const watertight_packet& rays, const uint32_t lanes,
+                                           const float t_min, uint32_t* hit_index, glm::vec2* barycentric)
+{
+    uint32_t hit_lanes{0};
+#ifdef RT_SIMD_X86
+    const __m128 near_limit = _mm_set1_ps(t_min);
+
+    for (uint32_t half = 0; half < ray_packet::size; half += 4)
+    {
+        if (((lanes >> half) & 0xF) == 0)
+            continue;
+
+        const __m128 origin[3] = {_mm_load_ps(rays.origin[0] + half), _mm_load_ps(rays.origin[1] + half), _mm_load_ps(rays.origin[2] + half)};
+        const __m128 shear[3] = {_mm_load_ps(rays.shear[0] + half), _mm_load_ps(rays.shear[1] + half), _mm_load_ps(rays.shear[2] + half)};
+        const bool uniform = rays.uniform_axes[half / 4];
+        const uint32_t* const axes = rays.half_axis[half / 4];
+
+        for (uint32_t i = first; i < first + count; ++i)
+        {
+            //coordinate k of a corner in the permuted axes of every lane
+            const auto lane_coordinates = [&](const float* const* const vertex, const uint32_t k) {
+                const uint32_t* const lane_axis = rays.axis[k] + half;
+                return uniform ? _mm_set1_ps(vertex[axes[k]][i])
+                               : _mm_setr_ps(vertex[lane_axis[0]][i], vertex[lane_axis[1]][i], vertex[lane_axis[2]][i], vertex[lane_axis[3]][i]);
+            };
+            const __m128 corners[3][3] = {
+                    {lane_coordinates(triangles.v0, 0), lane_coordinates(triangles.v0, 1), lane_coordinates(triangles.v0, 2)},
+                    {lane_coordinates(triangles.v1, 0), lane_coordinates(triangles.v1, 1), lane_coordinates(triangles.v1, 2)},
+                    {lane_coordinates(triangles.v2, 0), lane_coordinates(triangles.v2, 1), lane_coordinates(triangles.v2, 2)}};
+
+            const sse_triangle_hits result = watertight_test_sse(corners, origin, shear, near_limit, _mm_load_ps(packet.t_max + half));
+            const uint32_t hits = (static_cast<uint32_t>(_mm_movemask_ps(result.mask)) << half) & lanes;
+            if (hits == 0)
+                continue;
+
+            alignas(16) float distances[4], us[4], vs[4];
+            _mm_store_ps(distances, result.distance);
+            _mm_store_ps(us, result.u);
+            _mm_store_ps(vs, result.v);
+            for_each_lane(hits, [&](const uint32_t lane) {
+                packet.t_max[lane] = distances[lane - half];
+                hit_index[lane] = i;
+                barycentric[lane] = {us[lane - half], vs[lane - half]};
+            });
+            hit_lanes |= hits;
+        }
+    }
+#else
+    for_each_lane(lanes, [&](const uint32_t lane) {
+        const watertight_ray ray{packet.get_origin(lane), packet.get_direction(lane)};
+        if (intersect_triangles_scalar(triangles, first, count, ray, t_min, packet.t_max[lane], hit_index[lane], barycentric[lane]))
+        {
+            hit_lanes |= 1u << lane;
+        }
+    });
+#endif
+    return hit_lanes;
+}
+
+RT_UNFUSED_END
+
+struct triangle_kernel_benchmark
+{
+    triangle_kernel_type type;
+    uint64_t tests;
+    uint32_t hits;
+    double seconds;
+};
+
+inline std::ostream& operator<<(std::ostream& os, const triangle_kernel_benchmark& benchmark)
+{
+    return os << triangle_kernel_name(benchmark.type) << ": " << benchmark.tests / benchmark.seconds / 1.0e6
+              << " Mtriangles/s (" << benchmark.hits << " hits)";
+}
+
+//Brute force tests of every triangle against rays aimed at the mesh, leaf sized batches of batch_size triangles.
+//The hit counts of the different kernels should match.
+inline triangle_kernel_benchmark benchmark_triangle_kernel(const triangle_kernel_type type, const triangle_arrays& triangles,
+                                                           const uint32_t triangle_count, const point3& target_min,
+                                                           const point3& target_max, const uint32_t ray_count,
+                                                           const uint32_t batch_size = 8)
+{
+    const triangle_kernel kernel = get_triangle_kernel(type);
+    std::mt19937 generator{1234};
+    std::uniform_real_distribution<float> unit{0.0f, 1.0f};
+    const vec3 extent = target_max - target_min;
+    const point3 center = (target_min + target_max) * 0.5f;
+    const float radius = glm::length(extent) + 1.0f;
+
+    triangle_kernel_benchmark benchmark{type, 0, 0, 0.0};
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t r = 0; r < ray_count; ++r)
+    {
+        const point3 origin = center + radius * glm::normalize(vec3{unit(generator) - 0.5f, unit(generator) - 0.5f, unit(generator) - 0.5f});
+        const point3 target = target_min + extent * vec3{unit(generator), unit(generator), unit(generator)};
+        const watertight_ray ray{origin, glm::normalize(target - origin)};
+
+        float t_max{std::numeric_limits<float>::max()};
+        uint32_t hit_index{};
+        glm::vec2 barycentric{};
+        bool hit{false};
+        for (uint32_t first = 0; first < triangle_count; first += batch_size)
+        {
+            hit |= kernel(triangles, first, std::min(batch_size, triangle_count - first), ray, 0.0f, t_max, hit_index, barycentric);
+        }
+        benchmark.hits += hit;
+    }
+    benchmark.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    benchmark.tests = static_cast<uint64_t>(ray_count) * triangle_count;
+    return benchmark;
+}
@@ -1,5 +1,8 @@
 #pragma once
+#include <cmath>
 #include <cstdint>
+#include <limits>
+#include <memory>
 #include <utility>
 #include <vector>
 
@@ -7,53 +10,132 @@
 #include "../../ray.h"
 #include "../../utils.h"
 #include "glm/geometric.hpp"
-#include "glm/gtx/intersect.hpp"
 #include "glm/gtx/normal.hpp"
 #include "materials/i_material.h"
+#include "../acceleration/bvh.h"
+#include "triangle_kernels.h"
 
 
+//Every array of a triangle mesh, in BVH leaf order, as a cache file stores them. The corners are padded like
+//triangle_arrays, the texture coordinates and their scales are nullptr for a mesh without them.
+struct mesh_arrays
+{
+    triangle_arrays corners{};
+    const uint32_t* vertex_indices{nullptr}; //three per triangle, into the vertex pool
+    const vec3* normals{nullptr};            //one per vertex
+    const glm::vec2* texcoords{nullptr};     //one per vertex
+    const float* uv_scales{nullptr};         //one per triangle
+    uint32_t triangle_count{0};
+    uint32_t vertex_count{0};
+    const bvh_node* nodes{nullptr};
+    uint32_t node_count{0};
+    bvh_build_stats bvh_stats{};
+};
+
+//Triangles are stored as structure of arrays in BVH leaf order: their three corners are copied for the intersection
+//test, shading normals and texture coordinates are looked up in the shared vertex pool only for the final hit. The
+//corners are kept rather than edges so the triangles sharing an edge see the same coordinates, which the watertight
+//test relies on. A mesh without texture coordinates reports the barycentric coordinates of its hits as their uv.
+//Leaves are tested with the widest triangle kernel the cpu supports.
 class triangle_mesh final : public i_object
 {
 public:
-	triangle_mesh(const i_material* material, const int nb_triangles, std::vector<std::vector<Vertex>> p_triangles)
+	triangle_mesh(const i_material* material, const indexed_mesh& p_mesh)
+		: material(material),
+		  nb_triangles(static_cast<uint32_t>(p_mesh.indices.size() / 3)),
+		  normals(p_mesh.normals),
+		  texcoords(p_mesh.texcoords.size() == p_mesh.positions.size() ? p_mesh.texcoords : std::vector<glm::vec2>{}),
+		  kernel(get_triangle_kernel(best_triangle_kernel_type()))
+	{
+		build(p_mesh);
+	}
+
+	//takes the attributes of the pool over instead of copying them, the positions and indices are released once the
+	//triangles are built
+	triangle_mesh(const i_material* material, indexed_mesh&& p_mesh)
+		: material(material),
+		  nb_triangles(static_cast<uint32_t>(p_mesh.indices.size() / 3)),
+		  normals(std::move(p_mesh.normals)),
+		  texcoords(p_mesh.texcoords.size() == p_mesh.positions.size() ? std::move(p_mesh.texcoords) : std::vector<glm::vec2>{}),
+		  kernel(get_triangle_kernel(best_triangle_kernel_type()))
+	{
+		build(p_mesh);
+		p_mesh = {};
+	}
+
+	//uses arrays kept elsewhere, such as a mapped cache file, without copying them, p_storage keeps them alive
+	triangle_mesh(const i_material* material, const mesh_arrays& p_arrays, std::shared_ptr<const void> p_storage)
 		: material(material),
-		  nb_triangles(nb_triangles),
-            triangles(std::move(p_triangles))
+		  nb_triangles(p_arrays.triangle_count),
+		  kernel(get_triangle_kernel(best_triangle_kernel_type())),
+		  storage(std::move(p_storage)),
+		  data(p_arrays)
 	{
+		triangle_bvh.assign(p_arrays.nodes, p_arrays.node_count, p_arrays.bvh_stats);
 	}
 
-    bool intersect(const ray& p_ray, point3& t, vec3& normal, glm::vec2& uv) const override
+	//data points into the arrays of the mesh
+	triangle_mesh(const triangle_mesh&) = delete;
+	triangle_mesh& operator=(const triangle_mesh&) = delete;
+
+    //the traversal and the kernels start from the interval of the ray, nothing past the nearest hit known is tested
+    bool intersect(ray& p_ray, point3& t, vec3& normal, glm::vec2& uv, float& uv_scale, surface_offset& offset) const override
     {
-        const point3 acne_corrected_origin = p_ray.move(0.001f);
-        const vec3 direction = normalize(p_ray.get_direction());
-        bool intersected{false};
-        float min_distance{std::numeric_limits<float>::max()};
-        float distance{0};
+        const point3 origin = p_ray.get_origin();
+        const vec3 direction = p_ray.get_direction();
+        const watertight_ray sheared_ray{origin, direction};
+        const triangle_arrays triangles = arrays();
+        const float t_min = p_ray.get_t_min();
+        float min_distance = p_ray.get_t_max();
+        uint32_t hit_triangle{nb_triangles};
+        glm::vec2 hit_uv{0, 0};
 
-        for (uint32_t i = 0; i < nb_triangles; ++i)
-        {
-            const Vertex& v0 = triangles[i][0];
-            const Vertex& v1 = triangles[i][1];
-            const Vertex& v2 = triangles[i][2];
-            glm::vec2 hit_uv{0, 0};
-            if (intersectRayTriangle(acne_corrected_origin, direction, v0.position, v1.position, v2.position, hit_uv, distance) &&
-                distance > 0.001f && min_distance > distance)
-            {
-                min_distance = distance;
-                t = p_ray.move(min_distance);
-                // Interpolate the normals based on the uv coordinates
-                normal = glm::normalize((1 - hit_uv.x - hit_uv.y) * v0.normal + hit_uv.x * v1.normal + hit_uv.y * v2.normal);
-                intersected = true;
-                uv = hit_uv;
-            }
-        }
+        uint64_t triangle_tests{0};
+        triangle_bvh.traverse(origin, direction, min_distance, [&](const uint32_t first, const uint32_t count, float& t_max) {
+            kernel(triangles, first, count, sheared_ray, t_min, min_distance, hit_triangle, hit_uv);
+            triangle_tests += count;
+            t_max = min_distance;
+            return false;
+        });
+        thread_counters.triangle_tests += triangle_tests;
+
+        if (hit_triangle == nb_triangles)
+            return false;
+
+        p_ray.set_t_max(min_distance);
+        hit_point(hit_triangle, hit_uv, t, offset);
+        normal = interpolated_normal(hit_triangle, hit_uv);
+        uv = texture_coordinates(hit_triangle, hit_uv, uv_scale);
+        return true;
+    }
+
+    uint32_t intersect_packet(ray_packet& packet, const uint32_t lanes, packet_hits& hits) const override
+    {
+        const watertight_packet sheared_rays{packet, lanes};
+        const triangle_arrays triangles = arrays();
+        uint32_t hit_triangle[ray_packet::size]{};
+        glm::vec2 hit_uv[ray_packet::size]{};
+        uint32_t hit_lanes{0};
+        uint32_t active{lanes};
+        uint64_t triangle_tests{0};
+        triangle_bvh.traverse(packet, active, [&](const uint32_t first, const uint32_t count, const uint32_t leaf_lanes) {
+            hit_lanes |= intersect_triangles_packet(triangles, first, count, packet, sheared_rays, leaf_lanes, 0.0f, hit_triangle, hit_uv);
+            triangle_tests += count * std::popcount(leaf_lanes);
+            return false;
+        });
+        thread_counters.triangle_tests += triangle_tests;
 
-        return intersected;
+        for_each_lane(hit_lanes, [&](const uint32_t lane) {
+            hit_point(hit_triangle[lane], hit_uv[lane], hits.t[lane], hits.offset[lane]);
+            hits.normal[lane] = interpolated_normal(hit_triangle[lane], hit_uv[lane]);
+            hits.uv[lane] = texture_coordinates(hit_triangle[lane], hit_uv[lane], hits.uv_scale[lane]);
+        });
+        return hit_lanes;
     }
 
-	bool alter_ray_direction(const ray& incident_ray, const vec3& normal, vec3& next_direction) const override
+	bool alter_ray_direction(const ray& incident_ray, const vec3& normal, vec3& next_direction, sampler& p_sampler) const override
 	{
-		return material->alter_ray_direction(incident_ray, normal, next_direction);
+		return material->alter_ray_direction(incident_ray, normal, next_direction, p_sampler);
 	}
 
     [[nodiscard]] color3 color_at(const point3& t, const glm::vec2& uv) const override
@@ -66,8 +148,185 @@ public:
         return material->get_shininess();
     }
 
+    aabb bounds() const override
+    {
+        return triangle_bvh.bounds();
+    }
+
+    [[nodiscard]] const bvh& get_bvh() const
+    {
+        return triangle_bvh;
+    }
+
+    [[nodiscard]] const i_material* get_material() const { return material; }
+
+    [[nodiscard]] triangle_arrays arrays() const
+    {
+        return data.corners;
+    }
+
+    //every array of the mesh, to write it to a cache file
+    [[nodiscard]] mesh_arrays get_mesh_arrays() const
+    {
+        mesh_arrays arrays = data;
+        arrays.nodes = triangle_bvh.node_data();
+        arrays.node_count = triangle_bvh.node_count();
+        arrays.bvh_stats = triangle_bvh.get_build_stats();
+        return arrays;
+    }
+
+    [[nodiscard]] bool has_texture_coordinates() const
+    {
+        return data.texcoords != nullptr;
+    }
+
+    [[nodiscard]] uint32_t get_vertex_count() const
+    {
+        return data.vertex_count;
+    }
+
+    [[nodiscard]] uint32_t get_triangle_count() const
+    {
+        return nb_triangles;
+    }
+
+    //bytes of the triangle arrays, the vertex pool and the hierarchy, whether they are owned or mapped
+    [[nodiscard]] size_t memory_bytes() const
+    {
+        const size_t vertices = data.vertex_count;
+        const size_t triangles = nb_triangles;
+        return 9 * (triangles + triangle_padding) * sizeof(float) + 3 * triangles * sizeof(uint32_t) + vertices * sizeof(vec3) +
+               (data.texcoords != nullptr ? vertices * sizeof(glm::vec2) + triangles * sizeof(float) : 0) +
+               triangle_bvh.node_count() * sizeof(bvh_node);
+    }
+
+    //one avx2 register, the cost of a leaf is dominated by its first triangle with the wide kernels
+    static constexpr uint32_t max_triangles_per_leaf{8};
+    static constexpr float triangle_intersection_cost{0.5f};
+
 private:
+
+    [[nodiscard]] static point3 corner(const float* const (&corners)[3], const uint32_t triangle)
+    {
+        return {corners[0][triangle], corners[1][triangle], corners[2][triangle]};
+    }
+
+    //Hit point interpolated from the corners rather than moved along the ray, which keeps its error small and bounded
+    //by the magnitude of the terms summed. The offset carries that bound and the face normal.
+    void hit_point(const uint32_t triangle, const glm::vec2& barycentric, point3& t, surface_offset& offset) const
+    {
+        const point3 p0 = corner(data.corners.v0, triangle);
+        const point3 p1 = corner(data.corners.v1, triangle);
+        const point3 p2 = corner(data.corners.v2, triangle);
+        const float b0 = 1.0f - barycentric.x - barycentric.y;
+        t = b0 * p0 + barycentric.x * p1 + barycentric.y * p2;
+        offset.error = rounding_error_bound(7) * (glm::abs(b0 * p0) + glm::abs(barycentric.x * p1) + glm::abs(barycentric.y * p2));
+
+        const vec3 face_normal = glm::cross(p1 - p0, p2 - p0);
+        const float length_squared = glm::dot(face_normal, face_normal);
+        offset.geometric_normal = length_squared > 0.0f ? face_normal / std::sqrt(length_squared) : vec3{0.0f, 0.0f, 0.0f};
+    }
+
+    // Interpolate the normals based on the uv coordinates
+    [[nodiscard]] vec3 interpolated_normal(const uint32_t triangle, const glm::vec2& barycentric) const
+    {
+        const vec3& n0 = data.normals[data.vertex_indices[3 * triangle + 0]];
+        const vec3& n1 = data.normals[data.vertex_indices[3 * triangle + 1]];
+        const vec3& n2 = data.normals[data.vertex_indices[3 * triangle + 2]];
+        return glm::normalize((1 - barycentric.x - barycentric.y) * n0 + barycentric.x * n1 + barycentric.y * n2);
+    }
+
+    //interpolated texture coordinates, uv_scale receives the length in uv units of a unit length on the triangle
+    [[nodiscard]] glm::vec2 texture_coordinates(const uint32_t triangle, const glm::vec2& barycentric, float& uv_scale) const
+    {
+        if (data.texcoords == nullptr)
+        {
+            uv_scale = 0.0f;
+            return barycentric;
+        }
+        uv_scale = data.uv_scales[triangle];
+        const glm::vec2& t0 = data.texcoords[data.vertex_indices[3 * triangle + 0]];
+        const glm::vec2& t1 = data.texcoords[data.vertex_indices[3 * triangle + 1]];
+        const glm::vec2& t2 = data.texcoords[data.vertex_indices[3 * triangle + 2]];
+        return (1 - barycentric.x - barycentric.y) * t0 + barycentric.x * t1 + barycentric.y * t2;
+    }
+
+    //builds the hierarchy, then lays the triangles out in leaf order so every leaf is a contiguous range
+    void build(const indexed_mesh& p_mesh)
+    {
+        std::vector<aabb> triangle_bounds(nb_triangles);
+        for (uint32_t i = 0; i < nb_triangles; ++i)
+        {
+            for (uint32_t corner = 0; corner < 3; ++corner)
+            {
+                triangle_bounds[i].grow(p_mesh.positions[p_mesh.indices[3 * i + corner]]);
+            }
+        }
+        triangle_bvh.build(triangle_bounds, max_triangles_per_leaf, triangle_intersection_cost);
+
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            v0[axis].reserve(nb_triangles + triangle_padding);
+            v1[axis].reserve(nb_triangles + triangle_padding);
+            v2[axis].reserve(nb_triangles + triangle_padding);
+        }
+        vertex_indices.reserve(3 * static_cast<size_t>(nb_triangles));
+        uv_scales.reserve(texcoords.empty() ? 0 : nb_triangles);
+
+        for (const uint32_t index: triangle_bvh.primitive_order())
+        {
+            const uint32_t i0 = p_mesh.indices[3 * index + 0];
+            const uint32_t i1 = p_mesh.indices[3 * index + 1];
+            const uint32_t i2 = p_mesh.indices[3 * index + 2];
+            for (uint32_t axis = 0; axis < 3; ++axis)
+            {
+                v0[axis].push_back(p_mesh.positions[i0][axis]);
+                v1[axis].push_back(p_mesh.positions[i1][axis]);
+                v2[axis].push_back(p_mesh.positions[i2][axis]);
+            }
+            vertex_indices.insert(vertex_indices.end(), {i0, i1, i2});
+            if (!texcoords.empty())
+            {
+                //ratio of the areas of the triangle in uv space and in object space
+                const float area = glm::length(glm::cross(p_mesh.positions[i1] - p_mesh.positions[i0], p_mesh.positions[i2] - p_mesh.positions[i0]));
+                const glm::vec2 e1 = texcoords[i1] - texcoords[i0];
+                const glm::vec2 e2 = texcoords[i2] - texcoords[i0];
+                const float uv_area = std::abs(e1.x * e2.y - e1.y * e2.x);
+                uv_scales.push_back(area > 0.0f ? std::sqrt(uv_area / area) : 0.0f);
+            }
+        }
+
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            v0[axis].resize(nb_triangles + triangle_padding, 0.0f);
+            v1[axis].resize(nb_triangles + triangle_padding, 0.0f);
+            v2[axis].resize(nb_triangles + triangle_padding, 0.0f);
+        }
+
+        data.corners = {{v0[0].data(), v0[1].data(), v0[2].data()},
+                        {v1[0].data(), v1[1].data(), v1[2].data()},
+                        {v2[0].data(), v2[1].data(), v2[2].data()}};
+        data.vertex_indices = vertex_indices.data();
+        data.normals = normals.data();
+        data.texcoords = texcoords.empty() ? nullptr : texcoords.data();
+        data.uv_scales = texcoords.empty() ? nullptr : uv_scales.data();
+        data.triangle_count = nb_triangles;
+        data.vertex_count = static_cast<uint32_t>(normals.size());
+    }
+
 	const i_material* material;
 	const uint32_t nb_triangles{};
-    std::vector<std::vector<Vertex>> triangles;
+
+    std::vector<float> v0[3];
+    std::vector<float> v1[3];
+    std::vector<float> v2[3];
+    std::vector<uint32_t> vertex_indices;
+    std::vector<vec3> normals;
+    std::vector<glm::vec2> texcoords;
+    std::vector<float> uv_scales; //per triangle, see texture_coordinates
+    const triangle_kernel kernel;
+    bvh triangle_bvh;
+    //a mesh read from a cache file owns none of the arrays above, this keeps the file mapped instead
+    std::shared_ptr<const void> storage;
+    mesh_arrays data; //what the intersection and the shading read, the arrays above or the mapped ones
 };
@@ -0,0 +1,44 @@
+#pragma once
+
+//x86 SIMD support. SSE is part of the x86-64 baseline, wider instruction sets are enabled per function with
+//RT_TARGET_AVX2 and must only be called after checking the cpu at runtime.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RT_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define RT_TARGET_AVX2
+#else
+#define RT_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+#ifdef RT_SIMD_X86
+//true when the RT_TARGET_AVX2 functions can run on this cpu
+inline bool cpu_supports_avx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    const bool os_saves_avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+    const bool has_fma = (info[2] & (1 << 12)) != 0;
+    __cpuidex(info, 7, 0);
+    return os_saves_avx && has_fma && (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+#endif
+
+//A fused multiply-add rounds once where a multiply then an add round twice. Code relying on the rounding of every
+//operation it writes goes between these so GCC, which fuses across statements and intrinsics, leaves it as written.
+#if defined(__GNUC__) && !defined(__clang__)
+#define RT_UNFUSED_BEGIN _Pragma("GCC push_options") _Pragma("GCC optimize(\"fp-contract=off\")")
+#define RT_UNFUSED_END _Pragma("GCC pop_options")
+#else
+#define RT_UNFUSED_BEGIN
+#define RT_UNFUSED_END
+#endif
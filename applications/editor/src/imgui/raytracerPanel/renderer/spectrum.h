@@ -0,0 +1,151 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+#include "utils.h"
+
+//visible range the wavelengths are sampled in, in nanometers
+constexpr float min_wavelength{380.0f};
+constexpr float max_wavelength{720.0f};
+
+//Linear rgb response of each nanometer of the visible range, scaled so a spectrum that is 1 everywhere is white. The
+//CIE 1931 matching functions are the multi-lobe fit of Wyman, Sloan and Shirley (2013) taken to linear sRGB, the
+//saturated wavelengths fall outside of sRGB and have a negative channel.
+class wavelength_response
+{
+public:
+    wavelength_response()
+    {
+        for (uint32_t i = 0; i < entry_count; ++i)
+        {
+            entries[i] = xyz_to_rgb(matching_functions(min_wavelength + static_cast<float>(i)));
+        }
+        //integral of the interpolated response, the trapezoids between the nanometers
+        color3 sum = 0.5f * (entries.front() + entries.back());
+        for (uint32_t i = 1; i + 1 < entry_count; ++i)
+        {
+            sum += entries[i];
+        }
+        const color3 scale = static_cast<float>(entry_count - 1) / sum;
+        for (color3& entry: entries)
+        {
+            entry *= scale;
+        }
+    }
+
+    //interpolated between the nanometers around the wavelength
+    [[nodiscard]] color3 at(const float wavelength) const
+    {
+        const float position = std::clamp(wavelength - min_wavelength, 0.0f, static_cast<float>(entry_count - 1));
+        const auto index = std::min(static_cast<uint32_t>(position), entry_count - 2);
+        const float fraction = position - static_cast<float>(index);
+        return entries[index] + fraction * (entries[index + 1] - entries[index]);
+    }
+
+private:
+    static constexpr auto entry_count = static_cast<uint32_t>(max_wavelength - min_wavelength) + 1;
+
+    static float lobe(const float wavelength, const float mean, const float width_below, const float width_above)
+    {
+        const float t = (wavelength - mean) / (wavelength < mean ? width_below : width_above);
+        return std::exp(-0.5f * t * t);
+    }
+
+    static vec3 matching_functions(const float wavelength)
+    {
+        return {1.056f * lobe(wavelength, 599.8f, 37.9f, 31.0f) + 0.362f * lobe(wavelength, 442.0f, 16.0f, 26.7f) -
+                        0.065f * lobe(wavelength, 501.1f, 20.4f, 26.2f),
+                0.821f * lobe(wavelength, 568.8f, 46.9f, 40.5f) + 0.286f * lobe(wavelength, 530.9f, 16.3f, 31.1f),
+                1.217f * lobe(wavelength, 437.0f, 11.8f, 36.0f) + 0.681f * lobe(wavelength, 459.0f, 26.0f, 13.8f)};
+    }
+
+    static color3 xyz_to_rgb(const vec3& xyz)
+    {
+        return {3.2406f * xyz.x - 1.5372f * xyz.y - 0.4986f * xyz.z, -0.9689f * xyz.x + 1.8758f * xyz.y + 0.0415f * xyz.z,
+                0.0557f * xyz.x - 0.2040f * xyz.y + 1.0570f * xyz.z};
+    }
+
+    std::array<color3, entry_count> entries{};
+};
+
+inline const wavelength_response visible_response{};
+
+//Density the wavelengths are sampled with, sech^2 around 538 nm follows the sensitivity of the eye so the wavelengths
+//that barely show are rarely picked (Radziszewski et al. 2009), here restricted to the visible range
+class visible_wavelength_density
+{
+public:
+    //wavelength at which the cumulative distribution reaches u
+    [[nodiscard]] float sample(const float u) const
+    {
+        return center + std::atanh(tanh_min + u * (tanh_max - tanh_min)) / sharpness;
+    }
+
+    [[nodiscard]] float pdf(const float wavelength) const
+    {
+        const float c = std::cosh(sharpness * (wavelength - center));
+        return sharpness / ((tanh_max - tanh_min) * c * c);
+    }
+
+private:
+    static constexpr float center{538.0f};
+    static constexpr float sharpness{0.0072f};
+    const float tanh_min{std::tanh(sharpness * (min_wavelength - center))};
+    const float tanh_max{std::tanh(sharpness * (max_wavelength - center))};
+};
+
+inline const visible_wavelength_density visible_density{};
+
+//Wavelengths a path carries once it meets a dispersive material, the hero one and the others at even offsets of the
+//sample number after it, wrapping around (Wilkie et al. 2014), each distributed by the visible density. The weight of
+//a wavelength starts at the inverse of its density relative to a uniform one and carries what the interfaces met since
+//gave it. A direction only one of them can take, a refraction, ends the others and the hero carries the path alone,
+//which keeps the estimate unbiased as each of them is distributed the same on its own. Fixed size and on the stack of
+//the thread, the per wavelength loops run over 4 floats.
+struct hero_wavelengths
+{
+    static constexpr uint32_t count{4};
+
+    alignas(16) float wavelength[count]{};
+    alignas(16) float weight[count]{};
+    bool sampled{false};
+    bool hero_only{false}; //the secondary wavelengths were ended
+
+    void sample(const float u)
+    {
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const float offset = u + static_cast<float>(i) / static_cast<float>(count);
+            wavelength[i] = visible_density.sample(offset < 1.0f ? offset : offset - 1.0f);
+            weight[i] = 1.0f / ((max_wavelength - min_wavelength) * visible_density.pdf(wavelength[i]));
+        }
+        sampled = true;
+        hero_only = false;
+    }
+
+    void terminate_secondary()
+    {
+        if (hero_only)
+            return;
+        hero_only = true;
+        weight[0] *= static_cast<float>(count);
+        for (uint32_t i = 1; i < count; ++i)
+        {
+            weight[i] = 0.0f;
+        }
+    }
+
+    //rgb weight of the light the wavelengths carry
+    [[nodiscard]] color3 tint() const
+    {
+        color3 result{0.0f, 0.0f, 0.0f};
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (weight[i] != 0.0f)
+                result += weight[i] * visible_response.at(wavelength[i]);
+        }
+        return result / static_cast<float>(count);
+    }
+};
@@ -1,113 +1,369 @@
 #pragma once
 
+#include "completed_tile_queue.h"
 #include "i_renderer.h"
+#include "ray_packet.h"
+#include "sampler.h"
 #include "scene/i_scene.h"
+#include "tile_scheduler.h"
 #include "utils.h"
-#include <execution>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
 #include <future>
-#include <queue>
+#include <limits>
 #include <thread>
 
+//interleaves the bits of x and y, sorting by this code walks the tiles along a Z-order curve
+inline uint32_t morton_code(const uint32_t x, const uint32_t y)
+{
+    const auto spread = [](uint32_t v) {
+        v &= 0x0000FFFF;
+        v = (v | (v << 8)) & 0x00FF00FF;
+        v = (v | (v << 4)) & 0x0F0F0F0F;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    };
+    return spread(x) | (spread(y) << 1);
+}
 
-class ThreadPool
+class threaded_cpu_renderer final : public i_renderer
 {
 public:
-    explicit ThreadPool(const size_t threads) : stop(false)
+    //primary rays of neighbouring pixels are traced together as packets, pass is the number of samples the pixels
+    //already hold and jitter the sub-pixel offset of this one
+    void get_compute_unit(const uint32_t start, const uint32_t end, const uint32_t pass, const vec3& jitter) const
     {
-        for (size_t i = 0; i < threads; ++i)
-            workers.emplace_back([this] {
-                for (;;)
-                {
-                    std::function<void()> task;
-                    {
-                        std::unique_lock<std::mutex> lock(this->queue_mutex);
-                        this->condition.wait(lock, [this] { return this->stop || !this->tasks.empty(); });
-                        if (this->stop && this->tasks.empty())
-                            return;
-                        task = std::move(this->tasks.front());
-                        this->tasks.pop();
-                    }
-                    task();
-                }
-            });
+        uint32_t pixels[ray_packet::size];
+        color3 colors[ray_packet::size];
+        for (uint32_t i = start; i < end; i += ray_packet::size)
+        {
+            const uint32_t lane_count = std::min(ray_packet::size, end - i);
+            for (uint32_t lane = 0; lane < lane_count; ++lane)
+            {
+                pixels[lane] = i + lane;
+            }
+            trace_pixels(pixels, lane_count, pass, jitter, colors);
+        }
     }
 
-    template<class F>
-    void enqueue(F&& f)
+    //traces up to one packet of pixels and adds the sample to each of them, colors receives the samples
+    void trace_pixels(const uint32_t* pixels, const uint32_t lane_count, const uint32_t pass, const vec3& jitter, color3* colors) const
     {
+        if (frame_camera.lens)
         {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            tasks.emplace(std::forward<F>(f));
+            frame_camera.shutter ? trace_pixels<true, true>(pixels, lane_count, pass, jitter, colors)
+                                 : trace_pixels<true, false>(pixels, lane_count, pass, jitter, colors);
+        }
+        else
+        {
+            frame_camera.shutter ? trace_pixels<false, true>(pixels, lane_count, pass, jitter, colors)
+                                 : trace_pixels<false, false>(pixels, lane_count, pass, jitter, colors);
         }
-        condition.notify_one();
     }
 
-    ~ThreadPool()
+    //One instantiation per combination of camera features, so a pinhole camera with its shutter closed draws no lens
+    //or time numbers and keeps its plain ray generation. The lens and the time are sampled once per pass, like the
+    //sub-pixel jitter, and the passes average them out.
+    template<bool Lens, bool Shutter>
+    void trace_pixels(const uint32_t* pixels, const uint32_t lane_count, const uint32_t pass, const vec3& jitter, color3* colors) const
     {
+        const uint32_t active = ray_packet::all_lanes >> (ray_packet::size - lane_count);
+        ray_packet packet;
+        sampler samplers[ray_packet::size];
+        for (uint32_t lane = 0; lane < lane_count; ++lane)
+        {
+            samplers[lane] = sampler{pixels[lane], pass, sampling};
+            if constexpr (Lens || Shutter)
+            {
+                const glm::vec3 u = samplers[lane].next_camera(pass);
+                camera_sample sample;
+                if constexpr (Lens)
+                    sample.lens = {u.x, u.y};
+                if constexpr (Shutter)
+                    sample.time = u.z;
+                packet.set_lane(lane, scene.trace_camera_ray(precomputed_directions[pixels[lane]] + jitter, sample));
+            }
+            else
+            {
+                packet.set_lane(lane, scene.trace_camera_ray(precomputed_directions[pixels[lane]] + jitter));
+            }
+        }
+
+        pixel_features features[ray_packet::size];
+        scene.color_at(packet, active, colors, samplers, features);
+        const auto write_start = std::chrono::steady_clock::now();
+        for (uint32_t lane = 0; lane < lane_count; ++lane)
         {
-            std::unique_lock<std::mutex> lock(queue_mutex);
-            stop = true;
+            scene.add_color_to_image(colors[lane], pixels[lane]);
+            scene.add_features_to_image(features[lane], pixels[lane]);
         }
-        condition.notify_all();
-        for (std::thread& worker: workers)
-            worker.join();
+        thread_counters.image_write_nanoseconds +=
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - write_start).count();
     }
 
-private:
-    std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
-    std::mutex queue_mutex;
-    std::condition_variable condition;
+    //One level of the preview: the pixels on a grid of the block size, counted from the corner of the tile, get their
+    //first sample and show it over the block of pixels right and below them that have none yet. The pixels a coarser
+    //level of the same preview traced already are skipped, so the last level only traces the rest of the image and the
+    //preview costs no more than one full resolution sample per pixel.
+    void render_preview_tile(const tile& p_tile) const
+    {
+        const uint32_t width = scene.horizontal_pixel_count();
+        const uint32_t coarser_block = frame_reuses_preview ? 2 * frame_block : 0;
+        const vec3 jitter = progressive ? subpixel_offset(1) : vec3{0.0f, 0.0f, 0.0f};
+        uint32_t traced{0};
+        for (uint32_t y = p_tile.y_begin; y < p_tile.y_end; y += frame_block)
+        {
+            const bool coarser_row = coarser_block > 0 && (y - p_tile.y_begin) % coarser_block == 0;
+            uint32_t pixels[ray_packet::size];
+            uint32_t lane_count{0};
+            for (uint32_t x = p_tile.x_begin; x < p_tile.x_end; x += frame_block)
+            {
+                if (!coarser_row || (x - p_tile.x_begin) % coarser_block != 0)
+                    pixels[lane_count++] = y * width + x;
+            }
+            if (lane_count == 0)
+                continue;
 
-    bool stop;
-};
+            color3 colors[ray_packet::size];
+            trace_pixels(pixels, lane_count, 0, jitter, colors);
+            traced += lane_count;
+            for (uint32_t lane = 0; lane < lane_count; ++lane)
+            {
+                const uint32_t x = pixels[lane] % width;
+                for (uint32_t block_y = y; block_y < std::min(y + frame_block, p_tile.y_end); ++block_y)
+                {
+                    for (uint32_t block_x = x; block_x < std::min(x + frame_block, p_tile.x_end); ++block_x)
+                    {
+                        if (scene.sample_count_at(block_y * width + block_x) == 0)
+                            scene.set_display_color(colors[lane], block_y * width + block_x);
+                    }
+                }
+            }
+        }
+        traced_pixels.fetch_add(traced, std::memory_order_relaxed);
+    }
 
-class threaded_cpu_renderer final : public i_renderer
-{
-public:
-    void get_compute_unit(const uint32_t start, const uint32_t end) const
+    //tiles of a cancelled frame are skipped so the scheduler drains it right away. The pixels of a tile always hold the
+    //same number of samples, so the tile continues the sample sequence and the sub-pixel pattern from its own count.
+    void render_tile(const uint32_t tile_index)
     {
-        for (uint32_t i = start; i < end; i++)
+        if (cancelled.load(std::memory_order_relaxed))
+            return;
+
+        const auto start = std::chrono::steady_clock::now();
+        const tile p_tile = clip_to_region(tiles[tile_index]);
+        if (frame_block > 1 || frame_reuses_preview)
+        {
+            render_preview_tile(p_tile);
+        }
+        else
+        {
+            const uint32_t width = scene.horizontal_pixel_count();
+            const uint32_t pass = scene.sample_count_at(p_tile.y_begin * width + p_tile.x_begin);
+            const vec3 jitter = progressive ? subpixel_offset(pass + 1) : vec3{0.0f, 0.0f, 0.0f};
+            for (uint32_t y = p_tile.y_begin; y < p_tile.y_end; ++y)
+            {
+                get_compute_unit(y * width + p_tile.x_begin, y * width + p_tile.x_end, pass, jitter);
+            }
+            traced_pixels.fetch_add((p_tile.x_end - p_tile.x_begin) * (p_tile.y_end - p_tile.y_begin), std::memory_order_relaxed);
+        }
+        if (target_error > 0.0f && frame_block == 1)
         {
-            ray ray{scene.trace_camera_ray(precomputed_directions[i])};
-            color3 pixel_color = scene.color_at(ray);
-            uint32_t pixel_index = i;
-            scene.add_color_to_image(pixel_color, pixel_index);
+            tile_errors[tile_index] = tile_error(p_tile);
         }
+        tile_milliseconds[tile_index] = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        completed_tiles.push(p_tile);
     }
+
+    //a thread count of 0 uses every hardware thread
     explicit threaded_cpu_renderer(const i_scene&
-                                           scene
+                                           scene,
+                                   const size_t p_thread_count = 0
 
-                                   ) : scene(scene), pool(std::thread::hardware_concurrency())
+                                   ) : scene(scene),
+                                       scheduler(p_thread_count > 0 ? p_thread_count : std::max(1u, std::thread::hardware_concurrency()), [this](const uint32_t tile_index) { run_tile(tile_index); })
 
     {
         precompute_directions();
+        region = full_image();
+        build_tiles();
+        tile_errors.assign(tiles.size(), std::numeric_limits<float>::infinity());
+        tile_milliseconds.assign(tiles.size(), 0.0f);
+    }
 
+    //the returned future is ready once every tile of the frame has been written to the image
+    //in progressive mode every call adds one jittered sample per pixel to the accumulated image instead of replacing it,
+    //with a target error only to the pixels of the tiles that have not reached it yet. Only the tiles over the region
+    //are rendered, and while a preview is pending the call renders its next level instead.
+    std::shared_future<void> render() override
+    {
+        scheduler.wait();
+        cancelled.store(false, std::memory_order_relaxed);
+        completed_tiles.clear();
+        measure_pixel_cost();
+        frame_camera = scene.get_camera_features();
 
-        const uint32_t nb_compute_units = scene.horizontal_pixel_count() * scene.vertical_pixel_count() / (8 * 8);
+        frame_block = next_preview_block;
+        frame_reuses_preview = frame_block < preview_start_block;
+        next_preview_block = std::max(1u, frame_block / 2);
+        if (!progressive && !frame_reuses_preview)
+        {
+            reset_region();
+        }
+        if (frame_block == 1)
+        {
+            scene.begin_sample_pass();
+            preview_start_block = 1;
+        }
+        std::fill(tile_milliseconds.begin(), tile_milliseconds.end(), 0.0f);
+        active_tiles.clear();
+        for (uint32_t tile_index = 0; tile_index < tiles.size(); ++tile_index)
+        {
+            if (overlaps_region(tiles[tile_index]) && (frame_block > 1 || needs_samples(tile_index)))
+                active_tiles.push_back(tile_index);
+        }
+        return scheduler.run(static_cast<uint32_t>(active_tiles.size()));
+    }
 
+    //Renders only the pixels of a rectangle from now on, the rest of the image keeps what it shows. The samples of the
+    //region are dropped and it starts over, with a preview when enabled.
+    void set_region(const tile& p_region)
+    {
+        cancel();
+        const tile full = full_image();
+        region = {std::min(p_region.x_begin, full.x_end), std::min(p_region.y_begin, full.y_end), std::min(p_region.x_end, full.x_end),
+                  std::min(p_region.y_end, full.y_end)};
+        if (region.x_begin >= region.x_end || region.y_begin >= region.y_end)
+            region = full;
+        std::fill(tile_errors.begin(), tile_errors.end(), std::numeric_limits<float>::infinity());
+        reset_region();
+        start_preview();
+    }
+
+    //renders the whole image again
+    void clear_region()
+    {
+        set_region(full_image());
+    }
 
-        for (size_t i = 0; i < nb_compute_units; ++i)
+    [[nodiscard]] const tile& get_region() const
+    {
+        return region;
+    }
+
+    //With the preview enabled, a restart renders the region at 1/8, 1/4 and 1/2 of its resolution before the full
+    //resolution, one level per render() call. It starts from the finest level whose cost, estimated from the frames
+    //rendered so far, fits in the frame budget.
+    void set_preview(const bool p_preview)
+    {
+        preview = p_preview;
+        if (!preview)
         {
-            const uint32_t start = i * work_unit_pixels * work_unit_pixels;
-            const uint32_t end = start + work_unit_pixels * work_unit_pixels;
-            compute_units.emplace([=, this] { get_compute_unit(start, end); });
+            next_preview_block = 1;
+            preview_start_block = 1;
         }
     }
 
-    bool render(uint32_t& current_compute_unit) override
+    [[nodiscard]] bool is_preview_enabled() const
+    {
+        return preview;
+    }
+
+    //true while the next render() call renders a level of the preview, or finishes it at full resolution
+    [[nodiscard]] bool preview_pending() const
+    {
+        return next_preview_block > 1 || next_preview_block < preview_start_block;
+    }
+
+    //block size of the level of the frame rendered last, 1 at full resolution
+    [[nodiscard]] uint32_t get_frame_block() const
     {
+        return frame_block;
+    }
 
+    void set_frame_budget(const float p_milliseconds)
+    {
+        frame_budget_milliseconds = p_milliseconds;
+    }
+
+    //Relative standard error of the pixel averages below which a tile gets no more progressive samples, 0 samples every
+    //tile in every pass. The tiles are measured after each of their passes so the setting applies from the next one.
+    void set_target_error(const float p_target_error)
+    {
+        target_error = p_target_error;
+    }
 
-        while (!compute_units.empty())
+    [[nodiscard]] float get_target_error() const
+    {
+        return target_error;
+    }
+
+    //true when progressive rendering with a target error has no tile of the region left to refine, to call once the frame is done
+    [[nodiscard]] bool converged() const
+    {
+        if (!progressive || target_error <= 0.0f)
+            return false;
+        for (uint32_t tile_index = 0; tile_index < tiles.size(); ++tile_index)
         {
-            pool.enqueue(compute_units.front());
-            compute_units.pop();
+            if (overlaps_region(tiles[tile_index]) && needs_samples(tile_index))
+                return false;
         }
+        return true;
+    }
 
+    //tiles of the image that received samples in the last frame
+    [[nodiscard]] size_t active_tile_count() const
+    {
+        return active_tiles.size();
+    }
 
-        return true;
+    void set_progressive(const bool p_progressive)
+    {
+        cancel();
+        progressive = p_progressive;
+        scene.reset_accumulation();
     }
+
+    //drops the frame in flight and the accumulated samples, to call when the camera or the scene changes
+    void restart()
+    {
+        cancel();
+        scene.reset_accumulation();
+        start_preview();
+    }
+
+    //runs a job over every tile of the image on the render workers once the frame in flight is done, and waits for it,
+    //used by the passes working on the finished image such as the denoiser
+    void run_tiles(const std::function<void(const tile&)>& job)
+    {
+        scheduler.wait();
+        tile_job = &job;
+        scheduler.run(static_cast<uint32_t>(tiles.size())).wait();
+        tile_job = nullptr;
+    }
+
+    //regions of the image finished since the last call, merged per tile row
+    void drain_completed_tiles(std::vector<tile>& regions)
+    {
+        completed_tiles.drain(regions);
+    }
+
+    [[nodiscard]] bool is_progressive() const
+    {
+        return progressive;
+    }
+
+    //the sequence used for the path samples, a change restarts the accumulation
+    void set_sampler_type(const sampler_type p_sampling)
+    {
+        cancel();
+        sampling = p_sampling;
+        scene.reset_accumulation();
+    }
+
     void precompute_directions()
     {
         for (uint32_t y = scene.vertical_pixel_count(); y > 0; --y)
@@ -122,13 +378,200 @@ public:
         }
     }
 
+    [[nodiscard]] size_t thread_count() const
+    {
+        return scheduler.worker_count();
+    }
+
+    [[nodiscard]] std::vector<worker_stats> get_worker_stats() const
+    {
+        return scheduler.get_worker_stats();
+    }
+
+    void reset_worker_stats()
+    {
+        scheduler.reset_worker_stats();
+    }
+
+    //counters of the workers since they were last reset and wall times of the tiles of the last frame, once it is done
+    [[nodiscard]] render_stats get_stats() const
+    {
+        render_stats stats;
+        stats.workers = scheduler.get_worker_stats();
+        stats.tiles.reserve(tiles.size());
+        for (uint32_t tile_index = 0; tile_index < tiles.size(); ++tile_index)
+        {
+            stats.tiles.push_back({tiles[tile_index].x_begin, tiles[tile_index].y_begin, tile_milliseconds[tile_index]});
+        }
+        return stats;
+    }
+
 private:
-    size_t max_threads = std::thread::hardware_concurrency() - 2;
+    [[nodiscard]] tile full_image() const
+    {
+        return {0, 0, scene.horizontal_pixel_count(), scene.vertical_pixel_count()};
+    }
+
+    [[nodiscard]] bool overlaps_region(const tile& p_tile) const
+    {
+        return p_tile.x_begin < region.x_end && region.x_begin < p_tile.x_end && p_tile.y_begin < region.y_end && region.y_begin < p_tile.y_end;
+    }
+
+    [[nodiscard]] tile clip_to_region(const tile& p_tile) const
+    {
+        return {std::max(p_tile.x_begin, region.x_begin), std::max(p_tile.y_begin, region.y_begin), std::min(p_tile.x_end, region.x_end),
+                std::min(p_tile.y_end, region.y_end)};
+    }
+
+    //a region covering the image also restarts the pass count
+    void reset_region() const
+    {
+        const tile full = full_image();
+        if (region.x_begin == full.x_begin && region.y_begin == full.y_begin && region.x_end == full.x_end && region.y_end == full.y_end)
+            scene.reset_accumulation();
+        else
+            scene.reset_accumulation(region.x_begin, region.y_begin, region.x_end, region.y_end);
+    }
+
+    //the next frames render the levels of a preview, starting from the finest one expected to fit in the frame budget
+    void start_preview()
+    {
+        uint32_t block{1};
+        if (preview)
+        {
+            const auto region_pixels = static_cast<float>((region.x_end - region.x_begin) * (region.y_end - region.y_begin));
+            block = max_preview_block;
+            while (block > 1 && pixel_milliseconds > 0.0f && pixel_milliseconds * region_pixels / static_cast<float>(block * block / 4) <= frame_budget_milliseconds)
+            {
+                block /= 2;
+            }
+        }
+        next_preview_block = block;
+        preview_start_block = block;
+    }
+
+    //wall time per pixel traced by the last frame, its tile times spread over the workers
+    void measure_pixel_cost()
+    {
+        const uint32_t traced = traced_pixels.exchange(0, std::memory_order_relaxed);
+        if (traced == 0)
+            return;
+        float busy_milliseconds{0.0f};
+        for (const float milliseconds: tile_milliseconds)
+        {
+            busy_milliseconds += milliseconds;
+        }
+        pixel_milliseconds = busy_milliseconds / static_cast<float>(scheduler.worker_count()) / static_cast<float>(traced);
+    }
+
+    //frames run the active tiles, the jobs of run_tiles all of them
+    void run_tile(const uint32_t index)
+    {
+        if (tile_job != nullptr)
+            (*tile_job)(tiles[index]);
+        else
+            render_tile(active_tiles[index]);
+    }
+
+    //tiles keep sampling until they hold enough samples to measure their error and the error meets the target
+    [[nodiscard]] bool needs_samples(const uint32_t tile_index) const
+    {
+        if (!progressive || target_error <= 0.0f)
+            return true;
+        const tile p_tile = clip_to_region(tiles[tile_index]);
+        return scene.sample_count_at(p_tile.y_begin * scene.horizontal_pixel_count() + p_tile.x_begin) < min_adaptive_samples ||
+               tile_errors[tile_index] > target_error;
+    }
+
+    //mean relative error of the pixels of the tile
+    [[nodiscard]] float tile_error(const tile& p_tile) const
+    {
+        const uint32_t width = scene.horizontal_pixel_count();
+        float error_sum{0.0f};
+        for (uint32_t y = p_tile.y_begin; y < p_tile.y_end; ++y)
+        {
+            for (uint32_t x = p_tile.x_begin; x < p_tile.x_end; ++x)
+            {
+                error_sum += scene.relative_error_at(y * width + x);
+            }
+        }
+        return error_sum / static_cast<float>((p_tile.x_end - p_tile.x_begin) * (p_tile.y_end - p_tile.y_begin));
+    }
+
+    //stops the frame in flight, the tiles not started yet are skipped and none of the frame is reported as completed,
+    //the samples it accumulated so far are inconsistent so callers reset the accumulation afterwards
+    void cancel()
+    {
+        cancelled.store(true, std::memory_order_relaxed);
+        scheduler.wait();
+        completed_tiles.clear();
+    }
+
+    static float radical_inverse(uint32_t index, const uint32_t base)
+    {
+        float result = 0.0f;
+        float fraction = 1.0f / static_cast<float>(base);
+        for (; index > 0; index /= base)
+        {
+            result += static_cast<float>(index % base) * fraction;
+            fraction /= static_cast<float>(base);
+        }
+        return result;
+    }
+
+    //Halton (2, 3) point of the pass inside the pixel, so successive passes cover the pixel area evenly
+    vec3 subpixel_offset(const uint32_t pass) const
+    {
+        return {(radical_inverse(pass, 2) - 0.5f) / static_cast<float>(scene.horizontal_pixel_count()),
+                (radical_inverse(pass, 3) - 0.5f) / static_cast<float>(scene.vertical_pixel_count()), 0.0f};
+    }
+
+    //8x8 tiles in Z-order so neighbouring tiles, which touch the same geometry, run close in time and on the same worker
+    void build_tiles()
+    {
+        const uint32_t width = scene.horizontal_pixel_count();
+        const uint32_t height = scene.vertical_pixel_count();
+        for (uint32_t y = 0; y < height; y += work_unit_pixels)
+        {
+            for (uint32_t x = 0; x < width; x += work_unit_pixels)
+            {
+                tiles.push_back({x, y, std::min(width, x + work_unit_pixels), std::min(height, y + work_unit_pixels)});
+            }
+        }
+        std::sort(tiles.begin(), tiles.end(), [](const tile& a, const tile& b) {
+            return morton_code(a.x_begin / work_unit_pixels, a.y_begin / work_unit_pixels) <
+                   morton_code(b.x_begin / work_unit_pixels, b.y_begin / work_unit_pixels);
+        });
+    }
 
-    std::queue<std::function<void()>> compute_units;
     static constexpr uint32_t work_unit_pixels{8};
     const i_scene& scene;
     std::vector<vec3> precomputed_directions;
+    std::vector<tile> tiles;
+    completed_tile_queue completed_tiles;
+    std::atomic<bool> cancelled{false};
+    bool progressive{false};
+    sampler_type sampling{sampler_type::random};
+    camera_features frame_camera{}; //of the camera when the frame started, picks the ray generation of its pixels
+    //the error estimate of a few samples is itself too noisy to stop on
+    static constexpr uint32_t min_adaptive_samples{8};
+    float target_error{0.0f};
+    std::vector<float> tile_errors;
+    std::vector<float> tile_milliseconds; //0 for the tiles the last frame did not render
+    std::vector<uint32_t> active_tiles;
+    tile region{};
+    //block size of the levels of the preview, the first one renders one pixel in 8x8
+    static constexpr uint32_t max_preview_block{8};
+    bool preview{false};
+    float frame_budget_milliseconds{1000.0f / 30.0f};
+    uint32_t next_preview_block{1};
+    uint32_t preview_start_block{1}; //block of the first level of the preview in progress, 1 without one
+    uint32_t frame_block{1};
+    bool frame_reuses_preview{false}; //the frame skips the pixels the level before traced
+    mutable std::atomic<uint32_t> traced_pixels{0}; //counted by the const preview path too
+    float pixel_milliseconds{0.0f}; //0 until a frame was measured
+    const std::function<void(const tile&)>* tile_job{nullptr}; //set by run_tiles, the frame renders otherwise
 
-    ThreadPool pool;
+    //last so the workers are joined before the data they read is destroyed
+    tile_scheduler scheduler;
 };
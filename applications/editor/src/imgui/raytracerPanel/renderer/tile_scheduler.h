@@ -0,0 +1,254 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "render_stats.h"
+
+//Chase–Lev work stealing deque over tile indices. The owner pops from the bottom, thieves steal from the top.
+//Items are only pushed between frames while no worker runs, so the buffer never grows nor wraps around.
+class work_stealing_deque
+{
+public:
+    void reset(const uint32_t capacity)
+    {
+        items.assign(capacity, 0);
+        top.store(0, std::memory_order_relaxed);
+        bottom.store(0, std::memory_order_relaxed);
+    }
+
+    void push(const uint32_t item)
+    {
+        const int64_t b = bottom.load(std::memory_order_relaxed);
+        items[static_cast<size_t>(b)] = item;
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+
+    bool pop(uint32_t& item)
+    {
+        const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+
+        if (t > b)
+        {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        item = items[static_cast<size_t>(b)];
+        if (t == b)
+        {
+            //last item, race against the thieves for it
+            const bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    bool steal(uint32_t& item)
+    {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+            return false;
+
+        item = items[static_cast<size_t>(t)];
+        return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+private:
+    //owner and thieves write different ends, keep them on different cache lines
+    alignas(64) std::atomic<int64_t> top{0};
+    alignas(64) std::atomic<int64_t> bottom{0};
+    std::vector<uint32_t> items;
+};
+
+//Runs frames of tiles on a fixed set of workers. Each frame, the tiles (already in a cache friendly order) are split
+//into one contiguous chunk per worker; a worker renders its own chunk in order and steals from the far end of the
+//others' chunks once it runs out. The last finished tile completes the frame's future.
+class tile_scheduler
+{
+public:
+    tile_scheduler(const size_t p_worker_count, std::function<void(uint32_t)> p_run_tile)
+        : run_tile(std::move(p_run_tile)), deques(std::max<size_t>(1, p_worker_count)), stats(deques.size())
+    {
+        for (size_t i = 0; i < deques.size(); ++i)
+        {
+            workers.emplace_back([this, i] { work(static_cast<uint32_t>(i)); });
+        }
+    }
+
+    tile_scheduler(const tile_scheduler&) = delete;
+    tile_scheduler& operator=(const tile_scheduler&) = delete;
+
+    ~tile_scheduler()
+    {
+        wait();
+        {
+            std::unique_lock<std::mutex> lock(frame_mutex);
+            stop = true;
+        }
+        frame_started.notify_all();
+        for (std::thread& worker: workers)
+            worker.join();
+    }
+
+    //Starts rendering tiles [0, tile_count), waiting for the previous frame first. The deques are filled, the tile
+    //count stored and the epoch bumped in one critical section once no worker is busy: a worker only takes tiles after
+    //joining a frame under the same lock, so a late one never sees a deque being refilled or a count being reset.
+    std::shared_future<void> run(const uint32_t tile_count)
+    {
+        wait();
+
+        std::promise<void> done;
+        std::shared_future<void> future = done.get_future().share();
+        if (tile_count == 0)
+        {
+            done.set_value();
+            return frame = future;
+        }
+
+        {
+            //late workers may still be looking for tiles to steal in the finished frame
+            std::unique_lock<std::mutex> lock(frame_mutex);
+            workers_idle.wait(lock, [this] { return busy_workers == 0; });
+
+            const auto worker_count = static_cast<uint32_t>(deques.size());
+            const uint32_t chunk = (tile_count + worker_count - 1) / worker_count;
+            for (uint32_t w = 0; w < worker_count; ++w)
+            {
+                const uint32_t begin = std::min(tile_count, w * chunk);
+                const uint32_t end = std::min(tile_count, begin + chunk);
+                deques[w].reset(end - begin);
+                //pushed backwards so the owner pops its chunk front to back
+                for (uint32_t tile = end; tile > begin; --tile)
+                {
+                    deques[w].push(tile - 1);
+                }
+            }
+
+            frame_done = std::move(done);
+            remaining_tiles.store(tile_count, std::memory_order_relaxed);
+            ++frame_epoch;
+        }
+        frame_started.notify_all();
+        return frame = future;
+    }
+
+    void wait() const
+    {
+        if (frame.valid())
+            frame.wait();
+    }
+
+    [[nodiscard]] size_t worker_count() const { return workers.size(); }
+
+    //to read or reset between frames only, each worker writes its own entry while it runs
+    [[nodiscard]] std::vector<worker_stats> get_worker_stats() const
+    {
+        wait();
+        std::vector<worker_stats> result;
+        result.reserve(stats.size());
+        for (const padded_worker_stats& worker: stats)
+            result.push_back(worker.stats);
+        return result;
+    }
+
+    void reset_worker_stats()
+    {
+        wait();
+        for (padded_worker_stats& worker: stats)
+            worker.stats = {};
+    }
+
+private:
+    void work(const uint32_t worker_index)
+    {
+        uint64_t seen_epoch{0};
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(frame_mutex);
+                frame_started.wait(lock, [&] { return stop || frame_epoch != seen_epoch; });
+                if (stop)
+                    return;
+                seen_epoch = frame_epoch;
+                ++busy_workers;
+            }
+
+            worker_stats& own_stats = stats[worker_index].stats;
+            uint32_t tile;
+            bool stolen{false};
+            while (deques[worker_index].pop(tile) || (stolen = steal(worker_index, tile)))
+            {
+                const ray_counters counters_before = thread_counters;
+                const auto start = std::chrono::steady_clock::now();
+                run_tile(tile);
+                own_stats.busy_milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                own_stats.counters += thread_counters - counters_before;
+                ++own_stats.tiles;
+                own_stats.stolen_tiles += stolen;
+                stolen = false;
+                if (remaining_tiles.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                {
+                    frame_done.set_value();
+                }
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(frame_mutex);
+                --busy_workers;
+            }
+            workers_idle.notify_all();
+        }
+    }
+
+    //no tile is added during a frame, so once every deque looks empty there is nothing left to steal
+    bool steal(const uint32_t thief, uint32_t& tile)
+    {
+        const auto worker_count = static_cast<uint32_t>(deques.size());
+        for (uint32_t attempt = 0; attempt < 2; ++attempt)
+        {
+            for (uint32_t offset = 1; offset < worker_count; ++offset)
+            {
+                if (deques[(thief + offset) % worker_count].steal(tile))
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    //one cache line per worker so the counters do not false share
+    struct alignas(64) padded_worker_stats
+    {
+        worker_stats stats;
+    };
+
+    std::function<void(uint32_t)> run_tile;
+    std::vector<work_stealing_deque> deques;
+    std::vector<padded_worker_stats> stats;
+    std::vector<std::thread> workers;
+
+    std::mutex frame_mutex;
+    std::condition_variable frame_started;
+    std::condition_variable workers_idle;
+    uint64_t frame_epoch{0};
+    uint32_t busy_workers{0};
+    bool stop{false};
+
+    std::atomic<uint32_t> remaining_tiles{0};
+    std::promise<void> frame_done;
+    std::shared_future<void> frame;
+};
@@ -1,10 +1,32 @@
 #pragma once
+#include <cstdint>
+#include <vector>
+
+#include "glm/vec2.hpp"
 #include "glm/vec3.hpp"
 using point3 = glm::vec3;
 using color3 = glm::vec3;
 using vec3 = glm::vec3;
-struct Vertex
+
+//relative luminance of a linear rgb color
+inline float luminance(const color3& color)
 {
-    point3 position;
-    vec3 normal;
-};
\ No newline at end of file
+    return 0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b;
+}
+
+//what the camera ray of a pixel sees first, the guides of the denoiser
+struct pixel_features
+{
+    color3 albedo{0.0f, 0.0f, 0.0f};
+    vec3 normal{0.0f, 0.0f, 0.0f};
+    float depth{0.0f}; //0 when the ray escapes
+};
+
+//triangles indexing a shared vertex pool, three indices per triangle
+struct indexed_mesh
+{
+    std::vector<point3> positions;
+    std::vector<vec3> normals; //one per position
+    std::vector<glm::vec2> texcoords; //one per position, or empty for a mesh without texture coordinates
+    std::vector<uint32_t> indices;
+};
@@ -4,132 +4,117 @@
 //
 
 #include "renderer/scene/objects/box.h"
-#include "object_loader/tiny_obj_loader.h"
-void RayTracer::load()
-{
+#include "renderer/scene/objects/lights/environment_light.h"
+#include "renderer/scene/objects/materials/emissive.h"
+#include "renderer/scene/objects/mesh_cache.h"
+#include "object_loader/obj_stream_reader.h"
+#include "engine/stb_image.h"
+#include "glm/gtc/matrix_transform.hpp"
 
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <utility>
 
-    std::vector<std::vector<Vertex>> mesh_data;
+void RayTracer::load()
+{
 
-    const std::string p_file_name = "assets/test/teapot.obj";
 
-    tinyobj::ObjReaderConfig reader_config;
-    reader_config.mtl_search_path = "./";
+    const std::string& p_file_name = settings.scene_path;
 
-    tinyobj::ObjReader reader;
+    //the materials and their texture maps are looked up next to the obj file
+    const std::filesystem::path scene_directory = std::filesystem::path(p_file_name).parent_path();
 
-    if (!reader.ParseFromFile(p_file_name, reader_config))
+    //the mesh is moved in front of the camera, which the cache key covers along with the content of the obj
+    const vec3 mesh_offset{0.0f, -1.5f, -3.0f};
+    const auto cache_start = std::chrono::steady_clock::now();
+    uint64_t cache_key{0};
+    std::string cache_path;
+    if (settings.scene_cache && mesh_cache::source_key(p_file_name, hash_bytes(&mesh_offset, sizeof(mesh_offset), 0), cache_key))
     {
-        if (!reader.Error().empty())
-        {
-            std::cerr << "TinyObjReader: " << reader.Error();
-        }
-        exit(1);
+        const std::filesystem::path cache_directory =
+                settings.scene_cache_directory.empty() ? std::filesystem::temp_directory_path() / "raytracer_cache" : std::filesystem::path(settings.scene_cache_directory);
+        cache_path = mesh_cache::path_for(cache_directory, p_file_name, cache_key);
     }
-
-    if (!reader.Warning().empty())
+    const mesh_cache cache{cache_path, cache_key};
+    if (cache.is_valid())
     {
-        std::cout << "TinyObjReader: " << reader.Warning();
+        std::cout << "Scene cache " << cache_path << ": obj hashed and cache mapped in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cache_start).count() << " ms" << std::endl;
     }
 
-    auto& attrib = reader.GetAttrib();
-    auto& shapes = reader.GetShapes();
-    for (const auto& shape: shapes)
+    indexed_mesh mesh_data;
+    std::string material_texture = cache.get_texture_name();
+    if (!cache.is_valid())
     {
-        size_t index_offset = 0;
-        for (size_t f = 0; f < shape.mesh.num_face_vertices.size(); f++)
+        const auto parse_start = std::chrono::steady_clock::now();
+        obj_stream_reader reader{settings.thread_count};
+        if (!reader.load(p_file_name, mesh_data))
+        {
+            std::cerr << "OBJ reader: " << reader.error() << std::endl;
+            exit(1);
+        }
+        if (!reader.warning().empty())
         {
-            const size_t fv = shape.mesh.num_face_vertices[f];
+            std::cout << "OBJ reader: " << reader.warning();
+        }
+        std::cout << "OBJ " << p_file_name << ": " << reader.get_file_bytes() / (1024 * 1024) << " MiB in " << reader.get_chunk_count() << " chunks on "
+                  << std::min(reader.get_chunk_count(), reader.get_thread_count()) << " threads, read in "
+                  << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - parse_start).count() << " ms" << std::endl;
 
-            point3 vertex{};
-            std::vector<Vertex> vertices;
-            for (size_t v = 0; v < fv; v++)
+        for (point3& position: mesh_data.positions)
+        {
+            position += mesh_offset;
+        }
+        for (const auto& material: reader.get_materials())
+        {
+            if (!material.diffuse_texname.empty())
             {
-                const tinyobj::index_t idx = shape.mesh.indices[index_offset + v];
-                vertex.x = attrib.vertices[3 * static_cast<size_t>(idx.vertex_index) + 0];
-                vertex.y = attrib.vertices[3 * static_cast<size_t>(idx.vertex_index) + 1] - 1.5f;
-                vertex.z = attrib.vertices[3 * static_cast<size_t>(idx.vertex_index) + 2] - 3.0f;
-
-                vec3 normal;
-                if (idx.normal_index >= 0)
-                {
-                    normal.x = attrib.normals[3 * static_cast<size_t>(idx.normal_index) + 0];
-                    normal.y = attrib.normals[3 * static_cast<size_t>(idx.normal_index) + 1];
-                    normal.z = attrib.normals[3 * static_cast<size_t>(idx.normal_index) + 2];
-                }
-
-                vertices.emplace_back(Vertex{vertex, normal});
+                material_texture = material.diffuse_texname;
+                break;
             }
-            mesh_data.emplace_back(vertices);
-
-            index_offset += fv;
         }
     }
 
+    indexed_mesh floor_data;
+    floor_data.positions = {
+            {5.5, -2, -5.5}, {-5.5, -2, -5.5}, {-5.5, -2, 5},
+            {5.5, -2, -5.5}, {-5.5, -2, 5}, {5.5, -2, 5},
+            {5.5, -2, -5.5}, {5.5, -2, 5}, {5.5, 11, -5.5}};
 
-    std::vector<std::vector<Vertex>> floor_triangles;
-    std::vector<point3> tri;
-    std::vector<point3> tri2;
-    std::vector<point3> tri3;
-
-    tri.emplace_back(5.5, -2, -5.5);
-    tri.emplace_back(-5.5, -2, -5.5);
-    tri.emplace_back(-5.5, -2, 5);
-    tri2.emplace_back(5.5, -2, -5.5);
-    tri2.emplace_back(-5.5, -2, 5);
-    tri2.emplace_back(5.5, -2, 5);
-    tri3.emplace_back(5.5, -2, -5.5);
-    tri3.emplace_back(5.5, -2, 5);
-    tri3.emplace_back(5.5, 11, -5.5);
-
-    std::vector<Vertex> triangle1;
-    std::vector<Vertex> triangle2;
-    std::vector<Vertex> triangle3;
-    for (const auto& point: tri3)
-    {
-        triangle3.emplace_back(Vertex{point, vec3(0, 1, 0)});
-    }
-    for (const auto& point: tri)
-    {
-        triangle1.emplace_back(Vertex{point, vec3(0, 1, 0)});
-    }
-
-    for (const auto& point: tri2)
-    {
-        triangle2.emplace_back(Vertex{point, vec3(0, 1, 0)});
-    }
-
-    floor_triangles.emplace_back(triangle1);
-    floor_triangles.emplace_back(triangle2);
-    floor_triangles.emplace_back(triangle3);
-
-    std::vector<vec3> floor_normals;
-
-    for (const auto& triangle: floor_triangles)
+    // flat shaded, each triangle keeps its own vertices with the face normal
+    for (uint32_t i = 0; i < floor_data.positions.size(); i += 3)
     {
-        vec3 edge1 = triangle[1].position - triangle[0].position;
-        vec3 edge2 = triangle[2].position - triangle[0].position;
+        vec3 edge1 = floor_data.positions[i + 1] - floor_data.positions[i];
+        vec3 edge2 = floor_data.positions[i + 2] - floor_data.positions[i];
 
         vec3 normal = normalize(glm::cross(edge1, edge2));
 
-        floor_normals.push_back(normal);
-    }
-    for (auto& [position, normal]: triangle1)
-    {
-        normal = floor_normals[0];
+        floor_data.normals.insert(floor_data.normals.end(), {normal, normal, normal});
+        floor_data.indices.insert(floor_data.indices.end(), {i, i + 1, i + 2});
     }
 
-    for (auto& [position, normal]: triangle2)
-    {
-        normal = floor_normals[1];
-    }
-    for (auto& [position, normal]: triangle3)
+    // emissive panel above the teapot, sampled as an area light
+    indexed_mesh lamp_data;
+    lamp_data.positions = {{-1.0f, 4.0f, -3.5f}, {1.0f, 4.0f, -3.5f}, {1.0f, 4.0f, -2.0f}, {-1.0f, 4.0f, -2.0f}};
+    lamp_data.normals = {{0, -1, 0}, {0, -1, 0}, {0, -1, 0}, {0, -1, 0}};
+    lamp_data.indices = {0, 2, 1, 0, 3, 2};
+
+    //the mesh is painted with the texture given in the settings, or the diffuse map of the first material of the obj
+    //using one, which needs texture coordinates to be read
+    std::string texture_path = settings.texture_path;
+    if (texture_path.empty() && !material_texture.empty())
     {
-        normal = floor_normals[2];
+        texture_path = (scene_directory / material_texture).string();
     }
+    const i_texture* mesh_texture = texture_path.empty() ? nullptr : load_texture(texture_path);
+    const bool textured_mesh = mesh_texture != nullptr;
 
     //scene init
-    const i_texture* mesh_texture = new base_color{new color3{0.5f, 0.0f, 0.0f}};
+    if (mesh_texture == nullptr)
+    {
+        mesh_texture = new base_color{new color3{0.5f, 0.0f, 0.0f}};
+    }
     const i_texture* floor_texture = new checker{new color3{0.1f, 0.1f, 0.1f}, new color3{1, 1, 1}};
     const i_texture* sphere_texture = new base_color{new const color3{1.0f, 1.0f, 1.0f}};
     const i_texture* sphere_texture2 = new base_color{new const color3{0.0f, 0.6f, 0.0f}};
@@ -139,7 +124,8 @@ void RayTracer::load()
     const i_material* floor_material = new metal{floor_texture, 0.0f, 0.01f};
     const i_material* box_material = new metal{sphere_texture2, 0.0f, 0.0f};
     const i_material* sphere_material2 = new metal{sphere_texture3, 0.0f, 0};
-    const i_material* sphere_material3 = new glass{sphere_texture, 1.52f, 75.0f};
+    const i_material* sphere_material3 = new glass{sphere_texture, 1.52f, 75.0f, settings.glass_abbe_number};
+    const i_material* lamp_material = new emissive{{2.0f, 2.0f, 2.0f}};
 
     const i_light* light = new point_light({-5.0f, 2.0f, -1.0f}, {1, 1, 1}, 0.5f);
     const i_light* light2 = new point_light({-1.0f, 2.0f, 0.0f}, {1, 1, 1}, 1.0f);
@@ -148,19 +134,179 @@ void RayTracer::load()
     //scene_objects.add_object(new sphere{{1.5f, 1.3f, -3.2f}, 0.3f, sphere_material2});
     //scene_objects.add_object(new sphere{{-1.5f, 0.7f, -2.2f}, 0.3f, sphere_material3});
     scene_objects.add_object(new box{{4.5f, -1.9f, -1.0f}, {5.3f, 8.0f, -2.8f}, box_material});
-    scene_objects.add_object(new triangle_mesh{mesh_material, static_cast<int>(mesh_data.size()), mesh_data});
-
-    scene_objects.add_object(new triangle_mesh{
-            floor_material, static_cast<int>(floor_triangles.size()), floor_triangles});
+    //the mesh takes over the vertex attributes and the indexed copy of the positions is freed once it is built
+    triangle_mesh* mesh = cache.is_valid() ? cache.create_mesh(mesh_material) : new triangle_mesh{mesh_material, std::move(mesh_data)};
+    if (!cache.is_valid() && !cache_path.empty())
+    {
+        const auto write_start = std::chrono::steady_clock::now();
+        if (mesh_cache::write(cache_path, cache_key, *mesh, material_texture))
+            std::cout << "Scene cache " << cache_path << ": written in "
+                      << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - write_start).count() << " ms" << std::endl;
+        else
+            std::cerr << "Scene cache " << cache_path << ": could not be written" << std::endl;
+    }
+    if (textured_mesh && !mesh->has_texture_coordinates())
+    {
+        std::cerr << "Texture " << texture_path << ": " << p_file_name << " has no texture coordinates" << std::endl;
+    }
+    auto* floor_mesh = new triangle_mesh{floor_material, floor_data};
+    std::cout << "BVH " << p_file_name << ": " << mesh->get_bvh().get_build_stats() << std::endl;
+    std::cout << "Mesh " << p_file_name << ": " << mesh->get_triangle_count() << " triangles, "
+              << mesh->get_vertex_count() << " pooled vertices, " << mesh->memory_bytes() / 1024 << " KiB" << std::endl;
+    for (const triangle_kernel_type type: {triangle_kernel_type::scalar, triangle_kernel_type::sse, triangle_kernel_type::avx2})
+    {
+        if (settings.benchmark && triangle_kernel_supported(type))
+        {
+            const aabb mesh_bounds = mesh->bounds();
+            //the rate is measured on the first triangles, a large mesh would take longer to benchmark than to load
+            const uint32_t benchmark_triangles = std::min(mesh->get_triangle_count(), 1u << 16);
+            std::cout << "Triangle kernel " << benchmark_triangle_kernel(type, mesh->arrays(), benchmark_triangles, mesh_bounds.min, mesh_bounds.max, 256)
+                      << (type == best_triangle_kernel_type() ? " [active]" : "") << std::endl;
+        }
+    }
+    if (settings.mesh_instances > 0)
+    {
+        place_mesh_instances(scene_objects.add_shared_mesh(mesh), settings.mesh_instances);
+    }
+    else if (settings.mesh_motion != vec3{0.0f, 0.0f, 0.0f})
+    {
+        place_moving_mesh(scene_objects.add_shared_mesh(mesh), glm::mat4(1.0f));
+    }
+    else
+    {
+        scene_objects.add_object(mesh);
+    }
+    scene_objects.add_object(floor_mesh);
+    scene_objects.add_object(new triangle_mesh{lamp_material, lamp_data});
 
     scene_objects.add_light(light);
     //  scene_objects.add_light(light2);
+    if (!settings.environment_path.empty())
+    {
+        load_environment(settings.environment_path);
+    }
+
+    scene_objects.build_acceleration_structure();
+    std::cout << "BVH scene: " << scene_objects.get_bvh().get_build_stats() << std::endl;
+}
+
+//rows of scaled down copies standing on the floor in front of the camera, they all share the triangles of the mesh
+void RayTracer::place_mesh_instances(const triangle_mesh* p_mesh, const uint32_t p_count)
+{
+    const point3 grid_min{-4.5f, -2.0f, -5.0f};
+    const point3 grid_max{4.5f, -2.0f, -1.0f};
+    const auto columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(p_count))));
+    const uint32_t rows = (p_count + columns - 1) / columns;
+    const float cell_width = (grid_max.x - grid_min.x) / static_cast<float>(columns);
+    const float cell_depth = (grid_max.z - grid_min.z) / static_cast<float>(rows);
+
+    const aabb mesh_bounds = p_mesh->bounds();
+    const vec3 extent = mesh_bounds.max - mesh_bounds.min;
+    const float scale = 0.8f * std::min(cell_width, cell_depth) / std::max(extent.x, std::max(extent.y, extent.z));
+    const glm::mat4 to_base = glm::translate(glm::mat4(1.0f), -point3{mesh_bounds.centroid().x, mesh_bounds.min.y, mesh_bounds.centroid().z});
+    for (uint32_t i = 0; i < p_count; ++i)
+    {
+        const point3 base{grid_min.x + (static_cast<float>(i % columns) + 0.5f) * cell_width, grid_min.y,
+                          grid_min.z + (static_cast<float>(i / columns) + 0.5f) * cell_depth};
+        const glm::mat4 transform = glm::scale(glm::translate(glm::mat4(1.0f), base), vec3{scale}) * to_base;
+        if (settings.mesh_motion != vec3{0.0f, 0.0f, 0.0f})
+            place_moving_mesh(p_mesh, transform);
+        else
+            scene_objects.add_object(new mesh_instance{p_mesh, transform});
+    }
+    std::cout << "Instances: " << p_count << " copies of " << p_mesh->memory_bytes() / 1024 << " KiB of triangles, "
+              << p_count * sizeof(mesh_instance) / 1024 << " KiB of instances" << std::endl;
 }
-RayTracer::RayTracer() : rgb_image(
-                                 3, 1920 * 1, 1080 * 1, 3)
 
+//the mesh travels by the scene mesh motion from where the transform places it while the shutter is open
+void RayTracer::place_moving_mesh(const triangle_mesh* p_mesh, const glm::mat4& p_transform)
 {
+    const glm::mat4 end_transform = glm::translate(glm::mat4(1.0f), settings.mesh_motion) * p_transform;
+    scene_objects.add_object(new moving_mesh_instance{p_mesh, p_transform, end_transform});
+}
+
+const i_texture* RayTracer::load_texture(const std::string& p_file_name)
+{
+    int width, height, channels;
+    uint8_t* data = stbi_load(p_file_name.c_str(), &width, &height, &channels, 3);
+    if (data == nullptr)
+    {
+        std::cerr << "Texture " << p_file_name << ": " << stbi_failure_reason() << std::endl;
+        return nullptr;
+    }
+
+    const auto* texture = new image_texture{data, static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+    stbi_image_free(data);
+    std::cout << "Texture " << p_file_name << ": " << width << "x" << height << ", " << texture->get_level_count() << " mip levels, "
+              << texture->memory_bytes() / 1024 << " KiB" << std::endl;
+    return texture;
+}
+
+void RayTracer::load_environment(const std::string& p_file_name)
+{
+    int width, height, channels;
+    float* data = stbi_loadf(p_file_name.c_str(), &width, &height, &channels, 3);
+    if (data == nullptr)
+    {
+        std::cerr << "Environment " << p_file_name << ": " << stbi_failure_reason() << std::endl;
+        return;
+    }
+
+    std::vector<color3> texels(static_cast<size_t>(width) * height);
+    for (size_t i = 0; i < texels.size(); ++i)
+    {
+        texels[i] = {data[3 * i + 0], data[3 * i + 1], data[3 * i + 2]};
+    }
+    stbi_image_free(data);
+
+    scene_objects.set_environment(new environment_light{std::move(texels), static_cast<uint32_t>(width), static_cast<uint32_t>(height)});
+    std::cout << "Environment " << p_file_name << ": " << width << "x" << height << std::endl;
+}
+
+void RayTracer::report_traversal() const
+{
+    //closest hit queries for a grid of primary rays, timed without any shading
+    constexpr uint32_t probe_width = 192;
+    constexpr uint32_t probe_height = 108;
+    uint32_t hits{0};
+
+    const auto start = std::chrono::steady_clock::now();
+    for (uint32_t y = 0; y < probe_height; ++y)
+    {
+        for (uint32_t x = 0; x < probe_width; ++x)
+        {
+            const ray probe_ray = camera.cast_ray({(0.5f + x) / probe_width, (0.5f + y) / probe_height, 0.0f});
+            surface_hit hit;
+            hits += scene_objects.get_compiled_scene().intersect(probe_ray, hit);
+        }
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    constexpr uint32_t probe_rays = probe_width * probe_height;
+    std::cout << "BVH traversal: " << probe_rays << " primary rays (" << hits << " hits) in " << seconds * 1000.0
+              << " ms, " << probe_rays / seconds / 1.0e6 << " Mrays/s" << std::endl;
+}
+RayTracer::RayTracer() : RayTracer(ray_tracer_settings{})
+{
+}
+
+RayTracer::RayTracer(const ray_tracer_settings& p_settings) : settings(p_settings),
+                                                              image(3, p_settings.width, p_settings.height, p_settings.max_rays)
+
+{
+    image.set_tone_mapping(settings.tone_mapping_operator, settings.exposure);
+    camera.set_lens(settings.aperture, settings.focus_distance);
+    if (settings.mesh_motion != vec3{0.0f, 0.0f, 0.0f})
+    {
+        camera.set_shutter(0.0f, 1.0f);
+    }
+    const auto start = std::chrono::steady_clock::now();
     load();
-    auto camera = positionable_camera({0.0f, 2.5f, 0.0f}, {0, 1.5f, -1}, {0, 1, 0}, 90, 16.0f / 9.0f);
-    scene = basic_scene{rgb_image, camera, scene_objects};
+    load_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    scene_objects.set_samples_per_pixel(settings.samples_per_pixel);
+    renderer.set_target_error(settings.target_error);
+    if (settings.benchmark)
+    {
+        report_traversal();
+    }
 }
@@ -4,9 +4,13 @@
 
 #pragma once
 
+#include <chrono>
+#include <functional>
+#include <future>
 #include <iostream>
 #include <string>
 
+#include "renderer/denoiser.h"
 #include "renderer/scene/basic_scene.h"
 #include "renderer/scene/camera/i_camera.h"
 #include "renderer/scene/camera/positionable_camera.h"
@@ -19,28 +23,184 @@
 #include "renderer/scene/objects/materials/metal.h"
 #include "renderer/scene/objects/materials/textures/base_color.h"
 #include "renderer/scene/objects/materials/textures/checker.h"
+#include "renderer/scene/objects/materials/textures/image_texture.h"
+#include "renderer/scene/objects/mesh_instance.h"
+#include "renderer/scene/objects/moving_mesh_instance.h"
 #include "renderer/scene/objects/sphere.h"
 #include "renderer/scene/objects/triangle_mesh.h"
 #include "renderer/threaded_cpu_renderer.h"
 
+struct ray_tracer_settings
+{
+    std::string scene_path{"assets/test/teapot.obj"};
+    std::string environment_path{}; //latitude-longitude .hdr image lighting the scene, a constant background without one
+    std::string texture_path{}; //image painted on the scene mesh, the diffuse map of its obj material when empty
+    bool scene_cache{true}; //maps the scene mesh and its BVH from a cache file written by an earlier run on the same obj
+    std::string scene_cache_directory{}; //raytracer_cache in the temporary directory of the system when empty
+    uint32_t width{1920};
+    uint32_t height{1080};
+    uint32_t max_rays{3};
+    uint32_t samples_per_pixel{16};
+    size_t thread_count{0}; //0 uses every hardware thread
+    uint32_t mesh_instances{0}; //copies of the scene mesh placed on a grid over the floor by instancing, 0 places it once
+    float target_error{0.0f}; //relative error at which progressive rendering stops refining a tile, 0 never stops
+    double time_budget_milliseconds{0.0}; //progressive rendering stops after this long, 0 never stops
+    point3 look_from{0.0f, 2.5f, 0.0f};
+    point3 look_at{0.0f, 1.5f, -1.0f};
+    float aperture{0.0f}; //diameter of the camera lens, 0 is a pinhole keeping everything in focus
+    float focus_distance{0.0f}; //distance from the camera to the plane in focus, 0 focuses on look_at
+    vec3 mesh_motion{0.0f, 0.0f, 0.0f}; //distance the scene mesh travels while the shutter is open, 0 keeps it still
+    tone_mapping tone_mapping_operator{tone_mapping::clamp}; //maps the running average of a pixel to the display
+    float exposure{1.0f}; //scales the radiance before it is tonemapped
+    bool benchmark{false}; //times the triangle kernels and the BVH traversal once the scene is loaded and prints the rates
+    float glass_abbe_number{0.0f}; //dispersion of the glass sphere, lower splits the colors more, 0 does not disperse
+};
+
 class RayTracer
 {
 
 public:
     RayTracer();
+    explicit RayTracer(const ray_tracer_settings& p_settings);
     int run()
     {
-            renderer.render(current_compute_unit);
-
+        if (samples_per_pixel() == 0)
+        {
+            accumulation_start = std::chrono::steady_clock::now();
+        }
+        frame = renderer.render();
 
         return 1;
     }
-    uint32_t current_compute_unit = 1;
-    rgb_image rgb_image;
+    //true once the frame started by the last run() is fully written to image
+    bool frame_done() const
+    {
+        return frame.valid() && frame.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+    void wait_for_frame() const
+    {
+        if (frame.valid())
+            frame.wait();
+    }
+    //progressive frames trace one path per pixel and average successive run() calls in image
+    void set_progressive(const bool p_progressive)
+    {
+        renderer.set_progressive(p_progressive);
+        scene_objects.set_samples_per_pixel(p_progressive ? 1 : settings.samples_per_pixel);
+    }
+    bool is_progressive() const
+    {
+        return renderer.is_progressive();
+    }
+    //progressive rendering is done once every tile reached the target error or the time budget since the accumulation
+    //restarted is spent, to check once the frame is done
+    bool converged() const
+    {
+        return renderer.converged() ||
+               (renderer.is_progressive() && time_budget_milliseconds > 0.0 && samples_per_pixel() > 0 &&
+                std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - accumulation_start).count() >=
+                        time_budget_milliseconds);
+    }
+    void set_target_error(const float p_target_error)
+    {
+        renderer.set_target_error(p_target_error);
+    }
+    void set_time_budget(const double p_milliseconds)
+    {
+        time_budget_milliseconds = p_milliseconds;
+    }
+    //cancels the frame in flight and starts accumulating again from the new point of view
+    void set_camera(const point3& look_from, const point3& look_at, const vec3& up = {0, 1, 0})
+    {
+        renderer.restart();
+        camera.set_view(look_from, look_at, up);
+    }
+    void set_field_of_view(const float vfov)
+    {
+        renderer.restart();
+        camera.set_field_of_view(vfov);
+    }
+    //depth of field, see positionable_camera::set_lens
+    void set_lens(const float aperture, const float focus_distance)
+    {
+        renderer.restart();
+        camera.set_lens(aperture, focus_distance);
+    }
+    //motion blur over the part of the motion of the objects the shutter stays open for, see positionable_camera::set_shutter
+    void set_shutter(const float open, const float close)
+    {
+        renderer.restart();
+        camera.set_shutter(open, close);
+    }
+    //cancels the frame in flight, lets edit change the objects and lights and compiles the scene again
+    void edit_scene(const std::function<void(object_manager&)>& edit)
+    {
+        renderer.restart();
+        edit(scene_objects);
+        scene_objects.build_acceleration_structure();
+    }
+    //regions of image finished since the last call, safe to read until the next run()
+    void take_completed_tiles(std::vector<tile>& regions)
+    {
+        renderer.drain_completed_tiles(regions);
+    }
+    //renders only a rectangle of image from now on, the rest keeps what it shows
+    void set_region(const tile& p_region)
+    {
+        renderer.set_region(p_region);
+    }
+    void clear_region()
+    {
+        renderer.clear_region();
+    }
+    //restarts show the image at a coarse resolution first and refine it over the next run() calls
+    void set_preview(const bool p_preview)
+    {
+        renderer.set_preview(p_preview);
+    }
+    //true while the next run() refines a preview, to keep running even once the image is otherwise done
+    bool preview_pending() const
+    {
+        return renderer.preview_pending();
+    }
+    void set_sampler_type(const sampler_type p_sampler_type)
+    {
+        renderer.set_sampler_type(p_sampler_type);
+    }
+    //tonemaps the display buffer again once the frame in flight is done, the accumulated samples are kept
+    void set_tone_mapping(const tone_mapping p_tone_mapping, const float p_exposure)
+    {
+        wait_for_frame();
+        image.set_tone_mapping(p_tone_mapping, p_exposure);
+        image.refresh_display();
+    }
+    uint32_t samples_per_pixel() const
+    {
+        return image.get_sample_count();
+    }
+    //replaces the display buffer of image by a filtered copy of the samples accumulated so far, once the frame is done
+    void denoise()
+    {
+        wait_for_frame();
+        denoiser.apply(image, renderer);
+    }
+    const ray_tracer_settings settings;
+    std::shared_future<void> frame;
+    rgb_image image;
     object_manager scene_objects;
-    positionable_camera camera = positionable_camera({0.0f, 2.5f, 0.0f}, {0, 1.5f, -1}, {0, 1, 0}, 90, 16.0f / 9.0f);
-    basic_scene scene = basic_scene{rgb_image, camera, scene_objects};
+    positionable_camera camera = positionable_camera(settings.look_from, settings.look_at, {0, 1, 0}, 90,
+                                                     static_cast<float>(settings.width) / static_cast<float>(settings.height));
+    basic_scene scene = basic_scene{image, camera, scene_objects};
 
-    threaded_cpu_renderer renderer = threaded_cpu_renderer{scene};
+    threaded_cpu_renderer renderer = threaded_cpu_renderer{scene, settings.thread_count};
+    atrous_denoiser denoiser;
+    double load_milliseconds{0.0};
+    double time_budget_milliseconds{settings.time_budget_milliseconds};
+    std::chrono::steady_clock::time_point accumulation_start{std::chrono::steady_clock::now()};
     void load();
+    void load_environment(const std::string& p_file_name);
+    static const i_texture* load_texture(const std::string& p_file_name);
+    void place_mesh_instances(const triangle_mesh* p_mesh, uint32_t p_count);
+    void place_moving_mesh(const triangle_mesh* p_mesh, const glm::mat4& p_transform);
+    void report_traversal() const;
 };
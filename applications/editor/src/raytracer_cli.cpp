@@ -0,0 +1,320 @@
+//
+// Headless front end of the CPU ray tracer, renders one image without a window and reports where the time went
+//
+#define TINYOBJLOADER_IMPLEMENTATION
+#define TINYOBJLOADER_USE_MAPBOX_EARCUT
+#include "imgui/raytracerPanel/object_loader/tiny_obj_loader.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "engine/stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "engine/stb_image_write.h"
+
+#include "imgui/raytracerPanel/rt.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace
+{
+void print_usage(const char* program)
+{
+    std::cout << "usage: " << program << " [options]\n"
+              << "  --scene <file.obj>   mesh to render (default assets/test/teapot.obj)\n"
+              << "  --environment <file.hdr> latitude-longitude environment lighting the scene (default none)\n"
+              << "  --texture <file>     image painted on the scene mesh (default the diffuse map of its obj material)\n"
+              << "  --scene-cache <dir>  directory of the scene mesh caches (default raytracer_cache in the temporary directory)\n"
+              << "  --no-scene-cache     reads and builds the scene mesh without reading or writing a cache\n"
+              << "  --instances <count>  copies of the scene mesh placed by instancing, 0 places it once (default 0)\n"
+              << "  --width <pixels>     image width (default 1920)\n"
+              << "  --height <pixels>    image height (default 1080)\n"
+              << "  --spp <count>        paths per pixel, the most a pixel gets in progressive mode (default 16)\n"
+              << "  --target-error <e>   renders progressively, sampling only the tiles whose relative error is above e\n"
+              << "  --time-budget <ms>   renders progressively, stopping after this long\n"
+              << "  --max-rays <count>   maximum path length (default 3)\n"
+              << "  --threads <count>    worker threads, 0 for every hardware thread (default 0)\n"
+              << "  --frames <count>     frames to render, the timings are averaged (default 1)\n"
+              << "  --output <file.png>  image written after the last frame (default raytracer.png)\n"
+              << "  --stats-json <file>  counters and timings of the render written as json\n"
+              << "  --region <x,y,w,h>   renders only this rectangle of the image, the rest stays black\n"
+              << "  --aperture <d>       diameter of the camera lens, blurs what is out of focus (default 0, a pinhole)\n"
+              << "  --focus-distance <d> distance from the camera to the plane in focus (default the distance to the camera target)\n"
+              << "  --motion <x,y,z>     distance the scene mesh travels while the shutter is open, blurring it (default still)\n"
+              << "  --tone-map <op>      clamp or reinhard, maps the radiance of each pixel to the image (default clamp)\n"
+              << "  --exposure <e>       scales the radiance before it is tonemapped (default 1)\n"
+              << "  --abbe <number>      Abbe number of the glass sphere, disperses the light into colors (default 0, no dispersion)\n"
+              << "  --preview            renders coarse preview levels before the first full resolution frame\n"
+              << "  --denoise            filters the image before writing it\n"
+              << "  --benchmark          times the triangle kernels and the BVH traversal after loading\n";
+}
+
+bool parse_arguments(const int argc, char* argv[], ray_tracer_settings& settings, uint32_t& frames, std::string& output, bool& denoise,
+                     std::string& stats_json, bool& preview, tile& region)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string argument = argv[i];
+        if (argument == "--help" || argument == "-h")
+        {
+            return false;
+        }
+        if (argument == "--benchmark")
+        {
+            settings.benchmark = true;
+            continue;
+        }
+        if (argument == "--denoise")
+        {
+            denoise = true;
+            continue;
+        }
+        if (argument == "--preview")
+        {
+            preview = true;
+            continue;
+        }
+        if (argument == "--no-scene-cache")
+        {
+            settings.scene_cache = false;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            std::cerr << "missing value for " << argument << std::endl;
+            return false;
+        }
+        const std::string value = argv[++i];
+        if (argument == "--scene")
+            settings.scene_path = value;
+        else if (argument == "--environment")
+            settings.environment_path = value;
+        else if (argument == "--texture")
+            settings.texture_path = value;
+        else if (argument == "--scene-cache")
+            settings.scene_cache_directory = value;
+        else if (argument == "--instances")
+            settings.mesh_instances = std::stoul(value);
+        else if (argument == "--width")
+            settings.width = std::stoul(value);
+        else if (argument == "--height")
+            settings.height = std::stoul(value);
+        else if (argument == "--spp")
+            settings.samples_per_pixel = std::stoul(value);
+        else if (argument == "--max-rays")
+            settings.max_rays = std::stoul(value);
+        else if (argument == "--target-error")
+            settings.target_error = std::stof(value);
+        else if (argument == "--time-budget")
+            settings.time_budget_milliseconds = std::stod(value);
+        else if (argument == "--threads")
+            settings.thread_count = std::stoul(value);
+        else if (argument == "--frames")
+            frames = std::stoul(value);
+        else if (argument == "--output")
+            output = value;
+        else if (argument == "--stats-json")
+            stats_json = value;
+        else if (argument == "--aperture")
+            settings.aperture = std::stof(value);
+        else if (argument == "--focus-distance")
+            settings.focus_distance = std::stof(value);
+        else if (argument == "--exposure")
+            settings.exposure = std::stof(value);
+        else if (argument == "--tone-map")
+        {
+            if (value == "clamp")
+                settings.tone_mapping_operator = tone_mapping::clamp;
+            else if (value == "reinhard")
+                settings.tone_mapping_operator = tone_mapping::reinhard;
+            else
+            {
+                std::cerr << "--tone-map expects clamp or reinhard" << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--abbe")
+            settings.glass_abbe_number = std::stof(value);
+        else if (argument == "--motion")
+        {
+            if (std::sscanf(value.c_str(), "%f,%f,%f", &settings.mesh_motion.x, &settings.mesh_motion.y, &settings.mesh_motion.z) != 3)
+            {
+                std::cerr << "--motion expects x,y,z" << std::endl;
+                return false;
+            }
+        }
+        else if (argument == "--region")
+        {
+            uint32_t x, y, w, h;
+            if (std::sscanf(value.c_str(), "%u,%u,%u,%u", &x, &y, &w, &h) != 4 || w == 0 || h == 0)
+            {
+                std::cerr << "--region expects x,y,width,height" << std::endl;
+                return false;
+            }
+            region = {x, y, x + w, y + h};
+        }
+        else
+        {
+            std::cerr << "unknown option " << argument << std::endl;
+            return false;
+        }
+    }
+    return settings.width > 0 && settings.height > 0 && frames > 0;
+}
+
+double elapsed_milliseconds(const std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+}// namespace
+
+int main(int argc, char* argv[])
+{
+    ray_tracer_settings settings;
+    uint32_t frames{1};
+    std::string output{"raytracer.png"};
+    bool denoise{false};
+    std::string stats_json;
+    bool preview{false};
+    tile region{};
+    try
+    {
+        if (!parse_arguments(argc, argv, settings, frames, output, denoise, stats_json, preview, region))
+        {
+            print_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    catch (const std::exception&)
+    {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const auto setup_start = std::chrono::steady_clock::now();
+    RayTracer ray_tracer(settings);
+    const double setup_milliseconds = elapsed_milliseconds(setup_start);
+
+    //a target error or a time budget accumulates one sample per pass until they are met or --spp passes are done
+    const bool progressive = settings.target_error > 0.0f || settings.time_budget_milliseconds > 0.0;
+    if (progressive)
+    {
+        ray_tracer.set_progressive(true);
+        frames = 1;
+    }
+
+    if (region.x_end > 0)
+    {
+        ray_tracer.set_region(region);
+    }
+    //the preview starts at the next restart, timed apart from the frames
+    std::vector<std::pair<uint32_t, double>> preview_levels;
+    if (preview)
+    {
+        ray_tracer.set_preview(true);
+        ray_tracer.renderer.restart();
+        while (ray_tracer.preview_pending())
+        {
+            const auto level_start = std::chrono::steady_clock::now();
+            ray_tracer.run();
+            ray_tracer.wait_for_frame();
+            preview_levels.emplace_back(ray_tracer.renderer.get_frame_block(), elapsed_milliseconds(level_start));
+        }
+    }
+
+    ray_tracer.renderer.reset_worker_stats();
+    const auto render_start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < frames; ++frame)
+    {
+        do
+        {
+            ray_tracer.run();
+            ray_tracer.wait_for_frame();
+        } while (progressive && !ray_tracer.converged() && ray_tracer.samples_per_pixel() < settings.samples_per_pixel);
+    }
+    const double render_milliseconds = elapsed_milliseconds(render_start);
+    //taken before the denoiser runs on the same workers
+    const render_stats stats = ray_tracer.renderer.get_stats();
+
+    const auto denoise_start = std::chrono::steady_clock::now();
+    if (denoise)
+    {
+        ray_tracer.denoise();
+    }
+    const double denoise_milliseconds = elapsed_milliseconds(denoise_start);
+
+    const auto write_start = std::chrono::steady_clock::now();
+    const bool written = stbi_write_png(output.c_str(), static_cast<int>(settings.width), static_cast<int>(settings.height), 3,
+                                        ray_tracer.image.get_pixel_data(), static_cast<int>(settings.width * 3)) != 0;
+    const double write_milliseconds = elapsed_milliseconds(write_start);
+    if (!written)
+    {
+        std::cerr << "could not write " << output << std::endl;
+    }
+
+    const ray_counters totals = stats.totals();
+
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "Scene: " << settings.scene_path << ", " << settings.width << "x" << settings.height << ", " << settings.samples_per_pixel
+              << " spp, max " << settings.max_rays << " rays, " << stats.workers.size() << " threads" << std::endl;
+    std::cout << "Setup: " << setup_milliseconds << " ms (scene load and BVH build " << ray_tracer.load_milliseconds << " ms)" << std::endl;
+    for (const auto& [block, milliseconds]: preview_levels)
+    {
+        std::cout << "Preview: " << (block > 1 ? "1/" + std::to_string(block) : std::string{"full"}) << " resolution in " << milliseconds << " ms"
+                  << std::endl;
+    }
+    if (progressive)
+    {
+        uint64_t samples{0};
+        const uint32_t pixel_count = settings.width * settings.height;
+        for (uint32_t pixel = 0; pixel < pixel_count; ++pixel)
+            samples += ray_tracer.image.get_sample_count_at(pixel);
+        std::cout << "Render: " << render_milliseconds << " ms, " << ray_tracer.samples_per_pixel() << " passes, "
+                  << static_cast<double>(samples) / pixel_count << " samples per pixel on average"
+                  << (ray_tracer.renderer.converged() ? ", target error reached" : "") << std::endl;
+    }
+    else
+    {
+        std::cout << "Render: " << render_milliseconds / frames << " ms per frame over " << frames << " frames" << std::endl;
+    }
+    if (denoise)
+    {
+        std::cout << "Denoise: " << denoise_milliseconds << " ms" << std::endl;
+    }
+    std::cout << "Write: " << write_milliseconds << " ms (" << output << ")" << std::endl;
+    std::cout << "Rays: " << totals.rays() << ", " << totals.rays() / (render_milliseconds * 1.0e3) << " Mrays/s ("
+              << totals.primary_rays << " primary, " << totals.shadow_rays << " shadow, " << totals.secondary_rays << " secondary)" << std::endl;
+    std::cout << "Tests: " << static_cast<double>(totals.node_tests) / std::max<uint64_t>(1, totals.rays()) << " nodes and "
+              << static_cast<double>(totals.triangle_tests) / std::max<uint64_t>(1, totals.rays()) << " triangles per ray, "
+              << totals.average_bounces() << " bounces per path" << std::endl;
+    const double busy_milliseconds = std::max(stats.busy_milliseconds(), 1.0e-3);
+    std::cout << "Phases: traversal " << stats.traversal_milliseconds() / busy_milliseconds * 100.0 << "%, shading "
+              << stats.shading_milliseconds() / busy_milliseconds * 100.0 << "%, image write "
+              << stats.image_write_milliseconds() / busy_milliseconds * 100.0 << "%" << std::endl;
+    float tile_min, tile_mean, tile_max;
+    stats.tile_milliseconds(tile_min, tile_mean, tile_max);
+    std::cout << "Tiles: " << tile_min << " / " << tile_mean << " / " << tile_max << " ms min / mean / max in the last frame" << std::endl;
+    for (size_t i = 0; i < stats.workers.size(); ++i)
+    {
+        const worker_stats& worker = stats.workers[i];
+        std::cout << "Thread " << i << ": " << worker.busy_milliseconds / render_milliseconds * 100.0 << "% busy, "
+                  << worker.tiles << " tiles (" << worker.stolen_tiles << " stolen), " << worker.counters.rays() << " rays" << std::endl;
+    }
+    if (!stats_json.empty())
+    {
+        std::ofstream json(stats_json);
+        stats.write_json(json);
+        if (!json)
+        {
+            std::cerr << "could not write " << stats_json << std::endl;
+        }
+    }
+
+    return written ? EXIT_SUCCESS : EXIT_FAILURE;
+}